@@ -0,0 +1,29 @@
+/*
+ * bench.h: Helpers for the benchmark programs
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline uint64_t NowUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline void ReportRate(const char *Name, double Bytes, uint64_t Us)
+{
+  printf("%-40s %10.1f MB/s\n", Name, Us ? Bytes / Us : 0);
+}
+
+#endif //__BENCH_H
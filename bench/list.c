@@ -0,0 +1,95 @@
+/*
+ * list.c: Benchmark of cList versus cVectorList
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+// Usage: bench/list [count]
+// Builds a list of 'count' (default 10000) objects and walks it through Get()
+// and cListObject::Index(), the way cChannels does.
+
+#include "tools.h"
+#include <stdlib.h>
+#include "bench.h"
+
+#define DEFAULTCOUNT 10000
+
+class cItem : public cListObject {
+private:
+  int value;
+public:
+  cItem(int Value) { value = Value; }
+  int Value(void) const { return value; }
+  virtual int Compare(const cListObject &ListObject) const { return value - ((const cItem *)&ListObject)->value; }
+  };
+
+static void ReportTime(const char *Name, uint64_t Us)
+{
+  printf("%-40s %10.3f ms\n", Name, Us / 1000.0);
+}
+
+template<class T> static bool Bench(const char *Name, int Count)
+{
+  printf("%s (%d objects):\n", Name, Count);
+  bool Ok = true;
+  T List;
+  srand(1);
+  uint64_t Start = NowUs();
+  for (int i = 0; i < Count; i++)
+      List.Add(new cItem(rand()));
+  ReportTime("  Add()", NowUs() - Start);
+
+  Start = NowUs();
+  List.Sort();
+  ReportTime("  Sort()", NowUs() - Start);
+  for (cItem *Item = List.First(); Item && List.Next(Item); Item = List.Next(Item)) {
+      if (Item->Value() > List.Next(Item)->Value()) {
+         printf("  ERROR: list is not sorted\n");
+         Ok = false;
+         break;
+         }
+      }
+
+  Start = NowUs();
+  int i = 0;
+  for (cItem *Item = List.First(); Item; Item = List.Next(Item), i++) {
+      if (List.Get(i) != Item) {
+         printf("  ERROR: Get(%d) returns the wrong object\n", i);
+         Ok = false;
+         break;
+         }
+      }
+  ReportTime("  Get() for all objects", NowUs() - Start);
+
+  Start = NowUs();
+  i = 0;
+  for (cItem *Item = List.First(); Item; Item = List.Next(Item), i++) {
+      if (Item->Index() != i) {
+         printf("  ERROR: Index() returns %d instead of %d\n", Item->Index(), i);
+         Ok = false;
+         break;
+         }
+      }
+  ReportTime("  Index() for all objects", NowUs() - Start);
+
+  Start = NowUs();
+  while (cItem *Item = List.First())
+        List.Del(Item);
+  ReportTime("  Del() from the front", NowUs() - Start);
+  return Ok;
+}
+
+int main(int argc, char *argv[])
+{
+  int Count = argc > 1 ? atoi(argv[1]) : DEFAULTCOUNT;
+  if (Count <= 0) {
+     fprintf(stderr, "usage: %s [count]\n", argv[0]);
+     return 2;
+     }
+  bool Ok = Bench<cList<cItem> >("cList", Count);
+  Ok &= Bench<cVectorList<cItem> >("cVectorList", Count);
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+ * remuxreaders.c: Test of several readers sharing one remuxer
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+// Usage: bench/remuxreaders
+// Feeds a synthetic MPEG-2 video stream into a shared remuxer while one of
+// its readers stalls, and checks that the other one still gets every frame.
+// The stalled reader either never calls Get() at all, or holds on to the
+// data of one Get() without calling Del(). Returns 0 if all checks pass.
+
+#include "remux.h"
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+#define VPID          0x100
+#define FRAMEPACKETS  8         // TS packets per frame
+#define GOPSIZE       12
+#define TOTALBYTES    MEGABYTE(64)
+
+class cStream {
+private:
+  int frame;
+  int cc;
+public:
+  cStream(void) { frame = 0; cc = 0; }
+  int Frames(void) { return frame; }
+  int NextFrame(uchar *Data);
+       // Stores the TS packets of the next frame in Data and returns their size.
+  };
+
+int cStream::NextFrame(uchar *Data)
+{
+  memset(Data, 0xFF, FRAMEPACKETS * TS_SIZE);
+  for (int i = 0; i < FRAMEPACKETS; i++) {
+      uchar *p = Data + i * TS_SIZE;
+      p[0] = TS_SYNC_BYTE;
+      p[1] = (i == 0 ? 0x40 : 0x00) | (VPID >> 8);
+      p[2] = VPID & 0xFF;
+      p[3] = 0x10 | (cc++ & 0x0F);
+      }
+  uchar *p = Data + 4;
+  // PES header:
+  static const uchar Pes[] = { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x00, 0x00 };
+  memcpy(p, Pes, sizeof(Pes));
+  p += sizeof(Pes);
+  // Picture start code with the picture type, followed by the frame number:
+  p[0] = 0x00;
+  p[1] = 0x00;
+  p[2] = 0x01;
+  p[3] = SC_PICTURE;
+  p[4] = 0x00;
+  p[5] = (frame % GOPSIZE ? P_FRAME : I_FRAME) << 3;
+  p[6] = 0x80 | ((frame >> 21) & 0x7F);
+  p[7] = 0x80 | ((frame >> 14) & 0x7F);
+  p[8] = 0x80 | ((frame >> 7) & 0x7F);
+  p[9] = 0x80 | (frame & 0x7F);
+  frame++;
+  return FRAMEPACKETS * TS_SIZE;
+}
+
+// Returns the number of the frame that starts in the PES packet at Data, or -1:
+static int FrameNumber(const uchar *Data, int Count)
+{
+  for (int i = 0; i + 10 <= Count; i++) {
+      if (Data[i] == 0x00 && Data[i + 1] == 0x00 && Data[i + 2] == 0x01 && Data[i + 3] == SC_PICTURE) {
+         const uchar *p = Data + i + 6;
+         return ((p[0] & 0x7F) << 21) | ((p[1] & 0x7F) << 14) | ((p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+         }
+      }
+  return -1;
+}
+
+class cReader {
+private:
+  const char *name;
+  cRemux *remux;
+  int expected;
+  int frames;
+  int errors;
+public:
+  cReader(const char *Name, cRemux *Remux) { name = Name; remux = Remux; expected = -1; frames = 0; errors = 0; }
+  int Frames(void) { return frames; }
+  int Errors(void) { return errors; }
+  void Read(void);
+       // Reads and checks all data that is currently available.
+  };
+
+void cReader::Read(void)
+{
+  int Count;
+  uchar PictureType;
+  while (uchar *p = remux->Get(Count, &PictureType, 1)) {
+        int n = FrameNumber(p, Count);
+        if (n >= 0) {
+           if (expected >= 0 && n != expected) {
+              if (errors++ < 10)
+                 printf("  ERROR: %s got frame %d instead of %d\n", name, n, expected);
+              }
+           expected = n + 1;
+           frames++;
+           }
+        remux->Del(Count);
+        }
+}
+
+static bool Run(const char *Name, bool Hold)
+{
+  printf("%s:\n", Name);
+  tChannelID ChannelID = tChannelID::FromString("S19.2E-1-1-1");
+  cRemux *Stalled = cRemux::Acquire(ChannelID, VPID, NULL, NULL, NULL);
+  cRemux *Remux = cRemux::Acquire(ChannelID, VPID, NULL, NULL, NULL);
+  Stalled->SetTimeouts(0, 0);
+  Remux->SetTimeouts(0, 0);
+  cStream Stream;
+  cReader Reader("reader", Remux);
+  uchar Frame[FRAMEPACKETS * TS_SIZE];
+  uchar *Held = NULL;
+  uchar Copy[FRAMEPACKETS * TS_SIZE];
+  int HeldCount = 0;
+  int Bytes = 0;
+  uint64_t Start = NowUs();
+  while (Bytes < TOTALBYTES) {
+        int Count = Stream.NextFrame(Frame);
+        // Stalled is the first one and therefore feeds the repackers:
+        if (Stalled->Put(Frame, Count) != Count) {
+           printf("  ERROR: frame %d not accepted\n", Stream.Frames() - 1);
+           break;
+           }
+        Bytes += Count;
+        if (Hold && !Held) {
+           uchar PictureType;
+           if ((Held = Stalled->Get(HeldCount, &PictureType, 1)) != NULL) {
+              HeldCount = min(HeldCount, int(sizeof(Copy)));
+              memcpy(Copy, Held, HeldCount);
+              }
+           }
+        Reader.Read();
+        }
+  uint64_t Us = NowUs() - Start;
+  ReportRate("  remuxed", Bytes, Us);
+  bool Ok = Reader.Errors() == 0;
+  // Allow for the frames before the first I-frame and the one still being assembled:
+  if (Reader.Frames() < Stream.Frames() - GOPSIZE - 1) {
+     printf("  ERROR: reader got %d of %d frames\n", Reader.Frames(), Stream.Frames());
+     Ok = false;
+     }
+  if (Held && memcmp(Held, Copy, HeldCount) != 0) {
+     printf("  ERROR: the data held by the stalled reader has been overwritten\n");
+     Ok = false;
+     }
+  printf("  %d frames, reader got %d\n", Stream.Frames(), Reader.Frames());
+  // Once the stalled reader goes on, it syncs again and gets new data:
+  if (Held)
+     Stalled->Del(HeldCount);
+  cReader Resumed("resumed reader", Stalled);
+  Resumed.Read(); // loses what it has missed
+  for (int i = 0; i < 4 * GOPSIZE; i++) {
+      int Count = Stream.NextFrame(Frame);
+      Stalled->Put(Frame, Count);
+      Resumed.Read();
+      Reader.Read();
+      }
+  if (Resumed.Frames() < 2 * GOPSIZE || Resumed.Errors()) {
+     printf("  ERROR: resumed reader got %d frames with %d errors\n", Resumed.Frames(), Resumed.Errors());
+     Ok = false;
+     }
+  delete Remux;
+  delete Stalled;
+  return Ok;
+}
+
+int main(int argc, char *argv[])
+{
+  bool Ok = Run("stalled reader never calls Get()", false);
+  Ok &= Run("stalled reader holds its data", true);
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+/*
+ * ringbuffer.c: Benchmark of cRingBufferLinear against cRingBufferLinearSPSC
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#include "ringbuffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tsscan.h"
+#include "bench.h"
+
+#define BUFFERSIZE  (MEGABYTE(2) / TS_SIZE * TS_SIZE)
+#define CHUNK       (7 * TS_SIZE)
+#define TOTAL       (MEGABYTE(512) / CHUNK * CHUNK)
+#define PINGS       2000
+#define PINGDELAY   500 // microseconds the producer waits between two pings, so that the consumer goes to sleep
+
+template<class T> class cProducer : public cThread {
+private:
+  T *buffer;
+  bool ping;
+protected:
+  virtual void Action(void)
+  {
+    uchar Data[CHUNK];
+    memset(Data, 0x47, sizeof(Data));
+    if (ping) {
+       for (int i = 0; i < PINGS && Running(); i++) {
+           usleep(PINGDELAY);
+           uint64_t Now = NowUs();
+           memcpy(Data, &Now, sizeof(Now));
+           while (Running() && !buffer->Put(Data, TS_SIZE))
+                 ;
+           }
+       }
+    else {
+       for (int Sent = 0; Sent < TOTAL && Running(); ) {
+           int n = buffer->Put(Data, CHUNK);
+           Sent += n;
+           }
+       }
+  }
+public:
+  cProducer(T *Buffer, bool Ping) { buffer = Buffer; ping = Ping; }
+  virtual ~cProducer() { Cancel(3); }
+  };
+
+template<class T> static void Throughput(const char *Name)
+{
+  T Buffer(BUFFERSIZE, TS_SIZE);
+  Buffer.SetTimeouts(100, 100);
+  cProducer<T> Producer(&Buffer, false);
+  uint64_t Start = NowUs();
+  Producer.Start();
+  for (int Received = 0; Received < TOTAL; ) {
+      int Count;
+      if (uchar *p = Buffer.Get(Count)) {
+         Count -= Count % TS_SIZE;
+         if (Count > 0 && *p == 0x47) {
+            Buffer.Del(Count);
+            Received += Count;
+            }
+         }
+      }
+  ReportRate(Name, TOTAL, NowUs() - Start);
+}
+
+template<class T> static void Latency(const char *Name)
+{
+  T Buffer(BUFFERSIZE, TS_SIZE);
+  Buffer.SetTimeouts(100, 100);
+  cProducer<T> Producer(&Buffer, true);
+  Producer.Start();
+  uint64_t Sum = 0, Max = 0;
+  for (int Received = 0; Received < PINGS; ) {
+      int Count;
+      if (uchar *p = Buffer.Get(Count)) {
+         uint64_t Sent;
+         memcpy(&Sent, p, sizeof(Sent));
+         uint64_t d = NowUs() - Sent;
+         Sum += d;
+         if (d > Max)
+            Max = d;
+         Buffer.Del(TS_SIZE);
+         Received++;
+         }
+      }
+  printf("%-40s %10.1f us average, %llu us max\n", Name, double(Sum) / PINGS, (unsigned long long)Max);
+}
+
+int main(void)
+{
+  Throughput<cRingBufferLinear>("cRingBufferLinear throughput");
+  Throughput<cRingBufferLinearSPSC>("cRingBufferLinearSPSC throughput");
+  Latency<cRingBufferLinear>("cRingBufferLinear wakeup latency");
+  Latency<cRingBufferLinearSPSC>("cRingBufferLinearSPSC wakeup latency");
+  return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * startcode.c: Benchmark of the video start code scanner
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+// Usage: bench/startcode [file...]
+// The files are MPEG-2 or H.264 captures (PES or TS data). If no file is
+// given, synthetic data with some start codes and runs of zero bytes is used.
+
+#include "tsscan.h"
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+// The plain C versions, for comparison:
+namespace Scalar {
+#define SCALARTSSCAN
+#include "../tsscan.c"
+#undef SCALARTSSCAN
+}
+
+#define SYNTHETICSIZE MEGABYTE(64)
+#define MINBYTES      MEGABYTE(1024) // scanned per function, repeating the data as necessary
+#define MAXOFFSETS    256
+
+// The way ScanVideoPacket() used to look for start codes:
+static int ByteByByte(const uchar *Data, int Count, int *Offsets, int Max)
+{
+  int Found = 0;
+  for (int n = 0; n + 2 < Count && Found < Max; n++) {
+      if (Data[n] == 0 && Data[n + 1] == 0 && Data[n + 2] == 1)
+         Offsets[Found++] = n;
+      }
+  return Found;
+}
+
+typedef int (*tFindStartCodes)(const uchar *Data, int Count, int *Offsets, int Max);
+
+// Collects all start codes in Data, MAXOFFSETS at a time, and returns their
+// number. If Offsets is given, they are stored there.
+static int Scan(const uchar *Data, int Count, tFindStartCodes Find, int *Offsets)
+{
+  int Buffer[MAXOFFSETS];
+  int Total = 0;
+  int n = 0;
+  for (;;) {
+      int Found = Find(Data + n, Count - n, Buffer, MAXOFFSETS);
+      if (Offsets) {
+         for (int i = 0; i < Found; i++)
+             Offsets[Total + i] = n + Buffer[i];
+         }
+      Total += Found;
+      if (Found < MAXOFFSETS)
+         break;
+      n += Buffer[Found - 1] + 1;
+      }
+  return Total;
+}
+
+static int *Run(const char *Name, const uchar *Data, int Count, tFindStartCodes Find, int &Found)
+{
+  Found = Scan(Data, Count, Find, NULL);
+  int *Offsets = MALLOC(int, Found + 1);
+  Scan(Data, Count, Find, Offsets);
+  int Passes = MINBYTES / Count + 1;
+  uint64_t Start = NowUs();
+  for (int i = 0; i < Passes; i++)
+      Scan(Data, Count, Find, NULL);
+  ReportRate(Name, double(Count) * Passes, NowUs() - Start);
+  return Offsets;
+}
+
+static uchar *Synthesize(int &Count)
+{
+  uchar *Data = MALLOC(uchar, SYNTHETICSIZE);
+  srand(1);
+  for (int i = 0; i < SYNTHETICSIZE; i++)
+      Data[i] = rand() % 256;
+  for (int n = 0; n < SYNTHETICSIZE - 64; n += rand() % 4096) {
+      switch (rand() % 3) {
+        case 0: // a start code
+             Data[n] = Data[n + 1] = 0;
+             Data[n + 2] = 1;
+             break;
+        case 1: // a run of zeros, maybe followed by a start code
+             memset(Data + n, 0, rand() % 60);
+             break;
+        default: // two bytes of a start code
+             Data[n] = Data[n + 1] = 0;
+             Data[n + 2] = 2;
+        }
+      }
+  Count = SYNTHETICSIZE;
+  return Data;
+}
+
+static uchar *Load(const char *FileName, int &Count)
+{
+  FILE *f = fopen(FileName, "r");
+  if (!f) {
+     perror(FileName);
+     return NULL;
+     }
+  fseek(f, 0, SEEK_END);
+  long Size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (Size > MEGABYTE(512))
+     Size = MEGABYTE(512);
+  uchar *Data = MALLOC(uchar, Size);
+  Count = Data ? fread(Data, 1, Size, f) : 0;
+  fclose(f);
+  return Data;
+}
+
+static bool Compare(const char *Name, const int *Offsets, int Found, const int *Expected, int ExpectedFound)
+{
+  if (Found != ExpectedFound) {
+     printf("  ERROR: %s found %d start codes instead of %d\n", Name, Found, ExpectedFound);
+     return false;
+     }
+  for (int i = 0; i < Found; i++) {
+      if (Offsets[i] != Expected[i]) {
+         printf("  ERROR: %s found start code #%d at offset %d instead of %d\n", Name, i, Offsets[i], Expected[i]);
+         return false;
+         }
+      }
+  return true;
+}
+
+static bool Bench(const char *Name, const uchar *Data, int Count)
+{
+  printf("%s (%d bytes):\n", Name, Count);
+  int b, s, v;
+  int *Before = Run("  byte by byte", Data, Count, ByteByByte, b);
+  int *Plain = Run("  plain C", Data, Count, Scalar::FindStartCodes, s);
+  int *Vector = Run("  tsscan", Data, Count, FindStartCodes, v);
+  printf("  %d start codes\n", b);
+  bool Ok = Compare("plain C", Plain, s, Before, b) && Compare("tsscan", Vector, v, Before, b);
+  // FindStartCode() must agree with the first one found:
+  int First = b ? Before[0] : -1;
+  if (Scalar::FindStartCode(Data, Count) != First || FindStartCode(Data, Count) != First) {
+     printf("  ERROR: FindStartCode() doesn't find the first start code at %d\n", First);
+     Ok = false;
+     }
+  free(Before);
+  free(Plain);
+  free(Vector);
+  return Ok;
+}
+
+int main(int argc, char *argv[])
+{
+  bool Ok = true;
+  if (argc > 1) {
+     for (int i = 1; i < argc; i++) {
+         int Count;
+         if (uchar *Data = Load(argv[i], Count)) {
+            Ok &= Bench(argv[i], Data, Count);
+            free(Data);
+            }
+         else
+            Ok = false;
+         }
+     }
+  else {
+     int Count;
+     uchar *Data = Synthesize(Count);
+     Ok = Bench("synthetic", Data, Count);
+     free(Data);
+     }
+  return Ok ? 0 : 1;
+}
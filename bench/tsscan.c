@@ -0,0 +1,148 @@
+/*
+ * tsscan.c: Benchmark of the TS sync and PID run scanning functions
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+// Usage: bench/tsscan [file...]
+// The files are recorded transponder dumps (raw TS data). If no file is
+// given, a synthetic stream with short PID runs and some garbage in between
+// is used.
+
+#include "tsscan.h"
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+// The plain C versions, for comparison:
+namespace Scalar {
+#define SCALARTSSCAN
+#include "../tsscan.c"
+#undef SCALARTSSCAN
+}
+
+#define SYNTHETICSIZE MEGABYTE(64)
+#define MINBYTES      MEGABYTE(1024) // scanned per function, repeating the data as necessary
+
+struct tScanResult {
+  int synced;
+  int runs;
+  bool operator!=(const tScanResult &r) const { return synced != r.synced || runs != r.runs; }
+  };
+
+// Walks through Data the way cDevice::Action() and cTSBuffer do: skips
+// garbage up to the next sync byte, takes the synced packets and splits
+// them into runs of the same PID.
+static tScanResult Scan(const uchar *Data, int Count, int (*Synced)(const uchar *, int), int (*PidRun)(const uchar *, int))
+{
+  tScanResult r = { 0, 0 };
+  int n = 0;
+  while (n + TS_SIZE <= Count) {
+        if (Data[n] != TS_SYNC_BYTE) {
+           n++;
+           continue;
+           }
+        int Length = Synced(Data + n, Count - n);
+        if (!Length) {
+           n++;
+           continue;
+           }
+        r.synced += Length;
+        for (int i = 0; i < Length; r.runs++)
+            i += PidRun(Data + n + i, Length - i);
+        n += Length;
+        }
+  return r;
+}
+
+static tScanResult Run(const char *Name, const uchar *Data, int Count, int (*Synced)(const uchar *, int), int (*PidRun)(const uchar *, int))
+{
+  tScanResult r = Scan(Data, Count, Synced, PidRun);
+  int Passes = MINBYTES / Count + 1;
+  uint64_t Start = NowUs();
+  for (int i = 0; i < Passes; i++)
+      Scan(Data, Count, Synced, PidRun);
+  ReportRate(Name, double(Count) * Passes, NowUs() - Start);
+  return r;
+}
+
+static uchar *Synthesize(int &Count)
+{
+  uchar *Data = MALLOC(uchar, SYNTHETICSIZE);
+  int n = 0;
+  srand(1);
+  while (n + 21 * TS_SIZE + TS_SIZE <= SYNTHETICSIZE) {
+        int Pid = rand() % 0x1FFF;
+        for (int i = rand() % 20 + 1; i > 0; i--) {
+            memset(Data + n, 0xFF, TS_SIZE);
+            Data[n] = TS_SYNC_BYTE;
+            Data[n + 1] = Pid >> 8;
+            Data[n + 2] = Pid & 0xFF;
+            n += TS_SIZE;
+            }
+        if (rand() % 100 == 0) {
+           int Garbage = rand() % (TS_SIZE - 1) + 1;
+           memset(Data + n, 0x00, Garbage);
+           n += Garbage;
+           }
+        }
+  Count = n;
+  return Data;
+}
+
+static uchar *Load(const char *FileName, int &Count)
+{
+  FILE *f = fopen(FileName, "r");
+  if (!f) {
+     perror(FileName);
+     return NULL;
+     }
+  fseek(f, 0, SEEK_END);
+  long Size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (Size > MEGABYTE(512))
+     Size = MEGABYTE(512);
+  uchar *Data = MALLOC(uchar, Size);
+  Count = Data ? fread(Data, 1, Size, f) : 0;
+  fclose(f);
+  return Data;
+}
+
+static bool Bench(const char *Name, const uchar *Data, int Count)
+{
+  printf("%s (%d bytes):\n", Name, Count);
+  tScanResult s = Run("  plain C", Data, Count, Scalar::TsSynced, Scalar::TsPidRun);
+  tScanResult v = Run("  tsscan", Data, Count, TsSynced, TsPidRun);
+  printf("  %d bytes in sync, %d PID runs\n", s.synced, s.runs);
+  if (s != v) {
+     printf("  ERROR: tsscan found %d bytes in sync and %d PID runs\n", v.synced, v.runs);
+     return false;
+     }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  bool Ok = true;
+  if (argc > 1) {
+     for (int i = 1; i < argc; i++) {
+         int Count;
+         if (uchar *Data = Load(argv[i], Count)) {
+            Ok &= Bench(argv[i], Data, Count);
+            free(Data);
+            }
+         else
+            Ok = false;
+         }
+     }
+  else {
+     int Count;
+     uchar *Data = Synthesize(Count);
+     Ok = Bench("synthetic", Data, Count);
+     free(Data);
+     }
+  return Ok ? 0 : 1;
+}
@@ -216,6 +216,7 @@ cChannel::cChannel(void)
   guard        = GUARD_INTERVAL_AUTO;
   hierarchy    = HIERARCHY_AUTO;
   modification = CHANNELMOD_NONE;
+  idHash       = 0;
   schedule     = NULL;
   linkChannels = NULL;
   refChannel   = NULL;
@@ -227,6 +228,7 @@ cChannel::cChannel(const cChannel &Channel)
   shortName = NULL;
   provider = NULL;
   portalName = NULL;
+  idHash       = 0;
   schedule     = NULL;
   linkChannels = NULL;
   refChannel   = NULL;
@@ -919,10 +921,76 @@ public:
 
 cChannels Channels;
 
+#define MAXINDEXEDNUMBER 100000 // channel numbers beyond this are looked up the slow way
+
 cChannels::cChannels(void)
 {
   maxNumber = 0;
   modified = CHANNELSMOD_NONE;
+  numberIndex = NULL;
+  numberIndexSize = 0;
+  numberIndexState = -1;
+  numbersAscending = false;
+  EnableVector(); // Get() is used for stepping through the channels
+}
+
+cChannels::~cChannels()
+{
+  free(numberIndex);
+}
+
+void cChannels::Reindex(void)
+{
+  numberIndexState = ListState();
+  numbersAscending = true;
+  int Last = 0;
+  for (cChannel *channel = First(); channel; channel = Next(channel)) {
+      if (!channel->GroupSep()) {
+         if (channel->Number() <= Last || channel->Number() > MAXINDEXEDNUMBER)
+            numbersAscending = false;
+         Last = channel->Number();
+         }
+      }
+  // GetByNumber() falls back to a linear search if the numbers are not in
+  // ascending order (which is the case after moving channels around until
+  // ReNumber() is called):
+  if (numbersAscending) {
+     cChannel **p = (cChannel **)realloc(numberIndex, (Last + 1) * sizeof(cChannel *));
+     if (!p) {
+        esyslog("ERROR: can't allocate channel number index");
+        numbersAscending = false;
+        return;
+        }
+     numberIndex = p;
+     numberIndexSize = Last + 1;
+     memset(numberIndex, 0, numberIndexSize * sizeof(cChannel *));
+     for (cChannel *channel = First(); channel; channel = Next(channel)) {
+         if (!channel->GroupSep())
+            numberIndex[channel->Number()] = channel;
+         }
+     }
+}
+
+void cChannels::Add(cListObject *Object, cListObject *After)
+{
+  cConfig<cChannel>::Add(Object, After);
+  cChannel *Channel = (cChannel *)Object;
+  if (!Channel->GroupSep())
+     HashChannel(Channel);
+}
+
+void cChannels::Ins(cListObject *Object, cListObject *Before)
+{
+  cConfig<cChannel>::Ins(Object, Before);
+  cChannel *Channel = (cChannel *)Object;
+  if (!Channel->GroupSep())
+     HashChannel(Channel);
+}
+
+void cChannels::Del(cListObject *Object, bool DeleteObject)
+{
+  UnhashChannel((cChannel *)Object);
+  cConfig<cChannel>::Del(Object, DeleteObject);
 }
 
 void cChannels::DeleteDuplicateChannels(void)
@@ -1017,11 +1085,14 @@ void cChannels::CheckTimers(cTimers& tmpTimers)
 void cChannels::HashChannel(cChannel *Channel)
 {
   channelsHashSid.Add(Channel, Channel->Sid());
+  Channel->idHash = Channel->GetChannelID().Hash();
+  channelsHashId.Add(Channel, Channel->idHash);
 }
 
 void cChannels::UnhashChannel(cChannel *Channel)
 {
   channelsHashSid.Del(Channel, Channel->Sid());
+  channelsHashId.Del(Channel, Channel->idHash); // the id may have changed since it was hashed
 }
 
 int cChannels::GetNextGroup(int Idx)
@@ -1059,6 +1130,7 @@ int cChannels::GetPrevNormal(int Idx)
 void cChannels::ReNumber( void )
 {
   channelsHashSid.Clear();
+  channelsHashId.Clear();
   int Number = 1;
   maxNumber = 0; // when empty channels.conf
   for (cChannel *channel = First(); channel; channel = Next(channel)) {
@@ -1072,10 +1144,29 @@ void cChannels::ReNumber( void )
          channel->SetNumber(Number++);
          }
       }
+  Reindex();
 }
 
 cChannel *cChannels::GetByNumber(int Number, int SkipGap)
 {
+  if (numbersAscending && numberIndexState == ListState()) {
+     int Last = numberIndexSize - 1;
+     if (Number > 0 && Number <= Last && numberIndex[Number])
+        return numberIndex[Number];
+     if (SkipGap > 0) {
+        for (int n = max(Number + 1, 1); n <= Last; n++) {
+            if (numberIndex[n])
+               return numberIndex[n];
+            }
+        }
+     else if (SkipGap < 0 && Number <= Last) {
+        for (int n = Number - 1; n > 0; n--) {
+            if (numberIndex[n])
+               return numberIndex[n];
+            }
+        }
+     return NULL;
+     }
   cChannel *previous = NULL;
   for (cChannel *channel = First(); channel; channel = Next(channel)) {
       if (!channel->GroupSep()) {
@@ -1104,6 +1195,16 @@ cChannel *cChannels::GetByServiceID(int Source, int Transponder, unsigned short
 
 cChannel *cChannels::GetByChannelID(tChannelID ChannelID, bool TryWithoutRid, bool TryWithoutPolarization)
 {
+  cList<cHashObject> *idList = channelsHashId.GetList(ChannelID.Hash());
+  if (idList) {
+     for (cHashObject *hobj = idList->First(); hobj; hobj = idList->Next(hobj)) {
+         cChannel *channel = (cChannel *)hobj->Object();
+         if (channel->GetChannelID() == ChannelID)
+            return channel;
+         }
+     }
+  // the transponder of a channel may have changed without it being rehashed, so
+  // we still need to check all channels with this sid:
   int sid = ChannelID.Sid();
   cList<cHashObject> *list = channelsHashSid.GetList(sid);
   if (list) {
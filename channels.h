@@ -81,6 +81,7 @@ public:
   tChannelID(int Source, int Nid, int Tid, int Sid, int Rid = 0) { source = Source; nid = Nid; tid = Tid; sid = Sid; rid = Rid; }
   bool operator== (const tChannelID &arg) const { return source == arg.source && nid == arg.nid && tid == arg.tid && sid == arg.sid && rid == arg.rid; }
   bool Valid(void) const { return (nid || tid) && sid; } // rid is optional and source may be 0//XXX source may not be 0???
+  unsigned int Hash(void) const { return (((((unsigned int)source * 31) + nid) * 31 + tid) * 31 + sid) * 31 + rid; }
   tChannelID &ClrRid(void) { rid = 0; return *this; }
   tChannelID &ClrPolarization(void);
   int Source(void) { return source; }
@@ -110,6 +111,7 @@ class cLinkChannels : public cList<cLinkChannel> {
 class cSchedule;
 
 class cChannel : public cListObject {
+  friend class cChannels;
   friend class cSchedules;
   friend class cMenuEditChannel;
   friend class cMenuEditBouquet;
@@ -152,6 +154,7 @@ private:
   int hierarchy;
   int __EndData__;
   int modification;
+  unsigned int idHash; // the key this channel has been hashed with in cChannels
   mutable const cSchedule *schedule;
   cLinkChannels *linkChannels;
   cChannel *refChannel;
@@ -236,9 +239,22 @@ private:
   int modified;
   int beingEdited;
   cHash<cChannel> channelsHashSid;
+  cHash<cChannel> channelsHashId;
+  cChannel **numberIndex;   // channel number -> channel (NULL for gaps)
+  int numberIndexSize;
+  int numberIndexState;     // ListState() at the time numberIndex was built
+  bool numbersAscending;
   void DeleteDuplicateChannels(void);
+  void Reindex(void);
+       ///< Rebuilds the number lookup table. Called by ReNumber(), the table is
+       ///< not used any more once the list has been modified in any other way.
 public:
   cChannels(void);
+  virtual ~cChannels();
+  virtual void Add(cListObject *Object, cListObject *After = NULL);
+  virtual void Ins(cListObject *Object, cListObject *Before = NULL);
+  virtual void Del(cListObject *Object, bool DeleteObject = true);
+       ///< These keep the channel hashes up to date.
   bool Load(const char *FileName, bool AllowComments = false, bool MustExist = false);
   bool Reload(const char *FileName, bool AllowComments = false, bool MustExist = false);
   ///< FileName can be null, then old file name will be used
@@ -306,6 +306,7 @@ cSetup::cSetup(void)
   LiveBufferSize = 30;
   CAMEnabled=7;
   UseBouquetList = 1;
+  UseDirectIO = 0;
 }
 
 cSetup& cSetup::operator= (const cSetup &s)
@@ -496,6 +497,8 @@ bool cSetup::Parse(const char *Name, const char *Value)
   else if (!strcasecmp(Name, "LiveBufferSize"))      LiveBufferSize     = atoi(Value);
   else if (!strcasecmp(Name, "CAMEnabled"))          CAMEnabled         = atoi(Value);
   else if (!strcasecmp(Name, "UseBouquetList"))      UseBouquetList	= atoi(Value);
+  else if (!strcasecmp(Name, "UseDirectIO"))         UseDirectIO        = atoi(Value);
+  else if (!strncasecmp(Name, "Thread", 6))          return cThread::SetThreadPolicy(Name + 6, Value);
   else
      return false;
   return true;
@@ -586,6 +589,12 @@ bool cSetup::Save(void)
   Store("LiveBufferSize",     LiveBufferSize);
   Store("CAMEnabled",         CAMEnabled);
   Store("UseBouquetList",     UseBouquetList);
+  Store("UseDirectIO",        UseDirectIO);
+  for (int i = 0; i < MAXTHREADCLASSES; i++) {
+      const char *Policy = cThread::ThreadPolicy(eThreadClass(i));
+      if (Policy)
+         Store(cString::sprintf("Thread%s", cThread::ThreadClassName(eThreadClass(i))), Policy);
+      }
 
   Sort();
 
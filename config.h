@@ -287,6 +287,7 @@ public:
   int LiveBufferSize;
   int CAMEnabled;
   int UseBouquetList;
+  int UseDirectIO;
   int __EndData__;
   cSetup(void);
   cSetup& operator= (const cSetup &s);
@@ -14,8 +14,6 @@
 #include "videodir.h"
 
 
-// --- cCuttingThread --------------------------------------------------------
-
 #ifndef CUTTER_MAX_BANDWIDTH
 #ifdef RBLITE
 #  define CUTTER_MAX_BANDWIDTH MEGABYTE(3) // 10 MB/s
@@ -26,45 +24,128 @@
 #ifndef CUTTER_REL_BANDWIDTH
 #  define CUTTER_REL_BANDWIDTH 75 // %
 #endif
-#ifndef CUTTER_PRIORITY
-#  define CUTTER_PRIORITY sched_get_priority_min(SCHED_OTHER)
+#ifndef CUTTER_BUSY_BANDWIDTH
+#  define CUTTER_BUSY_BANDWIDTH 25 // % while a recording or replay uses the same disk
+#endif
+#ifndef CUTTER_MAX_JOBS
+#ifdef RBLITE
+#  define CUTTER_MAX_JOBS 1
+#else
+#  define CUTTER_MAX_JOBS 2
+#endif
 #endif
 #define CUTTER_TIMESLICE   100   // ms
+#define CUTTER_BURST (CUTTER_MAX_BANDWIDTH * CUTTER_TIMESLICE / 1000) // max bytes/timeslice
+
+// --- cDiskThrottle ---------------------------------------------------------
+
+// The bandwidth limits apply to each disk, no matter how many cutting jobs
+// are reading from or writing to it, so jobs that share a disk share its
+// bandwidth.
+
+class cDiskThrottle : public cListObject {
+private:
+  static cMutex mutex;
+  static cList<cDiskThrottle> disks;
+  dev_t device;
+  int bytes;
+  uint64_t start;
+  cDiskThrottle(dev_t Device) { device = Device; bytes = 0; start = cTimeMs::Now(); }
+public:
+  static int Throttle(dev_t Device, int Bytes);
+       ///< Accounts for Bytes read from or written to the given Device and
+       ///< returns the number of milliseconds the caller shall sleep to stay
+       ///< within the limits.
+  };
+
+cMutex cDiskThrottle::mutex;
+cList<cDiskThrottle> cDiskThrottle::disks;
+
+int cDiskThrottle::Throttle(dev_t Device, int Bytes)
+{
+  cMutexLock MutexLock(&mutex);
+  cDiskThrottle *d;
+  for (d = disks.First(); d; d = disks.Next(d)) {
+      if (d->device == Device)
+         break;
+      }
+  if (!d)
+     disks.Add(d = new cDiskThrottle(Device));
+  d->bytes += Bytes;
+  if (d->bytes < CUTTER_BURST)
+     return 0;
+  uint64_t Now = cTimeMs::Now();
+  int elapsed = Now > d->start ? Now - d->start : 0;
+  int sleep = 0;
+  // stay under max. relative bandwidth, and back off if somebody is using the disk:
+  int Rel = VideoDiskBusy(Device) ? CUTTER_BUSY_BANDWIDTH : CUTTER_REL_BANDWIDTH;
+  if (Rel > 0 && Rel < 100)
+     sleep = (elapsed * 100 / Rel) - elapsed;
+  // stay under max. absolute bandwidth
+  if (elapsed < CUTTER_TIMESLICE)
+     sleep = max(CUTTER_TIMESLICE - elapsed, sleep);
+  d->bytes = 0;
+  d->start = Now + max(sleep, 0);
+  return sleep;
+}
+
+// --- cCuttingThread --------------------------------------------------------
 
 class cCuttingThread : public cThread {
 private:
   const char *error;
+  char *toName;
   cUnbufferedFile *fromFile, *toFile;
   cFileName *fromFileName, *toFileName;
   cIndexFile *fromIndex, *toIndex;
   cMarks fromMarks, toMarks;
   uchar *PATPMT;
+  int runOffset, runLength;
+  dev_t fromDevice, toDevice;
+  int totalFrames, doneFrames;
+  uint64_t startTime;
   void CheckTS(cUnbufferedFile *replayFile);
+  bool FlushRun(void);
 protected:
   virtual void Action(void);
 public:
   cCuttingThread(const char *FromFileName, const char *ToFileName);
   virtual ~cCuttingThread();
   const char *Error(void) { return error; }
+  int Progress(void) { return totalFrames > 0 ? min(doneFrames * 100 / totalFrames, 100) : 0; }
+  int Eta(void);
   };
 
 cCuttingThread::cCuttingThread(const char *FromFileName, const char *ToFileName)
 :cThread("video cutting")
 {
   error = NULL;
+  toName = strdup(ToFileName);
   fromFile = toFile = NULL;
   fromFileName = toFileName = NULL;
   fromIndex = toIndex = NULL;
+  PATPMT = NULL;
+  runOffset = runLength = 0;
+  totalFrames = doneFrames = 0;
+  startTime = 0;
   if (fromMarks.Load(FromFileName) && fromMarks.Count()) {
      fromFileName = new cFileName(FromFileName, false, true);
      toFileName = new cFileName(ToFileName, true, true);
      fromIndex = new cIndexFile(FromFileName, false);
      toIndex = new cIndexFile(ToFileName, true);
      toMarks.Load(ToFileName); // doesn't actually load marks, just sets the file name
-     Start();
+     for (cMark *m = fromMarks.First(); m; m = fromMarks.Next(m)) {
+         cMark *n = fromMarks.Next(m);
+         totalFrames += max((n ? n->position : fromIndex->Last()) - m->position, 0);
+         if (!n)
+            break;
+         m = n;
+         }
      }
   else
      esyslog("no editing marks found for %s", FromFileName);
+  fromDevice = VideoFileDevice(FromFileName);
+  toDevice = 0;
 }
 
 cCuttingThread::~cCuttingThread()
@@ -76,6 +157,14 @@ cCuttingThread::~cCuttingThread()
   delete toFileName;
   delete fromIndex;
   delete toIndex;
+  free(toName);
+}
+
+int cCuttingThread::Eta(void)
+{
+  if (doneFrames > 0 && startTime && doneFrames < totalFrames)
+     return int((cTimeMs::Now() - startTime) * (totalFrames - doneFrames) / doneFrames / 1000);
+  return -1;
 }
 
 void cCuttingThread::CheckTS(cUnbufferedFile *replayFile)
@@ -98,18 +187,30 @@ void cCuttingThread::CheckTS(cUnbufferedFile *replayFile)
    }
 }
 
+bool cCuttingThread::FlushRun(void)
+{
+  // Frames that are taken over unchanged are collected into runs of contiguous
+  // data in fromFile, which are then copied without passing through user space:
+  if (runLength > 0) {
+     if (toFile->CopyFrom(fromFile, runOffset, runLength) != runLength) {
+        error = "CopyFrom";
+        return false;
+        }
+     runLength = 0;
+     }
+  if (!toIndex->Flush()) {
+     error = "toIndex";
+     return false;
+     }
+  return true;
+}
+
 void cCuttingThread::Action(void)
 {
-  {
-    sched_param tmp;
-    tmp.sched_priority = CUTTER_PRIORITY;
-    if(!pthread_setschedparam(pthread_self(), SCHED_OTHER, &tmp))
-      printf("cCuttingThread::Action: cant set priority\n");
-  }
+  SetThreadClass(tcBackground);
 
   int bytes = 0;
-  int __attribute__((unused)) burst_size = CUTTER_MAX_BANDWIDTH * CUTTER_TIMESLICE / 1000; // max bytes/timeslice 
-  cTimeMs __attribute__((unused)) t;
+  startTime = cTimeMs::Now();
 
   cMark *Mark = fromMarks.First();
   if (Mark) {
@@ -117,6 +218,8 @@ void cCuttingThread::Action(void)
      toFile = toFileName->Open();
      if (!fromFile || !toFile)
         return;
+     // OpenVideoFile() has decided which video disk the edited version goes to:
+     toDevice = VideoFileDevice(toName);
      CheckTS(fromFile);
      fromFile->SetReadAhead(MEGABYTE(20));
      int Index = Mark->position;
@@ -124,6 +227,7 @@ void cCuttingThread::Action(void)
      int FileSize = 0;
      int CurrentFileNumber = 0;
      int LastIFrame = 0;
+     int LastIndex = toIndex->Last();
      toMarks.Add(0);
      toMarks.Save();
      uchar buffer[MAXFRAMESIZE];
@@ -138,26 +242,18 @@ void cCuttingThread::Action(void)
 
            AssertFreeDiskSpace(-1);
 
-           // Read one frame:
+           // Locate one frame:
 
            if (fromIndex->Get(Index++, &FileNumber, &FileOffset, &PictureType, &Length)) {
               if (FileNumber != CurrentFileNumber) {
+                 if (!FlushRun())
+                    break;
                  fromFile = fromFileName->SetOffset(FileNumber, FileOffset);
-                 fromFile->SetReadAhead(MEGABYTE(20));
+                 if (fromFile)
+                    fromFile->SetReadAhead(MEGABYTE(20));
                  CurrentFileNumber = FileNumber;
                  }
-              if (fromFile) {
-                 int len = ReadFrame(fromFile, buffer,  Length, sizeof(buffer));
-                 if (len < 0) {
-                    error = "ReadFrame";
-                    break;
-                    }
-                 if (len != Length) {
-                    CurrentFileNumber = 0; // this re-syncs in case the frame was larger than the buffer
-                    Length = len;
-                    }
-                 }
-              else {
+              if (!fromFile) {
                  error = "fromFile";
                  break;
                  }
@@ -167,18 +263,21 @@ void cCuttingThread::Action(void)
 
            // Write one frame:
 
+           bool Patch = false;
            if (PictureType == I_FRAME || PATPMT != NULL) { // every file shall start with an I_FRAME
               if (LastMark) // edited version shall end before next I-frame
                  break;
               if (FileSize == 0) {
                  if (PATPMT != NULL) {
-                    if (toFile->Write(PATPMT, 2*TS_SIZE) < 0) // Add PATPMT to start of every file
+                    if (!FlushRun() || toFile->Write(PATPMT, 2*TS_SIZE) < 0) // Add PATPMT to start of every file
                        break;
                     else
                        FileSize+=TS_SIZE*2;
                     }   
                  }
               else if (FileSize > MEGABYTE(Setup.MaxVideoFileSize)) {
+                 if (!FlushRun())
+                    break;
                  toFile = toFileName->NextFile();
                  if (!toFile) {
                     error = "toFile 1";
@@ -195,21 +294,46 @@ void cCuttingThread::Action(void)
               LastIFrame = 0;
 
               if (cutIn) {
-                 cRemux::SetBrokenLink(buffer, Length);
+                 Patch = true;
                  cutIn = false;
                  }
               }
-           if (toFile->Write(buffer, Length) < 0) {
-              error = "safe_write";
-              break;
+           if (Patch || Length < 0) {
+              // The first frame after a cut needs its broken link flag set, and
+              // the last frame of a file has no known length, so these go the
+              // old way through the buffer:
+              if (!FlushRun())
+                 break;
+              fromFile->Seek(FileOffset, SEEK_SET);
+              int len = ReadFrame(fromFile, buffer,  Length, sizeof(buffer));
+              if (len < 0) {
+                 error = "ReadFrame";
+                 break;
+                 }
+              Length = len;
+              if (Patch)
+                 cRemux::SetBrokenLink(buffer, Length);
+              if (toFile->Write(buffer, Length) < 0) {
+                 error = "safe_write";
+                 break;
+                 }
+              }
+           else {
+              if (runLength && runOffset + runLength != FileOffset && !FlushRun())
+                 break;
+              if (!runLength)
+                 runOffset = FileOffset;
+              runLength += Length;
               }
-           if (!toIndex->Write(PictureType, toFileName->Number(), FileSize)) {
+           if (!toIndex->Add(PictureType, toFileName->Number(), FileSize)) {
               error = "toIndex";
               break;
               }
            FileSize += Length;
+           LastIndex++;
+           doneFrames++;
            if (!LastIFrame)
-              LastIFrame = toIndex->Last();
+              LastIFrame = LastIndex;
 
            // Check editing marks:
 
@@ -217,7 +341,7 @@ void cCuttingThread::Action(void)
               Mark = fromMarks.Next(Mark);
               toMarks.Add(LastIFrame);
               if (Mark)
-                 toMarks.Add(toIndex->Last() + 1);
+                 toMarks.Add(LastIndex + 1);
               toMarks.Save();
               if (Mark) {
                  Index = Mark->position;
@@ -225,6 +349,8 @@ void cCuttingThread::Action(void)
                  CurrentFileNumber = 0; // triggers SetOffset before reading next frame
                  cutIn = true;
                  if (Setup.SplitEditedFiles) {
+                    if (!FlushRun())
+                       break;
                     toFile = toFileName->NextFile();
                     if (!toFile) {
                        error = "toFile 2";
@@ -237,49 +363,123 @@ void cCuttingThread::Action(void)
                  LastMark = true;
               }
 
-	   bytes += Length;
-	   if(bytes >= burst_size) {
-	     int elapsed = t.Elapsed();
-	     int sleep = 0;
-	     
-#if CUTTER_REL_BANDWIDTH > 0 &&  CUTTER_REL_BANDWIDTH < 100
-	     // stay under max. relative bandwidth
-
-	     sleep = (elapsed * 100 / CUTTER_REL_BANDWIDTH) - elapsed;
-	     //if(sleep<=0 && elapsed<=2) sleep = 1; 
-	     //if(sleep) esyslog("cutter: relative bandwidth limit, sleep %d ms (chunk %dk / %dms)", sleep, burst_size/1024, CUTTER_TIMESLICE);
-#endif
-	     // stay under max. absolute bandwidth
-	     if(elapsed < CUTTER_TIMESLICE) {
-	       sleep = max(CUTTER_TIMESLICE - elapsed, sleep);
-	       //if(sleep) esyslog("cutter: absolute bandwidth limit, sleep %d ms (chunk %dk / %dms)", sleep, burst_size/1024, CUTTER_TIMESLICE);
-	     }
-
-	     if(sleep>0)
-	       cCondWait::SleepMs(sleep);
-	     t.Set();
-	     bytes = 0;
-	   }
+           // Stay within the bandwidth limits of the disks:
 
+           bytes += Length;
+           if (bytes >= CUTTER_BURST) {
+              if (!FlushRun())
+                 break;
+              int sleep = cDiskThrottle::Throttle(fromDevice, bytes);
+              if (toDevice != fromDevice)
+                 sleep = max(sleep, cDiskThrottle::Throttle(toDevice, bytes));
+              if (sleep > 0)
+                 cCondWait::SleepMs(sleep);
+              bytes = 0;
+              }
            }
+     if (!error)
+        FlushRun();
      Recordings.TouchUpdate();
      }
   else
      esyslog("no editing marks found!");
 }
 
+// --- cCuttingJob ----------------------------------------------------------
+
+class cCuttingJob : public cListObject {
+private:
+  char *fileName;
+  char *editedVersionName;
+  cCuttingThread *cuttingThread;
+public:
+  cCuttingJob(const char *FileName, const char *EditedVersionName);
+  ~cCuttingJob();
+  const char *FileName(void) { return fileName; }
+  const char *EditedVersionName(void) { return editedVersionName; }
+  void Start(void);
+  bool Started(void) { return cuttingThread != NULL; }
+  bool Finished(void) { return cuttingThread && !cuttingThread->Active(); }
+  const char *Error(void) { return cuttingThread ? cuttingThread->Error() : NULL; }
+  int Progress(void) { return cuttingThread ? cuttingThread->Progress() : 0; }
+  int Eta(void) { return cuttingThread ? cuttingThread->Eta() : -1; }
+  };
+
+cCuttingJob::cCuttingJob(const char *FileName, const char *EditedVersionName)
+{
+  fileName = strdup(FileName);
+  editedVersionName = strdup(EditedVersionName);
+  cuttingThread = NULL; // nothing is opened or created before the job starts
+}
+
+cCuttingJob::~cCuttingJob()
+{
+  bool Interrupted = !cuttingThread || cuttingThread->Active();
+  const char *Error = cuttingThread ? cuttingThread->Error() : NULL;
+  delete cuttingThread;
+  if (Interrupted || Error) {
+     if (Interrupted)
+        isyslog("editing process has been interrupted");
+     if (Error)
+        esyslog("ERROR: '%s' during editing process", Error);
+     RemoveVideoFile(editedVersionName); //XXX what if this file is currently being replayed?
+     Recordings.DelByName(editedVersionName);
+     }
+  free(fileName);
+  free(editedVersionName);
+}
+
+void cCuttingJob::Start(void)
+{
+  isyslog("editing %s", fileName);
+  cuttingThread = new cCuttingThread(fileName, editedVersionName);
+  cuttingThread->Start();
+}
+
 // --- cCutter ---------------------------------------------------------------
 
-char *cCutter::editedVersionName = NULL;
-cCuttingThread *cCutter::cuttingThread = NULL;
+cList<cCuttingJob> cCutter::jobs;
 bool cCutter::error = false;
 bool cCutter::ended = false;
 
+void cCutter::Schedule(void)
+{
+  // Starts waiting jobs, but no more than CUTTER_MAX_JOBS at a time. Jobs on
+  // the same disk are kept within its limits by cDiskThrottle:
+  int Running = 0;
+  for (cCuttingJob *j = jobs.First(); j; j = jobs.Next(j)) {
+      if (j->Started())
+         Running++;
+      }
+  for (cCuttingJob *j = jobs.First(); j && Running < CUTTER_MAX_JOBS; j = jobs.Next(j)) {
+      if (!j->Started()) {
+         j->Start();
+         Running++;
+         }
+      }
+}
+
+void cCutter::Reap(void)
+{
+  for (cCuttingJob *j = jobs.First(); j; ) {
+      cCuttingJob *n = jobs.Next(j);
+      if (j->Finished()) {
+         bool Error = j->Error() != NULL;
+         if (!Error)
+            cRecordingUserCommand::InvokeCommand(RUC_EDITEDRECORDING, j->EditedVersionName());
+         jobs.Del(j);
+         if (Error)
+            error = true;
+         ended = true;
+         }
+      j = n;
+      }
+  Schedule();
+}
+
 bool cCutter::Start(const char *FileName)
 {
-  if (!cuttingThread) {
-     error = false;
-     ended = false;
+  if (!Active(FileName)) {
      cRecording Recording(FileName);
      
      cMarks FromMarks;
@@ -288,7 +488,7 @@ bool cCutter::Start(const char *FileName)
      if (First) Recording.SetStartTime(Recording.start+((First->position/FRAMESPERSEC+30)/60)*60);
      
      const char *evn = Recording.PrefixFileName('%');
-     if (evn && RemoveVideoFile(evn) && MakeDirs(evn, true)) {
+     if (evn && !Active(evn) && RemoveVideoFile(evn) && MakeDirs(evn, true)) {
         // XXX this can be removed once RenameVideoFile() follows symlinks (see videodir.c)
         // remove a possible deleted recording with the same name to avoid symlink mixups:
         char *s = strdup(evn);
@@ -301,46 +501,38 @@ bool cCutter::Start(const char *FileName)
            }
         free(s);
         // XXX
-        editedVersionName = strdup(evn);
         Recording.WriteInfo();
-        Recordings.AddByName(editedVersionName, false);
-        cuttingThread = new cCuttingThread(FileName, editedVersionName);
+        Recordings.AddByName(evn, false);
+        jobs.Add(new cCuttingJob(FileName, evn));
+        Schedule();
         return true;
         }
      }
   return false;
 }
 
-void cCutter::Stop(void)
+void cCutter::Stop(const char *FileName)
 {
-  bool Interrupted = cuttingThread && cuttingThread->Active();
-  const char *Error = cuttingThread ? cuttingThread->Error() : NULL;
-  delete cuttingThread;
-  cuttingThread = NULL;
-  if ((Interrupted || Error) && editedVersionName) {
-     if (Interrupted)
-        isyslog("editing process has been interrupted");
-     if (Error)
-        esyslog("ERROR: '%s' during editing process", Error);
-     RemoveVideoFile(editedVersionName); //XXX what if this file is currently being replayed?
-     Recordings.DelByName(editedVersionName);
-     }
+  for (cCuttingJob *j = jobs.First(); j; ) {
+      cCuttingJob *n = jobs.Next(j);
+      if (!FileName || strcmp(j->FileName(), FileName) == 0)
+         jobs.Del(j);
+      j = n;
+      }
+  Schedule();
 }
 
-bool cCutter::Active(void)
+bool cCutter::Active(const char *FileName)
 {
-  if (cuttingThread) {
-     if (cuttingThread->Active())
-        return true;
-     error = cuttingThread->Error();
-     Stop();
-     if (!error)
-        cRecordingUserCommand::InvokeCommand(RUC_EDITEDRECORDING, editedVersionName);
-     free(editedVersionName);
-     editedVersionName = NULL;
-     ended = true;
+  Reap();
+  if (FileName) {
+     for (cCuttingJob *j = jobs.First(); j; j = jobs.Next(j)) {
+         if (strcmp(j->FileName(), FileName) == 0 || strcmp(j->EditedVersionName(), FileName) == 0)
+            return true;
+         }
+     return false;
      }
-  return false;
+  return jobs.Count() > 0;
 }
 
 bool cCutter::Error(void)
@@ -352,7 +544,23 @@ bool cCutter::Error(void)
 
 bool cCutter::Ended(void)
 {
+  Reap();
   bool result = ended;
   ended = false;
   return result;
 }
+
+bool cCutter::Progress(int Job, const char **FileName, int *Percent, int *Eta)
+{
+  cCuttingJob *j = jobs.Get(Job);
+  if (j) {
+     if (FileName)
+        *FileName = j->FileName();
+     if (Percent)
+        *Percent = j->Progress();
+     if (Eta)
+        *Eta = j->Eta();
+     return true;
+     }
+  return false;
+}
@@ -10,20 +10,37 @@
 #ifndef __CUTTER_H
 #define __CUTTER_H
 
-class cCuttingThread;
+#include "tools.h"
+
+class cCuttingJob;
 
 class cCutter {
 private:
-  static char *editedVersionName;
-  static cCuttingThread *cuttingThread;
+  static cList<cCuttingJob> jobs;
   static bool error;
   static bool ended;
+  static void Schedule(void);
+  static void Reap(void);
 public:
   static bool Start(const char *FileName);
-  static void Stop(void);
-  static bool Active(void);
+       ///< Queues the recording with the given FileName for editing. Several
+       ///< recordings can be edited at the same time; jobs using the same disk
+       ///< share its bandwidth.
+  static void Stop(const char *FileName = NULL);
+       ///< Stops editing the given recording, or all recordings if FileName
+       ///< is NULL.
+  static bool Active(const char *FileName = NULL);
+       ///< Returns true if the given recording (or any recording, if FileName
+       ///< is NULL) is being edited or waiting to be edited.
   static bool Error(void);
   static bool Ended(void);
+       ///< Returns true once after one or more editing jobs have finished
+       ///< (Error() tells whether any of them failed).
+  static bool Progress(int Job, const char **FileName, int *Percent, int *Eta);
+       ///< Returns the FileName of the given Job (0...), how many Percent of
+       ///< it are done, and the estimated time until it's finished in
+       ///< seconds (-1 if that's not known yet, e.g. because the job is still
+       ///< waiting to be started). Returns false if there is no such Job.
   };
 
 #endif //__CUTTER_H
@@ -202,6 +202,7 @@ cDevice::cDevice(void)
 
   for (int i = 0; i < MAXRECEIVERS; i++)
       receiver[i] = NULL;
+  memset(receiverMask, 0, sizeof(receiverMask));
 
   if (numDevices < MAXDEVICES)
      device[numDevices++] = this;
@@ -1461,23 +1462,28 @@ bool cDevice::Receiving(bool CheckAny) const
   return false;
 }
 
-#ifndef RBLITE
-
 void cDevice::Action(void)
 {
   if (Running() && OpenDvr()) {
-     SetPriority(-5); // This thread is important...
+     SetThreadClass(tcReceive); // This thread is important...
      while (Running()) {
-           // Read data from the DVR device:
+           // Read a burst of data from the DVR device:
            uchar *b = NULL;
-           if (GetTSPacket(b)) {
+           int Count = 0;
+           if (GetTSPackets(b, Count)) {
               if (b) {
-                 int Pid = (((uint16_t)b[1] & PID_MASK_HI) << 8) | b[2];
-                 // Distribute the packet to all attached receivers:
                  Lock();
-                 for (int i = 0; i < MAXRECEIVERS; i++) {
-                     if (receiver[i] && receiver[i]->WantsPid(Pid))
-                        receiver[i]->Receive(b, TS_SIZE);
+                 for (int n = 0; n < Count; ) {
+                     // Look for a run of packets with the same PID:
+                     int Pid = TsPid(b + n);
+                     int Length = TsPidRun(b + n, Count - n);
+                     // Distribute the packets to all receivers that want them:
+                     int Mask = receiverMask[Pid];
+                     for (int i = 0; Mask; i++, Mask >>= 1) {
+                         if (Mask & 1)
+                            receiver[i]->Receive(b + n, Length);
+                         }
+                     n += Length;
                      }
                  Unlock();
                  }
@@ -1488,50 +1494,6 @@ void cDevice::Action(void)
      CloseDvr();
      }
 }
-#else
-
-// GA Speedup (RBLITE)
-#define TS_MAX_READ (1024)  // max 192K buffer
-void cDevice::Action(void)
-{
-       uchar buf[TS_MAX_READ*188];
-       if (Running() && OpenDvr()) {
-               SetPriority(-5); // This thread is important...
-               while (Running()) {                    
-                       int l;
-                       l=GetTSPackets(buf,TS_MAX_READ); // Read data from the DVR device
-                       if (l>0) {  
-                               Lock();
-                               int burstlen=188;
-                               
-                               // Look for bursts of the same PID
-                               for(int n=0;n<l;n+=burstlen) {
-                                       uchar *b=buf+n;
-                                       int m;
-                                       int Pid = (((uint16_t)b[1] & PID_MASK_HI) << 8) | b[2];
-                                       int nextPid=-1;
-                                       burstlen=188;   
-                                       for(m=n+188;m<l;m+=188) {
-                                               nextPid=(((uint16_t)buf[m+1] & PID_MASK_HI) << 8) | buf[m+2];
-                                               if (nextPid!=Pid)
-                                                       break;
-                                               burstlen+=188;
-                                       }
-                                       // Distribute the packets to all attached receivers:
-                                       
-                                       for (int i = 0; i < MAXRECEIVERS; i++) {
-                                               if (receiver[i] && receiver[i]->WantsPid(Pid))
-                                                       receiver[i]->Receive(b, burstlen);
-                                       }
-                                       
-                               }
-                               Unlock();
-                       }
-               }
-               CloseDvr();
-       }
-}
-#endif
 
 bool cDevice::OpenDvr(void)
 {
@@ -1547,13 +1509,36 @@ bool cDevice::GetTSPacket(uchar *&Data)
   return false;
 }
 
-#ifdef RBLITE
-int cDevice::GetTSPackets(uchar *Data, int count)
+bool cDevice::GetTSPackets(uchar *&Data, int &Count)
 {
-  return 0;
+  Count = 0;
+  if (GetTSPacket(Data)) {
+     if (Data)
+        Count = TS_SIZE;
+     return true;
+     }
+  return false;
 }
+
+#if MAXRECEIVERS > 16
+#error cDevice::receiverMask[] holds at most 16 receivers
 #endif
 
+void cDevice::SetReceiverMask(int Index, bool On)
+{
+  cReceiver *Receiver = receiver[Index];
+  uint16_t Bit = 1 << Index;
+  for (int n = 0; n < Receiver->numPids; n++) {
+      int Pid = Receiver->pids[n];
+      if (0 < Pid && Pid < MAXPID) {
+         if (On)
+            receiverMask[Pid] |= Bit;
+         else
+            receiverMask[Pid] &= ~Bit;
+         }
+      }
+}
+
 bool cDevice::AttachReceiver(cReceiver *Receiver, bool StartDecrypting)
 {
   if (!Receiver)
@@ -1583,6 +1568,7 @@ bool cDevice::AttachReceiver(cReceiver *Receiver, bool StartDecrypting)
          Lock();
          Receiver->device = this;
          receiver[i] = Receiver;
+         SetReceiverMask(i, true);
          Unlock();
          if (!Running())
             Start();
@@ -1612,6 +1598,7 @@ void cDevice::Detach(cReceiver *Receiver)
       if (receiver[i] == Receiver) {
          Receiver->Activate(false);
          Lock();
+         SetReceiverMask(i, false);
          receiver[i] = NULL;
          Receiver->device = NULL;
          Unlock();
@@ -1674,8 +1661,8 @@ cTSBuffer::cTSBuffer(int File, int Size, int CardIndex)
   SetDescription("TS buffer on device %d", CardIndex);
   f = File;
   cardIndex = CardIndex;
-  delivered = false;
-  ringBuffer = new cRingBufferLinear(Size, TS_SIZE, true, "TS");
+  delivered = 0;
+  ringBuffer = new cRingBufferLinearSPSC(Size, TS_SIZE, true, "TS");
   ringBuffer->SetTimeouts(100, 100);
   Start();
 }
@@ -1711,24 +1698,31 @@ void cTSBuffer::Action(void)
 uchar *cTSBuffer::Get(void)
 {
   int Count = 0;
+  return Get(Count, TS_SIZE);
+}
+
+uchar *cTSBuffer::Get(int &Count, int Max)
+{
   if (delivered) {
-     ringBuffer->Del(TS_SIZE);
-     delivered = false;
+     ringBuffer->Del(delivered);
+     delivered = 0;
      }
-  uchar *p = ringBuffer->Get(Count);
-  if (p && Count >= TS_SIZE) {
+  int Available = 0;
+  uchar *p = ringBuffer->Get(Available);
+  Count = 0;
+  if (p && Available >= TS_SIZE) {
      if (*p != TS_SYNC_BYTE) {
-        for (int i = 1; i < Count; i++) {
-            if (p[i] == TS_SYNC_BYTE) {
-               Count = i;
-               break;
-               }
-            }
-        ringBuffer->Del(Count);
-        esyslog("ERROR: skipped %d bytes to sync on TS packet on device %d", Count, cardIndex);
+        uchar *q = (uchar *)memchr(p + 1, TS_SYNC_BYTE, Available - 1);
+        if (q)
+           Available = q - p;
+        ringBuffer->Del(Available);
+        esyslog("ERROR: skipped %d bytes to sync on TS packet on device %d", Available, cardIndex);
         return NULL;
         }
-     delivered = true;
+     // Deliver all complete packets that are in sync, the first one that isn't
+     // will be re-synchronized with the next call:
+     Count = TsSynced(p, min(Available, Max));
+     delivered = Count;
      return p;
      }
   return NULL;
@@ -22,19 +22,19 @@
 #include "spu.h"
 #include "thread.h"
 #include "tools.h"
+#include "tsscan.h"
 #include <linux/dvb/frontend.h>
 
 #include "reelcamlink.h"
 
 #define MAXDEVICES         16 // the maximum number of devices in the system
 #define MAXPIDHANDLES      64 // the maximum number of different PIDs per device
-#define MAXRECEIVERS       16 // the maximum number of receivers per device
+#define MAXRECEIVERS       16 // the maximum number of receivers per device (must fit into the bits of cDevice::receiverMask[])
 #define MAXVOLUME         255
 #define VOLUMEDELTA        10 // used to increase/decrease the volume
 
-#define TS_SIZE          188
-#define TS_SYNC_BYTE     0x47
-#define PID_MASK_HI      0x1F
+#define TS_MAX_BURST     (512 * TS_SIZE) // the maximum number of bytes cDevice::Action() distributes at once
+#define MAXPID           0x2000 // the number of different PIDs in a TS
 
 #define DO_MULTIPLE_CA_CHANNELS
 
@@ -545,6 +545,11 @@ public:
 private:
   cMutex mutexReceiver;
   cReceiver *receiver[MAXRECEIVERS];
+  uint16_t receiverMask[MAXPID];
+       ///< Bit i is set in receiverMask[Pid] if receiver[i] wants to receive Pid.
+  void SetReceiverMask(int Index, bool On);
+       ///< Sets or clears the bit of receiver[Index] for all of its PIDs.
+       ///< Must be called with the thread lock held.
   public:
   int Priority(void) const;
       ///< Returns the priority of the current receiving session (0..MAXPRIORITY),
@@ -563,9 +568,17 @@ protected:
       ///< new data available, Data will be set to NULL. The function returns
       ///< false in case of a non recoverable error, otherwise it returns true,
       ///< even if Data is NULL.
-#ifdef RBLITE
-   virtual int GetTSPackets(uchar *Data, int count);
-#endif
+  virtual bool GetTSPackets(uchar *&Data, int &Count);
+      ///< Gets as many consecutive TS packets as are currently available from
+      ///< the DVR of this device and returns a pointer to the first one in Data.
+      ///< Count is set to the number of bytes Data points to, which is always a
+      ///< multiple of TS_SIZE. The data remains valid until the next call to
+      ///< this function. If there is currently no new data available, Data will
+      ///< be set to NULL. The function returns false in case of a non recoverable
+      ///< error, otherwise it returns true, even if Data is NULL.
+      ///< The default implementation delivers one packet at a time by calling
+      ///< GetTSPacket(), so derived devices only need to implement this function
+      ///< if they are able to deliver larger bursts.
 public:
   int  Ca(void) const;
        ///< Returns the ca of the current receiving session(s).
@@ -593,13 +606,19 @@ class cTSBuffer : public cThread {
 private:
   int f;
   int cardIndex;
-  bool delivered;
-  cRingBufferLinear *ringBuffer;
+  int delivered;
+  cRingBufferLinearSPSC *ringBuffer;
   virtual void Action(void);
 public:
   cTSBuffer(int File, int Size, int CardIndex);
   ~cTSBuffer();
   uchar *Get(void);
+  uchar *Get(int &Count, int Max = TS_MAX_BURST);
+       ///< Returns a pointer to as many consecutive, synchronized TS packets as
+       ///< are currently available in one contiguous block of the buffer (up to
+       ///< Max bytes), and stores their total length (a multiple of TS_SIZE) in
+       ///< Count. The data is not copied and stays valid until the next call to
+       ///< Get().
   };
 
 #endif //__DEVICE_H
@@ -413,6 +413,7 @@ cDvbDevice::cDvbDevice(int n)
   // The DVR device (will be opened and closed as needed):
 
   fd_dvr = -1;
+  tsBuffer = NULL;
 
   // The offset of the /dev/video devices:
 
@@ -1342,44 +1343,34 @@ bool cDvbDevice::OpenDvr(void)
 {
   CloseDvr();
   fd_dvr = DvbOpen(DEV_DVB_DVR, CardIndex(), O_RDONLY | O_NONBLOCK, true);
-  if (fd_dvr >= 0) {
-#ifndef RBLITE
+  if (fd_dvr >= 0)
      tsBuffer = new cTSBuffer(fd_dvr, MEGABYTE(2), CardIndex() + 1);
-#endif
-       Poller=new cPoller(fd_dvr);
-  }
   return fd_dvr >= 0;
 }
 
 void cDvbDevice::CloseDvr(void)
 {
   if (fd_dvr >= 0) {
-#ifndef RBLITE
      delete tsBuffer;
      tsBuffer = NULL;
-#endif
-     delete Poller;
      close(fd_dvr);
      fd_dvr = -1;
      }
 }
 
-#ifdef RBLITE
-int cDvbDevice::GetTSPackets(uchar *Data, int count)
+bool cDvbDevice::GetTSPacket(uchar *&Data)
 {
-       int l;
-       if (Poller->Poll(20)) {
-               l=read(fd_dvr,Data,TS_SIZE*count);
-               return l;
-       }
-       return 0;
+  if (tsBuffer) {
+     Data = tsBuffer->Get();
+     return true;
+     }
+  return false;
 }
-#endif
 
-bool cDvbDevice::GetTSPacket(uchar *&Data)
+bool cDvbDevice::GetTSPackets(uchar *&Data, int &Count)
 {
   if (tsBuffer) {
-     Data = tsBuffer->Get();
+     Data = tsBuffer->Get(Count);
      return true;
      }
   return false;
@@ -144,14 +144,11 @@ public:
 public:
 private:
   cTSBuffer *tsBuffer;
-  cPoller *Poller;
 protected:
   virtual bool OpenDvr(void);
   virtual void CloseDvr(void);
   virtual bool GetTSPacket(uchar *&Data);
-#ifdef RBLITE
-  virtual int GetTSPackets(uchar *Data, int count);
-#endif
+  virtual bool GetTSPackets(uchar *&Data, int &Count);
   };
 
 #endif //__DVBDEVICE_H
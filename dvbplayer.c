@@ -15,6 +15,7 @@
 #include "thread.h"
 #include "tools.h"
 #include "status.h"
+#include "videodir.h"
 
 // --- cBackTrace ------------------------------------------------------------
 
@@ -77,21 +78,20 @@ int cBackTrace::Get ( bool Forward )
 
 // --- cNonBlockingFileReader ------------------------------------------------
 
-class cNonBlockingFileReader : public cThread
+// The actual reading is done by the cAsyncReader thread of the file's disk
+// (see cReadRequest).
+
+class cNonBlockingFileReader : public cReadRequest
 {
 	private:
 		cUnbufferedFile *f;
+		cRingBufferFrame *pool;
 		uchar *buffer;
-		int wanted;
-		int length;
-		bool hasData;
-		cCondWait newSet;
-		cCondVar newDataCond;
-		cMutex newDataMutex;
 	protected:
-		void Action ( void );
+		virtual int DoRead ( uchar *Data, int Size ) { return f->Read ( Data, Size ); }
+		virtual dev_t Device ( void ) { return f ? f->Device() : 0; }
 	public:
-		cNonBlockingFileReader ( void );
+		cNonBlockingFileReader ( cRingBufferFrame *Pool );
 		~cNonBlockingFileReader();
 		void Clear ( void );
 		int Read ( cUnbufferedFile *File, uchar *Buffer, int Length );
@@ -99,38 +99,30 @@ class cNonBlockingFileReader : public cThread
 		bool WaitForDataMs ( int msToWait );
 };
 
-cNonBlockingFileReader::cNonBlockingFileReader ( void )
-		:cThread ( "non blocking file reader" )
+cNonBlockingFileReader::cNonBlockingFileReader ( cRingBufferFrame *Pool )
 {
 	f = NULL;
+	pool = Pool;
 	buffer = NULL;
-	wanted = length = 0;
-	hasData = false;
-	Start();
 }
 
 cNonBlockingFileReader::~cNonBlockingFileReader()
 {
-	newSet.Signal();
-	Cancel ( 3 );
-	free ( buffer );
+	Cancel();
+	WaitIdle();
+	pool->Release ( buffer );
 }
 
 void cNonBlockingFileReader::Clear ( void )
 {
-	Lock();
-	f = NULL;
-	free ( buffer );
+	Cancel(); // doesn't wait for the disk, see WaitIdle()
+	pool->Release ( buffer );
 	buffer = NULL;
-	wanted = length = 0;
-	hasData = false;
-	Unlock();
-	newSet.Signal();
 }
 
 int cNonBlockingFileReader::Read ( cUnbufferedFile *File, uchar *Buffer, int Length )
 {
-	if ( hasData && buffer )
+	if ( buffer )
 	{
 		if ( buffer != Buffer )
 		{
@@ -138,60 +130,257 @@ int cNonBlockingFileReader::Read ( cUnbufferedFile *File, uchar *Buffer, int Len
 			errno = EINVAL;
 			return -1;
 		}
+		if ( !Done() )
+		{
+			errno = EAGAIN;
+			return -1;
+		}
 		buffer = NULL;
-		return length;
+		return Result();
+	}
+	WaitIdle();
+	f = File;
+	buffer = Buffer;
+	Submit ( Buffer, Length, rpFrame );
+	errno = EAGAIN;
+	return -1;
+}
+
+bool cNonBlockingFileReader::WaitForDataMs ( int msToWait )
+{
+	if ( Pending() )
+		return Wait ( msToWait );
+	cCondWait::SleepMs ( msToWait );
+	return false;
+}
+
+// --- cIFramePrefetcher -----------------------------------------------------
+
+// In fast forward/rewind only the I-frames are replayed, each of them after a
+// jump in the file, so the normal readahead doesn't help. The prefetcher
+// looks up the next few I-frames in the playing direction in the index, has
+// the kernel read all of them in parallel and keeps them in a small cache
+// until the player needs them. The reads are done by the cAsyncReader with
+// a lower priority than the frames the players are actually waiting for.
+
+#ifdef RBLITE
+#define PREFETCHFRAMES 4
+#else
+#define PREFETCHFRAMES 8 // number of I-frames to read ahead in trick modes
+#endif
+
+class cPrefetchRequest : public cReadRequest
+{
+	private:
+		cUnbufferedFile *file;
+		off_t offset;
+	protected:
+		virtual int DoRead ( uchar *Data, int Size );
+		virtual dev_t Device ( void ) { return file ? file->Device() : 0; }
+	public:
+		cPrefetchRequest ( void ) { file = NULL; offset = 0; }
+		~cPrefetchRequest() { Cancel(); WaitIdle(); }
+		void Set ( cUnbufferedFile *File, off_t Offset ) { file = File; offset = Offset; }
+};
+
+int cPrefetchRequest::DoRead ( uchar *Data, int Size )
+{
+	int r = file->ReadAt ( Data, Size, offset );
+	if ( r > 0 )
+		offset += r;
+	return r;
+}
+
+class cIFramePrefetcher : public cThread
+{
+	private:
+		struct tSlot { int index; int length; uchar *data; };
+		cFileName *fileName;
+		cIndexFile *index;
+		tSlot slots[PREFETCHFRAMES];
+		cPrefetchRequest request;
+		int current;
+		bool forward;
+		bool stayOffEnd;
+		int generation;
+		cMutex mutex;
+		cCondWait newSet;
+		int Lookup ( int Index );
+	protected:
+		void Action ( void );
+	public:
+		cIFramePrefetcher ( const char *FileName, cIndexFile *Index );
+		~cIFramePrefetcher();
+		void Set ( int Index, bool Forward, bool StayOffEnd );
+		///< Starts prefetching the I-frames that follow the one at Index in the
+		///< given direction.
+		int Get ( int Index, uchar *Data, int Max );
+		///< Copies the frame at Index into Data, if it has already been read.
+		///< Returns the length of the frame, or -1 if it's not in the cache.
+};
+
+cIFramePrefetcher::cIFramePrefetcher ( const char *FileName, cIndexFile *Index )
+		:cThread ( "I-frame prefetcher" )
+{
+	fileName = new cFileName ( FileName, false );
+	index = Index;
+	for ( int i = 0; i < PREFETCHFRAMES; i++ )
+	{
+		slots[i].index = -1;
+		slots[i].length = 0;
+		slots[i].data = NULL;
+	}
+	current = -1;
+	forward = true;
+	stayOffEnd = false;
+	generation = 0;
+	Start();
+}
+
+cIFramePrefetcher::~cIFramePrefetcher()
+{
+	Cancel ( -1 );
+	newSet.Signal();
+	Cancel ( 3 );
+	for ( int i = 0; i < PREFETCHFRAMES; i++ )
+		free ( slots[i].data );
+	delete fileName;
+}
+
+int cIFramePrefetcher::Lookup ( int Index )
+{
+	for ( int i = 0; i < PREFETCHFRAMES; i++ )
+	{
+		if ( slots[i].index == Index && slots[i].length > 0 )
+			return i;
 	}
-	if ( !buffer )
+	return -1;
+}
+
+void cIFramePrefetcher::Set ( int Index, bool Forward, bool StayOffEnd )
+{
+	cMutexLock MutexLock ( &mutex );
+	if ( Index != current || Forward != forward )
 	{
-		f = File;
-		buffer = Buffer;
-		wanted = Length;
-		length = 0;
-		hasData = false;
+		current = Index;
+		forward = Forward;
+		stayOffEnd = StayOffEnd;
+		generation++;
 		newSet.Signal();
 	}
-	errno = EAGAIN;
+}
+
+int cIFramePrefetcher::Get ( int Index, uchar *Data, int Max )
+{
+	cMutexLock MutexLock ( &mutex );
+	int i = Lookup ( Index );
+	if ( i >= 0 && slots[i].length <= Max )
+	{
+		memcpy ( Data, slots[i].data, slots[i].length );
+		return slots[i].length;
+	}
 	return -1;
 }
 
-void cNonBlockingFileReader::Action ( void )
+void cIFramePrefetcher::Action ( void )
 {
 	while ( Running() )
 	{
-		Lock();
-		if ( !hasData && f && buffer )
+		mutex.Lock();
+		int Generation = generation;
+		int Index = current;
+		bool Forward = forward;
+		bool StayOffEnd = stayOffEnd;
+		mutex.Unlock();
+		if ( Index >= 0 )
 		{
-			int r = f->Read ( buffer + length, wanted - length );
-			if ( r >= 0 )
+			// Find the next I-frames:
+			int Frames[PREFETCHFRAMES];
+			uchar FileNumbers[PREFETCHFRAMES];
+			int FileOffsets[PREFETCHFRAMES];
+			int Lengths[PREFETCHFRAMES];
+			int n = 0;
+			for ( int i = Index; n < PREFETCHFRAMES; n++ )
+			{
+				i = index->GetNextIFrame ( i, Forward, &FileNumbers[n], &FileOffsets[n], &Lengths[n], StayOffEnd );
+				if ( i < 0 )
+					break;
+				Frames[n] = i;
+				if ( Lengths[n] < 0 || Lengths[n] > MAXFRAMESIZE )
+					Lengths[n] = MAXFRAMESIZE; // read up to EOF (see cIndex)
+			}
+			// Free the slots that are no longer needed, and let the kernel
+			// start reading the frames we don't have yet:
+			bool Missing[PREFETCHFRAMES];
+			mutex.Lock();
+			for ( int s = 0; s < PREFETCHFRAMES; s++ )
 			{
-				length += r;
-				if ( !r || length == wanted ) // r == 0 means EOF
+				bool Needed = false;
+				for ( int i = 0; i < n && !Needed; i++ )
+					Needed = slots[s].index == Frames[i];
+				if ( !Needed )
+					slots[s].index = -1;
+			}
+			for ( int i = 0; i < n; i++ )
+				Missing[i] = Lookup ( Frames[i] ) < 0;
+			mutex.Unlock();
+			for ( int i = 0; i < n; i++ )
+			{
+				if ( Missing[i] )
 				{
-					cMutexLock NewDataLock ( &newDataMutex );
-					hasData = true;
-					newDataCond.Broadcast();
+					cUnbufferedFile *f = fileName->SetOffset ( FileNumbers[i], FileOffsets[i] );
+					if ( f )
+						f->WillNeed ( FileOffsets[i], Lengths[i] );
 				}
 			}
-			else if ( r < 0 && FATALERRNO )
+			// Read them in the order the player will need them:
+			for ( int i = 0; i < n && Running() && Generation == generation; i++ )
 			{
-				LOG_ERROR;
-				length = r; // this will forward the error status to the caller
-				hasData = true;
+				if ( !Missing[i] )
+					continue;
+				int s;
+				mutex.Lock();
+				for ( s = 0; s < PREFETCHFRAMES; s++ )
+				{
+					if ( slots[s].index < 0 )
+						break;
+				}
+				mutex.Unlock();
+				if ( s >= PREFETCHFRAMES )
+					break;
+				if ( !slots[s].data && ( slots[s].data = MALLOC ( uchar, MAXFRAMESIZE ) ) == NULL )
+					break;
+				cUnbufferedFile *f = fileName->SetOffset ( FileNumbers[i], FileOffsets[i] );
+				int r = -1;
+				if ( f )
+				{
+					// the frames the players are waiting for are read first:
+					request.Set ( f, FileOffsets[i] );
+					if ( request.Submit ( slots[s].data, Lengths[i], rpPrefetch ) )
+					{
+						while ( !request.Wait ( 100 ) && Running() )
+							;
+						r = request.Done() ? request.Result() : -1;
+						request.Cancel();
+						request.WaitIdle(); // before the file is used again
+					}
+				}
+				if ( r > 0 )
+				{
+					cMutexLock MutexLock ( &mutex );
+					slots[s].index = Frames[i];
+					slots[s].length = r;
+				}
 			}
+			mutex.Lock();
+			if ( Generation == generation )
+				current = -1; // all done until the player moves on
+			mutex.Unlock();
 		}
-		Unlock();
 		newSet.Wait ( 1000 );
 	}
 }
 
-bool cNonBlockingFileReader::WaitForDataMs ( int msToWait )
-{
-	cMutexLock NewDataLock ( &newDataMutex );
-	if ( hasData )
-		return true;
-	return newDataCond.TimedWait ( newDataMutex, msToWait );
-}
-
 // --- cDvbPlayer ------------------------------------------------------------
 
 #define PLAYERBUFSIZE  MEGABYTE(1)
@@ -206,10 +395,12 @@ class cDvbPlayer : public cPlayer, cThread
 		enum ePlayDirs { pdForward, pdBackward };
 		static int Speeds[];
 		cNonBlockingFileReader *nonBlockingFileReader;
+		cIFramePrefetcher *prefetcher;
 		cRingBufferFrame *ringBuffer;
 		cBackTrace *backTrace;
 		cMarksReload marks;
 		cFileName *fileName;
+		dev_t device;
 		cIndexFile *index;
 		cUnbufferedFile *replayFile;
 		bool eof;
@@ -256,6 +447,7 @@ cDvbPlayer::cDvbPlayer ( const char *FileName )
 		:cThread ( "dvbplayer" ), marks ( FileName )
 {
 	nonBlockingFileReader = NULL;
+	prefetcher = NULL;
 	ringBuffer = NULL;
 	backTrace = NULL;
 	index = NULL;
@@ -271,9 +463,11 @@ cDvbPlayer::cDvbPlayer ( const char *FileName )
 	isyslog ( "replay %s", FileName );
 	fileName = new cFileName ( FileName, false );
 	replayFile = fileName->Open();
+	device = replayFile ? VideoFileDevice ( FileName ) : 0;
 	if ( !replayFile )
 		return;
-	ringBuffer = new cRingBufferFrame ( PLAYERBUFSIZE );
+	SetVideoDiskBusy ( device, true );
+	ringBuffer = new cRingBufferFrame ( PLAYERBUFSIZE, true, MAXFRAMESIZE );
 	// Create the index file:
 	index = new cIndexFile ( FileName, false );
 	if ( !index )
@@ -283,6 +477,8 @@ cDvbPlayer::cDvbPlayer ( const char *FileName )
 		delete index;
 		index = NULL;
 	}
+	if ( index )
+		prefetcher = new cIFramePrefetcher ( FileName, index );
 	// Check for TS Data
 	CheckTS();
 	backTrace = new cBackTrace;
@@ -296,10 +492,12 @@ cDvbPlayer::~cDvbPlayer()
 	if ( PATPMT != NULL )
 		free ( PATPMT );
 	delete readFrame; // might not have been stored in the buffer in Action()
+	delete prefetcher;
 	delete index;
 	delete fileName;
 	delete backTrace;
 	delete ringBuffer;
+	SetVideoDiskBusy ( device, false );
 }
 
 void cDvbPlayer::TrickSpeed ( int Increment )
@@ -342,6 +540,9 @@ void cDvbPlayer::Empty ( void )
 
 bool cDvbPlayer::NextFile ( uchar FileNumber, int FileOffset )
 {
+	// a read that has been cancelled by Empty() may still be using replayFile:
+	if ( nonBlockingFileReader )
+		nonBlockingFileReader->WaitIdle();
 	if ( FileNumber > 0 )
 		replayFile = fileName->SetOffset ( FileNumber, FileOffset );
 	else if ( replayFile && eof )
@@ -424,7 +625,7 @@ void cDvbPlayer::Action ( void )
 	}
 
 	bool LastMarkPause = false;
-	nonBlockingFileReader = new cNonBlockingFileReader;
+	nonBlockingFileReader = new cNonBlockingFileReader ( ringBuffer );
 	int Length = 0;
 	bool Sleep = false;
 	bool WaitingForData = false;
@@ -433,8 +634,8 @@ void cDvbPlayer::Action ( void )
 	{
 		if ( Sleep )
 		{
-			if ( WaitingForData )
-				nonBlockingFileReader->WaitForDataMs ( 3 ); // this keeps the CPU load low, but reacts immediately on new data
+			if ( WaitingForData && nonBlockingFileReader->Reading() )
+				nonBlockingFileReader->WaitForDataMs ( 100 ); // returns as soon as the data has arrived
 			else
 				cCondWait::SleepMs ( 3 ); // this keeps the CPU load low
 			Sleep = false;
@@ -451,13 +652,16 @@ void cDvbPlayer::Action ( void )
 			{
 				if ( !readFrame && ( replayFile || readIndex >= 0 ) )
 				{
+					int Cached = -1;
 					if ( !nonBlockingFileReader->Reading() )
 					{
+						bool TrickMode = false;
+						bool TimeShiftMode = false;
 						if ( playMode == pmFast || ( playMode == pmSlow && playDir == pdBackward ))
 						{
 							uchar FileNumber;
 							int FileOffset;
-							bool TimeShiftMode = index->IsStillRecording();
+							TimeShiftMode = index->IsStillRecording();
 							int Index = index->GetNextIFrame ( readIndex, playDir == pdForward, &FileNumber, &FileOffset, &Length, TimeShiftMode );
 							if ( Index >= 0 )
 							{
@@ -489,6 +693,7 @@ void cDvbPlayer::Action ( void )
 								continue;
 							}
 							readIndex = Index;
+							TrickMode = true;
 						}
 						else if ( index )
 						{
@@ -553,17 +758,27 @@ void cDvbPlayer::Action ( void )
 							esyslog ( "ERROR: frame larger than buffer (%d > %d)", Length, MAXFRAMESIZE );
 							Length = MAXFRAMESIZE;
 						}
-						b = MALLOC ( uchar, Length );
+						b = ringBuffer->Alloc ( Length );
+						if ( TrickMode && prefetcher )
+						{
+							if ( b )
+								Cached = prefetcher->Get ( readIndex, b, Length );
+							prefetcher->Set ( readIndex, playDir == pdForward, TimeShiftMode );
+						}
 					}
-					int r = nonBlockingFileReader->Read ( replayFile, b, Length );
+					int r = ( Cached > 0 ) ? Cached : nonBlockingFileReader->Read ( replayFile, b, Length );
 					if ( r > 0 )
 					{
 						WaitingForData = false;
-						readFrame = new cFrame ( b, -r, ftUnknown, readIndex ); // hands over b to the ringBuffer
+						readFrame = new cFrame ( b, -r, ftUnknown, readIndex, ringBuffer ); // hands over b to the ringBuffer
 						b = NULL;
 					}
 					else if ( r == 0 )
+					{
+						ringBuffer->Release ( b );
+						b = NULL;
 						eof = true;
+					}
 					else if ( r < 0 && errno == EAGAIN )
 						WaitingForData = true;
 					else if ( r < 0 && FATALERRNO )
@@ -12,6 +12,7 @@
 
 #include "epg.h"
 #include <ctype.h>
+#include <sys/mman.h>
 #include <time.h>
 #include "libsi/si.h"
 #include "timers.h"
@@ -819,18 +820,668 @@ Final:
   checkCzech( description );
 }
 
+// --- cEpgCache -------------------------------------------------------------
+
+// In addition to the textual epg.data, the schedules are periodically saved
+// to a binary snapshot (epg.data.bin), which is mapped into memory at startup.
+// A schedule's events are only turned into cEvent objects when that schedule
+// is first accessed.
+//
+// The file consists of a segment holding all schedules, followed by segments
+// holding those schedules that were modified since the previous save, where a
+// later segment replaces what an earlier one had for the same channel. Once
+// these add up to more than half of the first segment, the file is rewritten
+// from scratch. Each segment is laid out as
+// tEpgCacheHeader, tEpgCacheSchedule[numSchedules], tEpgCacheEvent[numEvents],
+// tEpgCacheComponent[numComponents] and a string table of stringsSize bytes
+// (padded to a multiple of 8). Strings are referenced by their offset in the
+// string table, with 0 denoting an empty string. The data is stored in host
+// byte order, since it is only a cache of epg.data.
+
+#define EPGCACHEMAGIC   0x43504556 // "VEPC"
+#define EPGCACHEVERSION 2
+#define EPGCACHESUFFIX  ".bin"
+
+struct tEpgCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size; // of the entire segment, including this header
+  uint32_t numSchedules;
+  uint32_t numEvents;
+  uint32_t numComponents;
+  uint32_t stringsSize;
+  uint32_t reserved;
+  };
+
+struct tEpgCacheSchedule {
+  uint32_t channelID;
+  uint32_t firstEvent;
+  uint32_t numEvents;
+  uint32_t reserved;
+  };
+
+struct tEpgCacheEvent {
+  int64_t startTime;
+  int64_t vps;
+  uint32_t eventID;
+  int32_t duration;
+  uint32_t title;
+  uint32_t shortText;
+  uint32_t description;
+  uint32_t firstComponent;
+  uint16_t numComponents;
+  uint8_t tableID;
+  uint8_t version;
+  uint8_t reserved[4];
+  };
+
+struct tEpgCacheComponent {
+  uint32_t description;
+  uint8_t stream;
+  uint8_t type;
+  char language[MAXLANGCODE2];
+  uint8_t reserved[2];
+  };
+
+#define EPGCACHEALIGN(n) (((n) + 7) & ~7)
+
+// cSchedule::cached is tested without a lock, and is cleared only once all of
+// the schedule's events are in place:
+typedef const tEpgCacheSchedule *tEpgCacheSchedulePtr;
+#if __GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 7
+static inline tEpgCacheSchedulePtr LoadAcquire(const tEpgCacheSchedulePtr *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void StoreRelease(tEpgCacheSchedulePtr *p, tEpgCacheSchedulePtr v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+#else
+static inline tEpgCacheSchedulePtr LoadAcquire(const tEpgCacheSchedulePtr *p) { tEpgCacheSchedulePtr v = *(volatile tEpgCacheSchedulePtr *)p; __sync_synchronize(); return v; }
+static inline void StoreRelease(tEpgCacheSchedulePtr *p, tEpgCacheSchedulePtr v) { __sync_synchronize(); *(volatile tEpgCacheSchedulePtr *)p = v; }
+#endif
+
+class cEpgCacheSegment {
+private:
+  const uchar *data;
+public:
+  cEpgCacheSegment(const uchar *Data) { data = Data; }
+  static const uchar *Check(const uchar *Data, size_t Size);
+       // Returns the end of the segment at Data if it is valid and lies within
+       // the Size bytes available, NULL otherwise.
+  const tEpgCacheHeader *Header(void) const { return (const tEpgCacheHeader *)data; }
+  const tEpgCacheSchedule *Schedules(void) const { return (const tEpgCacheSchedule *)(Header() + 1); }
+  const tEpgCacheEvent *Events(void) const { return (const tEpgCacheEvent *)(Schedules() + Header()->numSchedules); }
+  const tEpgCacheComponent *Components(void) const { return (const tEpgCacheComponent *)(Events() + Header()->numEvents); }
+  const char *String(uint32_t Offset) const;
+  };
+
+const uchar *cEpgCacheSegment::Check(const uchar *Data, size_t Size)
+{
+  const tEpgCacheHeader *h = (const tEpgCacheHeader *)Data;
+  if (Size < sizeof(*h) || h->magic != EPGCACHEMAGIC || h->version != EPGCACHEVERSION || h->size > Size || h->size % 8)
+     return NULL;
+  uint64_t Expected = sizeof(*h) + uint64_t(h->numSchedules) * sizeof(tEpgCacheSchedule) + uint64_t(h->numEvents) * sizeof(tEpgCacheEvent) + uint64_t(h->numComponents) * sizeof(tEpgCacheComponent) + EPGCACHEALIGN(uint64_t(h->stringsSize));
+  if (Expected != h->size || h->stringsSize == 0)
+     return NULL;
+  cEpgCacheSegment Segment(Data);
+  const char *Strings = (const char *)(Segment.Components() + h->numComponents);
+  if (Strings[0] || Strings[h->stringsSize - 1])
+     return NULL;
+  for (uint32_t i = 0; i < h->numSchedules; i++) {
+      const tEpgCacheSchedule *s = &Segment.Schedules()[i];
+      if (s->channelID >= h->stringsSize || s->firstEvent > h->numEvents || s->numEvents > h->numEvents - s->firstEvent)
+         return NULL;
+      }
+  for (uint32_t i = 0; i < h->numEvents; i++) {
+      const tEpgCacheEvent *e = &Segment.Events()[i];
+      if (e->title >= h->stringsSize || e->shortText >= h->stringsSize || e->description >= h->stringsSize || e->firstComponent > h->numComponents || e->numComponents > h->numComponents - e->firstComponent)
+         return NULL;
+      }
+  for (uint32_t i = 0; i < h->numComponents; i++) {
+      const tEpgCacheComponent *c = &Segment.Components()[i];
+      if (c->description >= h->stringsSize || c->language[MAXLANGCODE2 - 1])
+         return NULL;
+      }
+  return Data + h->size;
+}
+
+const char *cEpgCacheSegment::String(uint32_t Offset) const
+{
+  return Offset ? (const char *)(Components() + Header()->numComponents) + Offset : NULL;
+}
+
+// --- cEpgCacheBuffer -------------------------------------------------------
+
+class cEpgCacheBuffer {
+private:
+  uchar *data;
+  int size;
+  int used;
+public:
+  cEpgCacheBuffer(void) { data = NULL; size = used = 0; }
+  ~cEpgCacheBuffer() { free(data); }
+  const uchar *Data(void) const { return data; }
+  int Used(void) const { return used; }
+  bool Append(const void *Data, int Length);
+  };
+
+bool cEpgCacheBuffer::Append(const void *Data, int Length)
+{
+  if (used + Length > size) {
+     int NewSize = max(2 * size, used + Length + KILOBYTE(64));
+     uchar *NewData = (uchar *)realloc(data, NewSize);
+     if (!NewData) {
+        esyslog("ERROR: out of memory");
+        return false;
+        }
+     data = NewData;
+     size = NewSize;
+     }
+  memcpy(data + used, Data, Length);
+  used += Length;
+  return true;
+}
+
+// --- cEpgCacheWriter -------------------------------------------------------
+
+class cEpgCacheWriter {
+private:
+  cEpgCacheBuffer schedules;
+  cEpgCacheBuffer events;
+  cEpgCacheBuffer components;
+  cEpgCacheBuffer strings;
+  uint32_t *stringHash;
+  int stringHashSize;
+  int numStrings;
+  int numSchedules;
+  int numEvents;
+  int numComponents;
+  bool ok;
+  uint32_t String(const char *s);
+  void AddEvent(tEpgCacheEvent *Event, const char *Title, const char *ShortText, const char *Description);
+  void AddComponent(uchar Stream, uchar Type, const char *Language, const char *Description);
+public:
+  cEpgCacheWriter(void);
+  ~cEpgCacheWriter();
+  bool Ok(void) const { return ok; }
+  uint32_t Size(void) const;
+  void Add(const cSchedule *Schedule, time_t Now);
+  bool Write(FILE *f);
+  };
+
+cEpgCacheWriter::cEpgCacheWriter(void)
+{
+  stringHash = NULL;
+  stringHashSize = 0;
+  numStrings = numSchedules = numEvents = numComponents = 0;
+  ok = strings.Append("", 1);
+}
+
+cEpgCacheWriter::~cEpgCacheWriter()
+{
+  free(stringHash);
+}
+
+uint32_t cEpgCacheWriter::String(const char *s)
+{
+  if (isempty(s) || !ok)
+     return 0;
+  if (2 * numStrings >= stringHashSize) {
+     int NewSize = stringHashSize ? 2 * stringHashSize : 4096;
+     uint32_t *NewHash = (uint32_t *)calloc(NewSize, sizeof(uint32_t));
+     if (!NewHash) {
+        esyslog("ERROR: out of memory");
+        ok = false;
+        return 0;
+        }
+     for (int i = 0; i < stringHashSize; i++) {
+         if (uint32_t Offset = stringHash[i]) {
+            uint32_t h = 2166136261u; // FNV-1a
+            for (const uchar *p = strings.Data() + Offset; *p; p++)
+                h = (h ^ *p) * 16777619u;
+            int j = h & (NewSize - 1);
+            while (NewHash[j])
+                  j = (j + 1) & (NewSize - 1);
+            NewHash[j] = Offset;
+            }
+         }
+     free(stringHash);
+     stringHash = NewHash;
+     stringHashSize = NewSize;
+     }
+  uint32_t h = 2166136261u;
+  for (const uchar *p = (const uchar *)s; *p; p++)
+      h = (h ^ *p) * 16777619u;
+  int i = h & (stringHashSize - 1);
+  while (uint32_t Offset = stringHash[i]) {
+        if (strcmp((const char *)strings.Data() + Offset, s) == 0)
+           return Offset;
+        i = (i + 1) & (stringHashSize - 1);
+        }
+  uint32_t Offset = strings.Used();
+  if (!strings.Append(s, strlen(s) + 1)) {
+     ok = false;
+     return 0;
+     }
+  stringHash[i] = Offset;
+  numStrings++;
+  return Offset;
+}
+
+void cEpgCacheWriter::AddEvent(tEpgCacheEvent *Event, const char *Title, const char *ShortText, const char *Description)
+{
+  Event->title = String(Title);
+  Event->shortText = String(ShortText);
+  Event->description = String(Description);
+  ok = ok && events.Append(Event, sizeof(*Event));
+  numEvents++;
+}
+
+void cEpgCacheWriter::AddComponent(uchar Stream, uchar Type, const char *Language, const char *Description)
+{
+  tEpgCacheComponent c;
+  memset(&c, 0, sizeof(c));
+  c.stream = Stream;
+  c.type = Type;
+  strn0cpy(c.language, Language, sizeof(c.language));
+  c.description = String(Description);
+  ok = ok && components.Append(&c, sizeof(c));
+  numComponents++;
+}
+
+void cEpgCacheWriter::Add(const cSchedule *Schedule, time_t Now)
+{
+  // Just like cSchedule::Dump() we only save schedules of known channels and
+  // drop events that have ended longer than EPGLinger ago:
+  cChannel *channel = Channels.GetByChannelID(Schedule->ChannelID(), true);
+  if (!channel)
+     return;
+  tEpgCacheSchedule s;
+  memset(&s, 0, sizeof(s));
+  s.channelID = String(channel->GetChannelID().ToString());
+  s.firstEvent = numEvents;
+  tEpgCacheEvent e;
+  memset(&e, 0, sizeof(e));
+  if (Schedule->cached) {
+     // This schedule has not been unpacked yet, so we copy it right from the cache:
+     cEpgCacheSegment Segment(Schedule->cachedSegment);
+     const tEpgCacheSchedule *cs = Schedule->cached;
+     for (const tEpgCacheEvent *p = Segment.Events() + cs->firstEvent; p < Segment.Events() + cs->firstEvent + cs->numEvents; p++) {
+         if (p->startTime + p->duration + Setup.EPGLinger * 60 >= Now) {
+            e = *p;
+            e.firstComponent = numComponents;
+            for (const tEpgCacheComponent *c = Segment.Components() + p->firstComponent; c < Segment.Components() + p->firstComponent + p->numComponents; c++)
+                AddComponent(c->stream, c->type, c->language, Segment.String(c->description));
+            AddEvent(&e, Segment.String(p->title), Segment.String(p->shortText), Segment.String(p->description));
+            }
+         }
+     }
+  else {
+     for (const cEvent *p = Schedule->events.First(); p; p = Schedule->events.Next(p)) {
+         if (p->EndTime() + Setup.EPGLinger * 60 >= Now) {
+            e.startTime = p->StartTime();
+            e.vps = p->Vps();
+            e.eventID = p->EventID();
+            e.duration = p->Duration();
+            e.tableID = p->TableID();
+            e.version = p->Version();
+            e.firstComponent = numComponents;
+            e.numComponents = 0;
+            if (const cComponents *Components = p->Components()) {
+               for (int i = 0; i < Components->NumComponents(); i++) {
+                   const tComponent *c = Components->Component(i);
+                   AddComponent(c->stream, c->type, c->language, c->description);
+                   e.numComponents++;
+                   }
+               }
+            AddEvent(&e, p->Title(), p->ShortText(), p->Description());
+            }
+         }
+     }
+  s.numEvents = numEvents - s.firstEvent;
+  ok = ok && schedules.Append(&s, sizeof(s));
+  numSchedules++;
+}
+
+uint32_t cEpgCacheWriter::Size(void) const
+{
+  return sizeof(tEpgCacheHeader) + schedules.Used() + events.Used() + components.Used() + EPGCACHEALIGN(strings.Used());
+}
+
+bool cEpgCacheWriter::Write(FILE *f)
+{
+  tEpgCacheHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = EPGCACHEMAGIC;
+  h.version = EPGCACHEVERSION;
+  h.numSchedules = numSchedules;
+  h.numEvents = numEvents;
+  h.numComponents = numComponents;
+  h.stringsSize = strings.Used();
+  h.size = Size();
+  uint64_t Padding = 0;
+  return fwrite(&h, sizeof(h), 1, f) == 1
+      && fwrite(schedules.Data(), 1, schedules.Used(), f) == size_t(schedules.Used())
+      && fwrite(events.Data(), 1, events.Used(), f) == size_t(events.Used())
+      && fwrite(components.Data(), 1, components.Used(), f) == size_t(components.Used())
+      && fwrite(strings.Data(), 1, strings.Used(), f) == size_t(strings.Used())
+      && fwrite(&Padding, 1, EPGCACHEALIGN(h.stringsSize) - h.stringsSize, f) == EPGCACHEALIGN(h.stringsSize) - h.stringsSize;
+}
+
+// --- cEpgCache -------------------------------------------------------------
+
+class cEpgCache {
+private:
+  static cMutex mutex;
+  static uchar *data;
+  static size_t size;
+  static int pending; // the number of schedules that have not been unpacked yet
+  static off_t baseSize; // the size of the first segment in the file
+  static off_t journalSize; // the size of the segments following it
+  static bool compact; // the file needs to be rewritten
+  static cString FileName(const char *EpgDataFileName);
+  static void Unmap(void);
+public:
+  static bool Load(const char *EpgDataFileName, cSchedules *Schedules);
+       // Maps the cache of the given EpgDataFileName into memory and assigns
+       // its data to the respective schedules. Returns false if there is no
+       // valid cache, or if EpgDataFileName is newer than it.
+  static bool Save(const char *EpgDataFileName, bool Full);
+       // Saves the schedules that have been modified since the last call, or
+       // all of them if Full is true (or if the file needs to be compacted).
+  static void Unpack(cSchedule *Schedule);
+       // Creates the cached events of Schedule.
+  static void Forget(cSchedule *Schedule);
+  static bool Outdated(const cSchedule *Schedule, time_t Time);
+       // Returns true if the first cached event of Schedule would be removed
+       // by cSchedule::Cleanup(Time).
+  };
+
+cMutex cEpgCache::mutex;
+uchar *cEpgCache::data = NULL;
+size_t cEpgCache::size = 0;
+int cEpgCache::pending = 0;
+off_t cEpgCache::baseSize = 0;
+off_t cEpgCache::journalSize = 0;
+bool cEpgCache::compact = true;
+
+cString cEpgCache::FileName(const char *EpgDataFileName)
+{
+  return cString::sprintf("%s%s", EpgDataFileName, EPGCACHESUFFIX);
+}
+
+void cEpgCache::Unmap(void)
+{
+  if (data) {
+     munmap(data, size);
+     data = NULL;
+     size = 0;
+     }
+}
+
+bool cEpgCache::Load(const char *EpgDataFileName, cSchedules *Schedules)
+{
+  cMutexLock MutexLock(&mutex);
+  if (data)
+     return false;
+  cString CacheFileName = FileName(EpgDataFileName);
+  struct stat Cache, Text;
+  if (stat(CacheFileName, &Cache) < 0)
+     return false;
+  if (stat(EpgDataFileName, &Text) == 0 && Text.st_mtime > Cache.st_mtime) {
+     dsyslog("%s is newer than %s", EpgDataFileName, *CacheFileName);
+     return false;
+     }
+  int f = open(CacheFileName, O_RDONLY);
+  if (f < 0) {
+     LOG_ERROR_STR(*CacheFileName);
+     return false;
+     }
+  size = Cache.st_size;
+  void *p = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, f, 0) : MAP_FAILED;
+  close(f);
+  if (p == MAP_FAILED) {
+     LOG_ERROR_STR(*CacheFileName);
+     size = 0;
+     return false;
+     }
+  data = (uchar *)p;
+  const uchar *End = data + size;
+  const uchar *Valid = data;
+  for (const uchar *s = data; s < End && (s = cEpgCacheSegment::Check(s, End - s)) != NULL; )
+      Valid = s;
+  if (Valid == data) {
+     esyslog("ERROR: invalid EPG data cache %s", *CacheFileName);
+     Unmap();
+     return false;
+     }
+  if (Valid != End) // most likely an interrupted save
+     esyslog("ERROR: ignoring invalid data at offset %ld of %s", long(Valid - data), *CacheFileName);
+  baseSize = ((const tEpgCacheHeader *)data)->size;
+  journalSize = Valid - data - baseSize;
+  compact = Valid != End || journalSize > baseSize / 2;
+  dsyslog("reading EPG data from %s", *CacheFileName);
+  for (const uchar *s = data; s < Valid; s += ((const tEpgCacheHeader *)s)->size) {
+      cEpgCacheSegment Segment(s);
+      for (const tEpgCacheSchedule *cs = Segment.Schedules(); cs < Segment.Schedules() + Segment.Header()->numSchedules; cs++) {
+          tChannelID channelID = tChannelID::FromString(Segment.String(cs->channelID));
+          if (!channelID.Valid()) {
+             esyslog("ERROR: invalid channel ID: %s", Segment.String(cs->channelID));
+             continue;
+             }
+          cSchedule *p = Schedules->AddSchedule(channelID);
+          if (p && !p->events.First()) {
+             // A later segment replaces what an earlier one had for the same channel:
+             if (!p->cached)
+                pending++;
+             p->cached = cs;
+             p->cachedSegment = s;
+             Schedules->SetModified(p);
+             p->unsaved = false;
+             }
+          }
+      }
+  if (!pending)
+     Unmap();
+  return true;
+}
+
+void cEpgCache::Unpack(cSchedule *Schedule)
+{
+  cMutexLock MutexLock(&mutex);
+  const tEpgCacheSchedule *cs = Schedule->cached;
+  if (!cs)
+     return; // somebody else was faster
+  cEpgCacheSegment Segment(Schedule->cachedSegment);
+  for (const tEpgCacheEvent *p = Segment.Events() + cs->firstEvent; p < Segment.Events() + cs->firstEvent + cs->numEvents; p++) {
+      cEvent *Event = new cEvent(p->eventID);
+      Event->seen = 0;
+      Event->SetTableID(p->tableID);
+      Event->SetVersion(p->version);
+      Event->SetStartTime(p->startTime);
+      Event->SetDuration(p->duration);
+      Event->SetTitle(Segment.String(p->title));
+      Event->SetShortText(Segment.String(p->shortText));
+      Event->SetDescription(Segment.String(p->description));
+      if (p->numComponents) {
+         cComponents *Components = new cComponents;
+         for (int i = 0; i < p->numComponents; i++) {
+             const tEpgCacheComponent *c = &Segment.Components()[p->firstComponent + i];
+             Components->SetComponent(i, c->stream, c->type, c->language, Segment.String(c->description));
+             }
+         Event->SetComponents(Components);
+         }
+      Event->SetVps(p->vps);
+      // Not using AddEvent() here, because other threads must not see this
+      // schedule as unpacked before all of its events are in place:
+      Schedule->events.Add(Event);
+      Event->schedule = Schedule;
+      Schedule->HashEvent(Event);
+      }
+  Schedule->events.Sort();
+  Schedule->cachedSegment = NULL;
+  StoreRelease(&Schedule->cached, NULL); // the events must be visible before this
+  if (--pending == 0)
+     Unmap();
+}
+
+void cEpgCache::Forget(cSchedule *Schedule)
+{
+  cMutexLock MutexLock(&mutex);
+  if (Schedule->cached) {
+     Schedule->cached = NULL;
+     Schedule->cachedSegment = NULL;
+     if (--pending == 0)
+        Unmap();
+     }
+}
+
+bool cEpgCache::Outdated(const cSchedule *Schedule, time_t Time)
+{
+  const tEpgCacheSchedule *cs = Schedule->cached;
+  if (cs && cs->numEvents) {
+     const tEpgCacheEvent *p = cEpgCacheSegment(Schedule->cachedSegment).Events() + cs->firstEvent;
+     return p->startTime + p->duration + Setup.EPGLinger * 60 + 3600 < Time;
+     }
+  return false;
+}
+
+bool cEpgCache::Save(const char *EpgDataFileName, bool Full)
+{
+  Full |= compact;
+  cEpgCacheWriter Writer;
+  int Schedules = 0;
+  {
+    cSchedulesLock SchedulesLock;
+    const cSchedules *s = cSchedules::Schedules(SchedulesLock);
+    if (!s)
+       return false;
+    cMutexLock MutexLock(&mutex); // keeps the cache from being unpacked and unmapped
+    time_t now = time(NULL);
+    for (cSchedule *p = (cSchedule *)s->First(); p; p = (cSchedule *)s->Next(p)) {
+        if (Full || p->unsaved) {
+           Writer.Add(p, now);
+           p->unsaved = false;
+           Schedules++;
+           }
+        }
+  }
+  if (!Writer.Ok()) {
+     compact = true;
+     return false;
+     }
+  if (!Schedules && !Full)
+     return true; // nothing has changed
+  cString CacheFileName = FileName(EpgDataFileName);
+  bool result = false;
+  if (Full) {
+     cSafeFile f(CacheFileName);
+     if (f.Open()) {
+        result = Writer.Write(f);
+        result = f.Close() && result;
+        }
+     if (result) {
+        baseSize = Writer.Size();
+        journalSize = 0;
+        }
+     }
+  else {
+     FILE *f = fopen(CacheFileName, "a");
+     if (f) {
+        result = Writer.Write(f);
+        result = fclose(f) == 0 && result;
+        }
+     if (result)
+        journalSize += Writer.Size();
+     }
+  if (result)
+     compact = journalSize > baseSize / 2;
+  else {
+     LOG_ERROR_STR(*CacheFileName);
+     compact = true; // whatever has been written must not be appended to
+     }
+  return result;
+}
+
 // --- cSchedule -------------------------------------------------------------
 
 cSchedule::cSchedule(tChannelID ChannelID)
 {
   channelID = ChannelID;
+  eventsByTime = NULL;
+  numEventsByTime = 0;
+  maxEventsByTime = 0;
+  cached = NULL;
+  cachedSegment = NULL;
+  unsaved = false;
   hasRunning = false;
   modified = 0;
   presentSeen = 0;
 }
 
+cSchedule::~cSchedule()
+{
+  if (cached)
+     cEpgCache::Forget(this);
+  free(eventsByTime);
+}
+
+void cSchedule::Unpack(void) const
+{
+  if (LoadAcquire(&cached))
+     cEpgCache::Unpack((cSchedule *)this);
+}
+
+int cSchedule::IndexPosition(time_t StartTime, bool After) const
+{
+  int Low = 0;
+  int High = numEventsByTime;
+  while (Low < High) {
+        int i = (Low + High) / 2;
+        time_t t = eventsByTime[i]->StartTime();
+        if (t < StartTime || (After && t == StartTime))
+           Low = i + 1;
+        else
+           High = i;
+        }
+  return Low;
+}
+
+int cSchedule::IndexOf(const cEvent *Event) const
+{
+  for (int i = IndexPosition(Event->StartTime(), false); i < numEventsByTime && eventsByTime[i]->StartTime() == Event->StartTime(); i++) {
+      if (eventsByTime[i] == Event)
+         return i;
+      }
+  return -1;
+}
+
+void cSchedule::IndexEvent(cEvent *Event)
+{
+  if (numEventsByTime == maxEventsByTime) {
+     int NewMax = maxEventsByTime ? 2 * maxEventsByTime : 64;
+     cEvent **NewEvents = (cEvent **)realloc(eventsByTime, NewMax * sizeof(cEvent *));
+     if (!NewEvents) {
+        esyslog("ERROR: out of memory");
+        return;
+        }
+     eventsByTime = NewEvents;
+     maxEventsByTime = NewMax;
+     }
+  int i = IndexPosition(Event->StartTime(), true);
+  memmove(&eventsByTime[i + 1], &eventsByTime[i], (numEventsByTime - i) * sizeof(cEvent *));
+  eventsByTime[i] = Event;
+  numEventsByTime++;
+}
+
+void cSchedule::UnindexEvent(cEvent *Event)
+{
+  int i = IndexOf(Event);
+  if (i >= 0) {
+     numEventsByTime--;
+     memmove(&eventsByTime[i], &eventsByTime[i + 1], (numEventsByTime - i) * sizeof(cEvent *));
+     }
+}
+
 cEvent *cSchedule::AddEvent(cEvent *Event)
 {
+  Unpack();
   events.Add(Event);
   Event->schedule = this;
   HashEvent(Event);
@@ -839,6 +1490,7 @@ cEvent *cSchedule::AddEvent(cEvent *Event)
 
 void cSchedule::DelEvent(cEvent *Event)
 {
+  Unpack();
   if (Event->schedule == this) {
      if (hasRunning && Event->IsRunning())
         ClrRunningStatus();
@@ -852,6 +1504,7 @@ void cSchedule::HashEvent(cEvent *Event)
   eventsHashID.Add(Event, Event->EventID());
   if (Event->StartTime() > 0) // 'StartTime < 0' is apparently used with NVOD channels
      eventsHashStartTime.Add(Event, Event->StartTime());
+  IndexEvent(Event);
 }
 
 void cSchedule::UnhashEvent(cEvent *Event)
@@ -859,13 +1512,16 @@ void cSchedule::UnhashEvent(cEvent *Event)
   eventsHashID.Del(Event, Event->EventID());
   if (Event->StartTime() > 0) // 'StartTime < 0' is apparently used with NVOD channels
      eventsHashStartTime.Del(Event, Event->StartTime());
+  UnindexEvent(Event);
 }
 
 const cEvent *cSchedule::GetPresentEvent(void) const
 {
+  Unpack();
   const cEvent *pe = NULL;
   time_t now = time(NULL);
-  for (cEvent *p = events.First(); p; p = events.Next(p)) {
+  for (int i = 0; i < numEventsByTime; i++) {
+      const cEvent *p = eventsByTime[i];
       if (p->StartTime() <= now)
          pe = p;
       else if (p->StartTime() > now + 3600)
@@ -878,21 +1534,15 @@ const cEvent *cSchedule::GetPresentEvent(void) const
 
 const cEvent *cSchedule::GetFollowingEvent(void) const
 {
+  Unpack();
   const cEvent *p = GetPresentEvent();
-  if (p)
-     p = events.Next(p);
-  else {
-     time_t now = time(NULL);
-     for (p = events.First(); p; p = events.Next(p)) {
-         if (p->StartTime() >= now)
-            break;
-         }
-     }
-  return p;
+  int i = p ? IndexOf(p) + 1 : IndexPosition(time(NULL), false);
+  return i < numEventsByTime ? eventsByTime[i] : NULL;
 }
 
 const cEvent *cSchedule::GetEvent(tEventID EventID, time_t StartTime) const
 {
+  Unpack();
   // Returns the event info with the given StartTime or, if no actual StartTime
   // is given, the one with the given EventID.
   if (StartTime > 0) // 'StartTime < 0' is apparently used with NVOD channels
@@ -903,30 +1553,39 @@ const cEvent *cSchedule::GetEvent(tEventID EventID, time_t StartTime) const
 
 const cEvent *cSchedule::GetEventAround(time_t Time) const
 {
-  const cEvent *pe = NULL;
-  time_t delta = INT_MAX;
-  for (cEvent *p = events.First(); p; p = events.Next(p)) {
-      time_t dt = Time - p->StartTime();
-      if (dt >= 0 && dt < delta && p->EndTime() >= Time) {
-         delta = dt;
-         pe = p;
+  Unpack();
+  // The latest event that starts at or before Time and is still running then:
+  for (int i = IndexPosition(Time, true); i-- > 0; ) {
+      const cEvent *p = eventsByTime[i];
+      if (p->EndTime() >= Time) {
+         while (i > 0 && eventsByTime[i - 1]->StartTime() == p->StartTime() && eventsByTime[i - 1]->EndTime() >= Time)
+               p = eventsByTime[--i];
+         return p;
          }
       }
-  return pe;
+  return NULL;
 }
 
 void cSchedule::SetRunningStatus(cEvent *Event, int RunningStatus, cChannel *Channel)
 {
+  Unpack();
   hasRunning = false;
-  for (cEvent *p = events.First(); p; p = events.Next(p)) {
-      if (p == Event) {
-         if (p->RunningStatus() > SI::RunningStatusNotRunning || RunningStatus > SI::RunningStatusNotRunning) {
-            p->SetRunningStatus(RunningStatus, Channel);
-            break;
+  // Only events that start no later than Event can be affected, but any
+  // event may still be running. As before, the walk ends once Event itself
+  // has been set:
+  int n = IndexPosition(Event->StartTime(), true);
+  for (int i = 0; i < n || (!hasRunning && i < numEventsByTime); i++) {
+      cEvent *p = eventsByTime[i];
+      if (i < n) {
+         if (p == Event) {
+            if (p->RunningStatus() > SI::RunningStatusNotRunning || RunningStatus > SI::RunningStatusNotRunning) {
+               p->SetRunningStatus(RunningStatus, Channel);
+               break;
+               }
             }
+         else if (RunningStatus >= SI::RunningStatusPausing && p->StartTime() < Event->StartTime())
+            p->SetRunningStatus(SI::RunningStatusNotRunning);
          }
-      else if (RunningStatus >= SI::RunningStatusPausing && p->StartTime() < Event->StartTime())
-         p->SetRunningStatus(SI::RunningStatusNotRunning);
       if (p->RunningStatus() >= SI::RunningStatusPausing)
          hasRunning = true;
       }
@@ -934,6 +1593,7 @@ void cSchedule::SetRunningStatus(cEvent *Event, int RunningStatus, cChannel *Cha
 
 void cSchedule::ClrRunningStatus(cChannel *Channel)
 {
+  Unpack();
   if (hasRunning) {
      for (cEvent *p = events.First(); p; p = events.Next(p)) {
          if (p->RunningStatus() >= SI::RunningStatusPausing) {
@@ -947,12 +1607,14 @@ void cSchedule::ClrRunningStatus(cChannel *Channel)
 
 void cSchedule::ResetVersions(void)
 {
+  Unpack();
   for (cEvent *p = events.First(); p; p = events.Next(p))
       p->SetVersion(0xFF);
 }
 
 void cSchedule::Sort(void)
 {
+  Unpack();
   events.Sort();
   // Make sure there are no RunningStatusUndefined before the currently running event:
   if (hasRunning) {
@@ -966,28 +1628,32 @@ void cSchedule::Sort(void)
 
 void cSchedule::DropOutdated(time_t SegmentStart, time_t SegmentEnd, uchar TableID, uchar Version)
 {
+  Unpack();
   if (SegmentStart > 0 && SegmentEnd > 0) {
-     for (cEvent *p = events.First(); p; p = events.Next(p)) {
-         if (p->EndTime() > SegmentStart) {
-            if (p->StartTime() < SegmentEnd) {
-               // The event overlaps with the given time segment.
-               if (p->TableID() > TableID || p->TableID() == TableID && p->Version() != Version) {
-                  // The segment overwrites all events from tables with higher ids, and
-                  // within the same table id all events must have the same version.
-                  // We can't delete the event right here because a timer might have
-                  // a pointer to it, so let's set its id and start time to 0 to have it
-                  // "phased out":
-                  if (hasRunning && p->IsRunning())
-                     ClrRunningStatus();
-                  UnhashEvent(p);
-                  p->eventID = 0;
-                  p->startTime = 0;
-                  }
-               }
-            else
-               break;
-            }
-         }
+     // Start with the events that begin before the segment, but reach into it:
+     int i = IndexPosition(SegmentStart, true);
+     while (i > 0 && eventsByTime[i - 1]->EndTime() > SegmentStart)
+           i--;
+     while (i < numEventsByTime) {
+           cEvent *p = eventsByTime[i];
+           if (p->StartTime() >= SegmentEnd)
+              break;
+           // The event overlaps with the given time segment.
+           if (p->EndTime() > SegmentStart && (p->TableID() > TableID || p->TableID() == TableID && p->Version() != Version)) {
+              // The segment overwrites all events from tables with higher ids, and
+              // within the same table id all events must have the same version.
+              // We can't delete the event right here because a timer might have
+              // a pointer to it, so let's set its id and start time to 0 to have it
+              // "phased out":
+              if (hasRunning && p->IsRunning())
+                 ClrRunningStatus();
+              UnhashEvent(p); // this also takes it out of eventsByTime
+              p->eventID = 0;
+              p->startTime = 0;
+              }
+           else
+              i++;
+           }
      }
 }
 
@@ -998,6 +1664,9 @@ void cSchedule::Cleanup(void)
 
 void cSchedule::Cleanup(time_t Time)
 {
+  if (cached && !cEpgCache::Outdated(this, Time))
+     return; // no need to unpack it just yet
+  Unpack();
   cEvent *Event;
   while ((Event = events.First()) != NULL) {
         if (!Event->HasTimer() && Event->EndTime() + Setup.EPGLinger * 60 + 3600 < Time) // adding one hour for safety
@@ -1009,6 +1678,7 @@ void cSchedule::Cleanup(time_t Time)
 
 void cSchedule::Dump(FILE *f, const char *Prefix, eDumpMode DumpMode, time_t AtTime) const
 {
+  Unpack();
   cChannel *channel = Channels.GetByChannelID(channelID, true);
   if (channel) {
      fprintf(f, "%sC %s %s\n", Prefix, *channel->GetChannelID().ToString(), channel->Name());
@@ -1135,13 +1805,19 @@ void cSchedules::Cleanup(bool Force)
         ReportEpgBugFixStats(true);
      }
   if (epgDataFileName && now - lastDump > 600) {
-     cSafeFile f(epgDataFileName);
-     if (f.Open()) {
-        Dump(f);
-        f.Close();
+     if (Force) {
+        // The textual epg.data is only written when explicitly requested (at
+        // shutdown or after SVDRP PUTE), the cache takes care of the rest:
+        cSafeFile f(epgDataFileName);
+        if (f.Open()) {
+           Dump(f);
+           f.Close();
+           }
+        else
+           LOG_ERROR;
         }
-     else
-        LOG_ERROR;
+     // Saving the cache after epg.data makes sure it is the newer one:
+     cEpgCache::Save(epgDataFileName, Force);
      lastDump = now;
      }
 }
@@ -1163,8 +1839,10 @@ bool cSchedules::ClearAll(void)
   if (s) {
      for (cTimer *Timer = Timers.First(); Timer; Timer = Timers.Next(Timer))
          Timer->SetEvent(NULL);
-     for (cSchedule *Schedule = s->First(); Schedule; Schedule = s->Next(Schedule))
+     for (cSchedule *Schedule = s->First(); Schedule; Schedule = s->Next(Schedule)) {
          Schedule->Cleanup(INT_MAX);
+         SetModified(Schedule);
+         }
      return true;
      }
   return false;
@@ -1189,6 +1867,8 @@ bool cSchedules::Read(FILE *f)
   if (s) {
      bool OwnFile = f == NULL;
      if (OwnFile) {
+        if (epgDataFileName && cEpgCache::Load(epgDataFileName, s))
+           return true;
         if (epgDataFileName && access(epgDataFileName, R_OK) == 0) {
            dsyslog("reading EPG data from %s", epgDataFileName);
            if ((f = fopen(epgDataFileName, "r")) == NULL) {
@@ -52,6 +52,7 @@ typedef u_int32_t tEventID;
 
 class cEvent : public cListObject {
   friend class cSchedule;
+  friend class cEpgCache;
 private:
   cSchedule *schedule;     // The Schedule this event belongs to
   tEventID eventID;        // Event ID of this event
@@ -112,23 +113,43 @@ public:
   };
 
 class cSchedules;
+struct tEpgCacheSchedule;
 
 class cSchedule : public cListObject  {
+  friend class cEpgCache;
+  friend class cEpgCacheWriter;
 private:
   tChannelID channelID;
   cList<cEvent> events;
   cHash<cEvent> eventsHashID;
   cHash<cEvent> eventsHashStartTime;
+  cEvent **eventsByTime;   // The hashed events, sorted by start time
+  int numEventsByTime;
+  int maxEventsByTime;
+  const tEpgCacheSchedule *cached; // The events of this schedule that still are in the EPG data cache
+  const uchar *cachedSegment;
+  bool unsaved;            // Modified since it was last saved to the EPG data cache
   bool hasRunning;
   time_t modified;
   time_t presentSeen;
+  void Unpack(void) const;
+       // Creates the events that are still in the EPG data cache. Readers only
+       // hold the schedules' read lock, so this may run in several threads at
+       // once; the events are created exactly once.
+  int IndexPosition(time_t StartTime, bool After) const;
+       // Returns the position in eventsByTime of the first event that starts at or,
+       // if After is true, after the given StartTime.
+  int IndexOf(const cEvent *Event) const;
+  void IndexEvent(cEvent *Event);
+  void UnindexEvent(cEvent *Event);
 public:
   cSchedule(tChannelID ChannelID);
+  virtual ~cSchedule();
   tChannelID ChannelID(void) const { return channelID; }
   time_t Modified(void) const { return modified; }
   time_t PresentSeen(void) const { return presentSeen; }
   bool PresentSeenWithin(int Seconds) const { return time(NULL) - presentSeen < Seconds; }
-  void SetModified(void) { modified = time(NULL); }
+  void SetModified(void) { modified = time(NULL); unsaved = true; }
   void SetPresentSeen(void) { presentSeen = time(NULL); }
   void SetRunningStatus(cEvent *Event, int RunningStatus, cChannel *Channel = NULL);
   void ClrRunningStatus(cChannel *Channel = NULL);
@@ -141,7 +162,7 @@ public:
   void DelEvent(cEvent *Event);
   void HashEvent(cEvent *Event);
   void UnhashEvent(cEvent *Event);
-  const cList<cEvent> *Events(void) const { return &events; }
+  const cList<cEvent> *Events(void) const { Unpack(); return &events; }
   const cEvent *GetPresentEvent(void) const;
   const cEvent *GetFollowingEvent(void) const;
   const cEvent *GetEvent(tEventID EventID, time_t StartTime = 0) const;
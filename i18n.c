@@ -78,6 +78,7 @@
 #include "i18n.h"
 #include <ctype.h>
 #include "config.h"
+#include "thread.h"
 #include "tools.h"
 
 const tI18nPhrase Phrases[] = {
@@ -11664,19 +11665,103 @@ const tI18nPhrase Phrases[] = {
   { NULL }
   };
 
+// --- cI18nIndex ------------------------------------------------------------
+
+// A hash index over a phrase table, holding only those phrases that have
+// a translation in the language it has been built for. It is rebuilt
+// whenever a lookup is done for a different language.
+
+class cI18nIndex {
+private:
+  const tI18nPhrase *phrases;
+  const tI18nPhrase **slots;
+  int size;
+  int language;
+  static unsigned int Hash(const char *s);
+  void Build(int Language);
+public:
+  cI18nIndex(const tI18nPhrase * const Phrases);
+  ~cI18nIndex();
+  const tI18nPhrase *Find(const char *s, int Language);
+       // Returns the first phrase in the table that matches s and has a
+       // non-empty translation in the given Language, or NULL if there is none.
+  };
+
+cI18nIndex::cI18nIndex(const tI18nPhrase * const Phrases)
+{
+  phrases = Phrases;
+  slots = NULL;
+  size = 0;
+  language = -1;
+}
+
+cI18nIndex::~cI18nIndex()
+{
+  free(slots);
+}
+
+unsigned int cI18nIndex::Hash(const char *s)
+{
+  unsigned int h = 2166136261u; // FNV-1a
+  while (*s)
+        h = (h ^ (uchar)*s++) * 16777619u;
+  return h;
+}
+
+void cI18nIndex::Build(int Language)
+{
+  int n = 0;
+  for (const tI18nPhrase *p = phrases; **p; p++)
+      n++;
+  int Size = 64;
+  while (Size < 2 * n)
+        Size <<= 1;
+  if (Size != size) {
+     free(slots);
+     slots = MALLOC(const tI18nPhrase *, Size);
+     size = Size;
+     }
+  memset(slots, 0, size * sizeof(*slots));
+  for (const tI18nPhrase *p = phrases; **p; p++) {
+      const char *t = (*p)[Language];
+      if (t && *t) {
+         unsigned int i = Hash(**p) & (size - 1);
+         while (slots[i] && strcmp(**slots[i], **p) != 0)
+               i = (i + 1) & (size - 1);
+         if (!slots[i])
+            slots[i] = p; // the first one wins, just like a linear search would
+         }
+      }
+  language = Language;
+}
+
+const tI18nPhrase *cI18nIndex::Find(const char *s, int Language)
+{
+  if (Language != language)
+     Build(Language);
+  for (unsigned int i = Hash(s) & (size - 1); slots[i]; i = (i + 1) & (size - 1)) {
+      if (strcmp(**slots[i], s) == 0)
+         return slots[i];
+      }
+  return NULL;
+}
+
 // --- cI18nEntry ------------------------------------------------------------
 
 class cI18nEntry : public cListObject {
 private:
   const tI18nPhrase *phrases;
   const char *plugin;
+  cI18nIndex index;
 public:
   cI18nEntry(const tI18nPhrase * const Phrases, const char *Plugin);
   const tI18nPhrase *Phrases(void) { return phrases; }
   const char *Plugin(void) { return plugin; }
+  cI18nIndex *Index(void) { return &index; }
   };
 
 cI18nEntry::cI18nEntry(const tI18nPhrase * const Phrases, const char *Plugin)
+:index(Phrases)
 {
   phrases = Phrases;
   plugin = Plugin;
@@ -11709,33 +11794,71 @@ const tI18nPhrase *cI18nList::GetPhrases(const char *Plugin)
 
 cI18nList I18nList;
 
+// --- cI18nMemo -------------------------------------------------------------
+
+// Remembers the phrases found for the most recently translated strings,
+// keyed by the address of the string and the plugin it came from. Since
+// tr() is mostly called with string literals this avoids even hashing
+// the string. The text is still compared, so a reused buffer can't
+// yield a stale translation.
+
+#define I18NMEMOSIZE 1024 // must be a power of 2
+
+struct tI18nMemo {
+  const char *s;
+  const char *plugin;
+  int language;
+  const tI18nPhrase *phrase;
+  };
+
+static tI18nMemo I18nMemo[I18NMEMOSIZE];
+static cMutex I18nMutex; // protects I18nMemo and the indexes
+
+static cI18nIndex PhrasesIndex(Phrases);
+
+static void I18nMemoClear(void)
+{
+  memset(I18nMemo, 0, sizeof(I18nMemo));
+}
+
+static tI18nMemo *I18nMemoSlot(const char *s, const char *Plugin)
+{
+  unsigned long k = (unsigned long)s ^ ((unsigned long)Plugin >> 4);
+  return &I18nMemo[(k ^ (k >> 10)) & (I18NMEMOSIZE - 1)];
+}
+
 // ---
 
 void I18nRegister(const tI18nPhrase * const Phrases, const char *Plugin)
 {
+  cMutexLock MutexLock(&I18nMutex);
   cI18nEntry *p = I18nList.Get(Plugin);
   if (p)
      I18nList.Del(p);
   if (Phrases)
      I18nList.Add(new cI18nEntry(Phrases, Plugin));
+  I18nMemoClear();
 }
 
 const char *I18nTranslate(const char *s, const char *Plugin)
 {
-  if (Setup.OSDLanguage) {
-     const tI18nPhrase *p = Plugin ? I18nList.GetPhrases(Plugin) : Phrases;
+  int Language = Setup.OSDLanguage;
+  if (Language) {
+     cMutexLock MutexLock(&I18nMutex);
+     tI18nMemo *m = I18nMemoSlot(s, Plugin);
+     if (m->s == s && m->plugin == Plugin && m->language == Language && strcmp(s, **m->phrase) == 0)
+        return (*m->phrase)[Language];
+     cI18nEntry *e = Plugin ? I18nList.Get(Plugin) : NULL;
+     const tI18nPhrase *p = e ? e->Index()->Find(s, Language) : NULL;
      if (!p)
-        p = Phrases;
-     for (int i = ((p == Phrases) ? 1 : 2); i--; ) {
-         for (; **p; p++) {
-             if (strcmp(s, **p) == 0) {
-                const char *t = (*p)[Setup.OSDLanguage];
-                if (t && *t)
-                   return t;
-                }
-             }
-         p = Phrases;
-         }
+        p = PhrasesIndex.Find(s, Language);
+     if (p) {
+        m->s = s;
+        m->plugin = Plugin;
+        m->language = Language;
+        m->phrase = p;
+        return (*p)[Language];
+        }
      esyslog("%s%sno translation found for '%s' in language %d (%s)", Plugin ? Plugin : "", Plugin ? ": " : "", s, Setup.OSDLanguage, Phrases[0][Setup.OSDLanguage]);
      }
   const char *p = strchr(s, '$');
@@ -114,6 +114,8 @@ void cFileName64::CloseAndRemove(void)
 cUnbufferedFile64::cUnbufferedFile64(void)
 {
   fd = -1;
+  device = 0;
+  direct = NULL;
 }
 
 cUnbufferedFile64::~cUnbufferedFile64()
@@ -126,6 +128,15 @@ int cUnbufferedFile64::Open(const char *FileName, int Flags, mode_t Mode)
   Close();
   fd = open64(FileName, Flags, Mode);
   curpos = 0;
+  struct stat64 st;
+  device = fd >= 0 && fstat64(fd, &st) == 0 ? st.st_dev : 0;
+  if (fd >= 0 && (Flags & O_CREAT) && cDirectWriter::Enabled()) {
+     direct = new cDirectWriter;
+     if (!direct->Open(FileName)) {
+        delete direct;
+        direct = NULL;
+        }
+     }
 #ifdef USE_FADVISE
   begin = lastpos = ahead = 0;
   cachedstart = 0;
@@ -141,6 +152,8 @@ int cUnbufferedFile64::Open(const char *FileName, int Flags, mode_t Mode)
 
 int cUnbufferedFile64::Close(void)
 {
+  delete direct;
+  direct = NULL;
 #ifdef USE_FADVISE
   if (fd >= 0) {
      if (totwritten)
@@ -222,6 +235,19 @@ ssize_t cUnbufferedFile64::Read(void *Data, size_t Size)
 
 ssize_t cUnbufferedFile64::Write(const void *Data, size_t Size)
 {
+  if (fd >= 0 && direct) {
+     // The live buffer's readers may read each frame as soon as it has been
+     // written, so the partial page can't be held back:
+     ssize_t bytesWritten = direct->Write(fd, curpos, Data, Size);
+     if (bytesWritten > 0 && !direct->Flush())
+        bytesWritten = -1;
+     if (bytesWritten > 0) {
+        curpos += bytesWritten;
+        lseek64(fd, curpos, SEEK_SET);
+        totwritten += bytesWritten;
+        }
+     return bytesWritten;
+     }
   if (fd >=0) {
      ssize_t bytesWritten = safe_write(fd, Data, Size);
 #ifdef USE_FADVISE
@@ -539,67 +565,79 @@ cLiveFileReader::cLiveFileReader(const char *FileName, int Number)
   fileName->SetNumber(Number);
   readFile = fileName->Open();
   buffer = NULL;
+  pool = NULL;
   filePos = 0;
-  Start();
+  length = wanted = 0;
 }
 
 cLiveFileReader::~cLiveFileReader()
 {
-  Cancel(3);
+  Cancel();
+  WaitIdle();
+  Clear();
   delete fileName;
 }
 
-void cLiveFileReader::Action(void)
+int cLiveFileReader::DoRead(uchar *Data, int Size)
 {
-  while (Running()) {
-    Lock();
-    if (buffer && !hasData) {
-      int r = readFile->Read(buffer + length, wanted - length);
-      if (r >= 0) {
-        length += r;
-        filePos += r;
-        if (length == wanted)
-          hasData = true;
-        }
-      else if (r < 0 && FATALERRNO) {
-        LOG_ERROR;
-        length = r;
-        hasData = true;
-        }
-      }
-    Unlock();
-    newSet.Wait(1000);
-    }
+  // called from the cAsyncReader thread
+  int r = readFile->Read(Data, Size);
+  if (r > 0)
+     filePos += r;
+  return r;
 }
 
-int cLiveFileReader::Read(uchar **Buffer, off64_t FilePos, int Size)
+int cLiveFileReader::Read(uchar **Buffer, off64_t FilePos, int Size, cRingBufferFrame *Pool)
 {
-  if (buffer && hasData) {
+  if (buffer) {
+    if (!Done())
+       return -1;
+    int r = Result();
+    if (r < 0) {
+       LOG_ERROR;
+       Clear();
+       return -1;
+       }
+    length += r;
+    if (length < wanted) {
+       // the rest of the frame hasn't been written yet
+       Submit(buffer + length, wanted - length);
+       return -1;
+       }
     *Buffer = buffer;
     buffer = NULL;
     return length;
     }
-  if (!buffer) {
-    uchar *b = MALLOC(uchar, Size);
-    if (filePos != FilePos) {
-      filePos = FilePos;
-      readFile->Seek(FilePos,0);
-      }
-    wanted = Size;
-    length = 0;
-    hasData = false;
-    buffer = b;
-    newSet.Signal();
+  WaitIdle(); // a cancelled read may still be using readFile and filePos
+  pool = Pool;
+  uchar *b = pool ? pool->Alloc(Size) : MALLOC(uchar, Size);
+  if (filePos != FilePos) {
+    filePos = FilePos;
+    readFile->Seek(FilePos,0);
     }
+  wanted = Size;
+  length = 0;
+  buffer = b;
+  Submit(buffer, wanted);
   return -1;
 }
 
 void cLiveFileReader::Clear(void)
 {
-  Lock();
-  delete buffer;
+  Cancel();
+  if (pool)
+     pool->Release(buffer);
+  else
+     free(buffer);
   buffer = NULL;
-  Unlock();
+}
+
+bool cLiveFileReader::WaitForDataMs(int msToWait)
+{
+  if (Pending())
+     return Wait(msToWait);
+  cCondWait::SleepMs(msToWait);
+  return false;
 }
 
 // --- cLiveFileWriter -------------------------------------------------------
@@ -879,7 +917,7 @@ void cLiveBuffer::SetNewRemux(cRemux *Remux, bool Clear)
     } 
 }
 
-int cLiveBuffer::GetFrame(uchar **Buffer, int Number, int Off)
+int cLiveBuffer::GetFrame(uchar **Buffer, int Number, int Off, cRingBufferFrame *Pool)
 { 
   if (!Buffer) {
     fileReader->Clear();
@@ -899,7 +937,7 @@ int cLiveBuffer::GetFrame(uchar **Buffer, int Number, int Off)
         off += Off;
         }
       if (size > 0) {
-      uchar *b = MALLOC(uchar, size);
+      uchar *b = Pool ? Pool->Alloc(size) : MALLOC(uchar, size);
       *Buffer = b;
       memcpy(b,&buffer[off],size);
          }
@@ -912,7 +950,7 @@ int cLiveBuffer::GetFrame(uchar **Buffer, int Number, int Off)
     return size;
     }
   else
-    return fileReader->Read(Buffer,index->GetOffset(Number),index->Size(Number));
+    return fileReader->Read(Buffer,index->GetOffset(Number),index->Size(Number),Pool);
   return -1;
 }
 
@@ -969,51 +1007,35 @@ cLiveReceiver::cLiveReceiver(const cChannel *Channel)
 :cReceiver(0, -1, Channel->Vpid(), Channel->Apids(), Channel->Dpids(), Channel->Spids()) //always use dpids (andreas)
 {
   channel = Channel;
-//  ringBuffer = new cRingBufferLinear(RECORDERBUFSIZE, TS_SIZE * 2, true, "Recorder");
-//  ringBuffer->SetTimeouts(0, 20); 
-  remux = new cRemux(Channel->Vpid(), Channel->Apids(), Channel->Dpids(), Channel->Spids()); //always use dpids (Klaus)
+  remux = cRemux::Acquire(Channel->GetChannelID(), Channel->Vpid(), Channel->Apids(), Channel->Dpids(), Channel->Spids()); //always use dpids (Klaus)
   remux->SetTimeouts(0, 50);
+  feeder = new cRemuxFeeder(remux, RECORDERBUFSIZE, "live buffer remux");
 }
 
 cLiveReceiver::~cLiveReceiver()
 {
   Detach();
   Cancel(3);
+  delete feeder;
   delete remux;
-//  delete ringBuffer;
 }
 
 void cLiveReceiver::Activate(bool On)
 {
-  if (On) {
-//     Start();
-     }
-  else {
+  feeder->Activate(On);
+  if (!On)
      Cancel(-1);
-  }
 }
 
 void cLiveReceiver::Receive(uchar *Data, int Length)
 {
-//  int p = ringBuffer->Put(Data, Length);
-//  if (p != Length && Running())
-//     ringBuffer->ReportOverflow(Length - p); 
-    remux->Put(Data, Length);
+  feeder->Put(Data, Length);
 }
 
 void cLiveReceiver::Action(void)
 {
-  while (Running()) {
-/*        int r;
-        uchar *b = ringBuffer->Get(r);
-        if (b) {
-           int Count = remux->Put(b, r);
-           if (Count)
-              ringBuffer->Del(Count);
-           else*/
-              cCondWait::SleepMs(20);
-//           }
-        }
+  while (Running())
+        cCondWait::SleepMs(20);
 }
 
 // --- cLiveBackTrace --------------------------------------------------------
@@ -1089,7 +1111,7 @@ cLivePlayer::cLivePlayer(cLiveBuffer *LiveBuffer)
 #endif
 {
   liveBuffer = LiveBuffer;
-  ringBuffer = new cRingBufferFrame(PLAYERBUFSIZE);
+  ringBuffer = new cRingBufferFrame(PLAYERBUFSIZE, true, MAXFRAMESIZE);
   readIndex = writeIndex = -1;
   readFrame = playFrame = NULL;
   firstPacket = true;
@@ -1182,8 +1204,8 @@ void cLivePlayer::Action(void)
 
   while (Running()) {
     if (Sleep) {
-      if (WaitingForData)
-         cCondWait::SleepMs(3);
+      if (WaitingForData && liveBuffer->Reading())
+         liveBuffer->WaitForData(100); // returns as soon as the frame has been read from the disk
       else
          cCondWait::SleepMs(3);
       Sleep = false;
@@ -1223,23 +1245,23 @@ void cLivePlayer::Action(void)
            playDir = pdForward;
            continue;
            }
-         int r = liveBuffer->GetFrame(pb, Index);
+         int r = liveBuffer->GetFrame(pb, Index, -1, ringBuffer);
          if (r>0) {
            readIndex = Index;
            WaitingForData = false;
-           readFrame = new cFrame(b, -r, ftUnknown, readIndex);
+           readFrame = new cFrame(b, -r, ftUnknown, readIndex, ringBuffer);
            b = NULL;
            }
          else
            WaitingForData = true;
          }
        else {
-          int r=liveBuffer->GetFrame(pb, readIndex+1, Off);
+          int r=liveBuffer->GetFrame(pb, readIndex+1, Off, ringBuffer);
           if (r>0)
             readIndex++;
           if (r > 0 || r < -10) {
             WaitingForData = false;
-            readFrame = new cFrame(b, -abs(r), ftUnknown, readIndex);
+            readFrame = new cFrame(b, -abs(r), ftUnknown, readIndex, ringBuffer);
             b = NULL;
             if (r<0)
                Off += -r;
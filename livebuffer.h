@@ -16,6 +16,8 @@
 class cUnbufferedFile64 {
 private:
   int fd;
+  dev_t device;
+  cDirectWriter *direct;
   off64_t curpos;
   off64_t cachedstart;
   off64_t cachedend;
@@ -31,6 +33,7 @@ public:
   ~cUnbufferedFile64();
   int Open(const char *FileName, int Flags, mode_t Mode = DEFFILEMODE);
   int Close(void);
+  dev_t Device(void) { return device; }
   off64_t Seek(off64_t Offset, int Whence);
   ssize_t Read(void *Data, size_t Size);
   ssize_t Write(const void *Data, size_t Size);
@@ -103,25 +106,24 @@ public:
   int First(void) { return start > delCount ? start : delCount; }
 };
 
-#ifndef USE_FAIR_MUTEX
-class cLiveFileReader : public cThread {
-#else
-class cLiveFileReader : public cFairMutexThread {
-#endif
+class cLiveFileReader : public cReadRequest {
 private:
   cFileName64 *fileName;
   cUnbufferedFile64 *readFile;
-  cCondWait newSet;
   off64_t filePos;
-  int hasData, length, wanted;
+  int length, wanted;
   uchar *buffer;
+  cRingBufferFrame *pool;
 protected:
-  virtual void Action(void);
+  virtual int DoRead(uchar *Data, int Size);
+  virtual dev_t Device(void) { return readFile ? readFile->Device() : 0; }
 public:
   cLiveFileReader(const char *FileName, int Number);
   ~cLiveFileReader();
-  int Read(uchar **Buffer, off64_t FilePos, int Size);
+  int Read(uchar **Buffer, off64_t FilePos, int Size, cRingBufferFrame *Pool = NULL);
   void Clear(void);
+  bool Reading(void) { return buffer; }
+  bool WaitForDataMs(int msToWait);
 };
 
 #ifndef USE_FAIR_MUTEX
@@ -195,7 +197,10 @@ public:
   cLiveBuffer(const char *FileName, cRemux *Remux);
   virtual ~cLiveBuffer();
   void SetNewRemux(cRemux *Remux, bool Clear = false);
-  int GetFrame(uchar **Buffer, int Number, int Off = -1);
+  int GetFrame(uchar **Buffer, int Number, int Off = -1, cRingBufferFrame *Pool = NULL);
+  bool Reading(void) { return fileReader->Reading(); }
+  bool WaitForData(int TimeoutMs) { return fileReader->WaitForDataMs(TimeoutMs); }
+       ///< Waits until a frame GetFrame() is reading from the disk has arrived.
   int GetNextIFrame(int Index, bool Forward) { return index->GetNextIFrame(Index,Forward); }
   int LastDeleted(void) { return index->DelCount(); }
   int LastIndex(void) { return index->Last(); }
@@ -258,8 +263,8 @@ class cLiveReceiver : public cReceiver, cFairMutexThread {
 friend class cLiveBufferManager;
 friend class cLiveBufferControl;
 private:
-//  cRingBufferLinear *ringBuffer;
   cRemux *remux;
+  cRemuxFeeder *feeder;
   const cChannel *channel;
 protected:
   virtual void Activate(bool On);
@@ -1778,7 +1778,7 @@ void cMenuBouquets::AddFavourite(bool active)
     newChannel->rid = 100;
     Channels.Add(newChannel);
     GetFavourite();
-    Channels.Move(newChannel, Channels.First()->Next());
+    Channels.Move(newChannel, Channels.Next(Channels.First()));
     Channels.ReNumber();
     Channels.SetModified(true);
     SetGroup(0);
@@ -6759,7 +6759,7 @@ cRecordControl::cRecordControl(cDevice *Device, cTimer *Timer, bool Pause)
            return;
            }
      }
-     recorder = new cRecorder(fileName, ch->Ca(), timer->Priority(), ch->Vpid(), ch->Apids(), ch->Dpids(), ch->Spids(), liveBuffer);
+     recorder = new cRecorder(fileName, ch->Ca(), timer->Priority(), ch->Vpid(), ch->Apids(), ch->Dpids(), ch->Spids(), liveBuffer, ch->GetChannelID());
      if (device->AttachReceiver(recorder, true)) {
         time_t start_t=time(0);
         while(recorder->GetRemux()->SFmode()==SF_UNKNOWN && (time(0)-start_t)<=2)
@@ -7348,7 +7348,7 @@ void cReplayControl::EditCut(void)
 {
   if (fileName) {
      Hide();
-     if (!cCutter::Active()) {
+     if (!cCutter::Active(fileName)) {
         if (!marks.Count())
            Skins.Message(mtError, tr("No editing marks defined!"));
         else if (!cCutter::Start(fileName))
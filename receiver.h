@@ -32,7 +32,8 @@ protected:
                ///< It is guaranteed that Receive() will not be called before Activate(true).
   virtual void Receive(uchar *Data, int Length) = 0;
                ///< This function is called from the cDevice we are attached to, and
-               ///< delivers one TS packet from the set of PIDs the cReceiver has requested.
+               ///< delivers one or more TS packets (Length is always a multiple of TS_SIZE)
+               ///< of the same PID from the set of PIDs the cReceiver has requested.
                ///< The data packet must be accepted immediately, and the call must return
                ///< as soon as possible, without any unnecessary delay. Each TS packet
                ///< will be delivered only ONCE, so the cReceiver must make sure that
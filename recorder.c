@@ -11,6 +11,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <unistd.h>
+#include "videodir.h"
 
 #define RECORDERBUFSIZE  MEGABYTE(5)
 
@@ -23,17 +24,337 @@
 
 #define PATPMT_DISTANCE (1*1024*1024)
 
+// The data is written to disk in blocks of this size, by a separate thread,
+// so that a slow disk doesn't hold up the remuxer:
+#define WRITEBLOCKSIZE  MEGABYTE(2)
+#define WRITEBLOCKS     8    // blocks of buffering between the remuxer and the disk
+#define MAXWRITEDELAY   1000 // ms a partially filled block may wait before being written
+#define WRITEALIGNMENT  4096
+
+// --- cAsyncWriter ----------------------------------------------------------
+
+struct tWriteIndex {
+  int offset; // relative to the beginning of the block (or the file, if held)
+  uchar pictureType;
+  };
+
+struct tWriteBlock {
+  uchar *data;
+  int size;
+  bool newFile; // the block goes to the next file
+  tWriteIndex *index;
+  int numIndex, maxIndex;
+  };
+
+class cAsyncWriter : public cThread {
+private:
+  cFileName *fileName;
+  cUnbufferedFile *recordFile;
+  cIndexFile *index;
+  tWriteBlock blocks[WRITEBLOCKS];
+  int fill;  // the block currently being filled by Put()
+  int first; // the oldest block waiting to be written
+  int queued;
+  cTimeMs fillTime;
+  cMutex mutex; // protects all of the above, as well as 'error' and 'lowDiskSpace'
+  cCondVar blockQueued;
+  cCondVar blockWritten;
+  bool error;
+  bool lowDiskSpace;
+  bool done; // Action() has written everything and returns
+  int fileSize;
+  tWriteIndex *held; // index entries of frames that aren't completely in the file yet
+  int numHeld, maxHeld;
+  time_t lastDiskSpaceCheck;
+  void QueueBlock(void);
+  bool Queue(void);
+  bool WriteBlock(tWriteBlock *Block);
+  void PublishIndex(int InFile);
+  void CheckDiskSpace(void);
+protected:
+  virtual void Action(void);
+public:
+  cAsyncWriter(cFileName *FileName, cUnbufferedFile *RecordFile, cIndexFile *Index);
+  virtual ~cAsyncWriter();
+  bool Put(const uchar *Data, int Count);
+       ///< Copies Count bytes of Data into the current block. Waits for the
+       ///< writer thread if all blocks are in use.
+       ///< \return Returns false if writing has failed.
+  void AddIndex(uchar PictureType);
+       ///< Adds an index entry for the data given to the next call to Put().
+  void NextFile(void);
+       ///< All further data goes to the next file of the recording.
+  bool LowDiskSpace(void);
+       ///< Returns true once after each disk space check that found less
+       ///< than MINFREEDISKSPACE.
+  bool Error(void) { cMutexLock MutexLock(&mutex); return error; }
+  };
+
+cAsyncWriter::cAsyncWriter(cFileName *FileName, cUnbufferedFile *RecordFile, cIndexFile *Index)
+:cThread("async writer")
+{
+  fileName = FileName;
+  recordFile = RecordFile;
+  index = Index;
+  error = false;
+  for (int i = 0; i < WRITEBLOCKS; i++) {
+      tWriteBlock *b = &blocks[i];
+      // aligned, so that the blocks could also be written with O_DIRECT:
+      if (posix_memalign((void **)&b->data, WRITEALIGNMENT, WRITEBLOCKSIZE)) {
+         esyslog("ERROR: can't allocate write buffer");
+         b->data = NULL;
+         error = true;
+         }
+      b->size = 0;
+      b->newFile = false;
+      b->index = NULL;
+      b->numIndex = b->maxIndex = 0;
+      }
+  fill = first = queued = 0;
+  lowDiskSpace = false;
+  done = false;
+  fileSize = 0;
+  held = NULL;
+  numHeld = maxHeld = 0;
+  lastDiskSpaceCheck = time(NULL);
+  Start();
+}
+
+cAsyncWriter::~cAsyncWriter()
+{
+  // Write what's left and wait until everything is on disk, no matter how
+  // long a slow disk takes, so that the recording and its index are complete:
+  {
+    cMutexLock MutexLock(&mutex);
+    if (!Queue() && blocks[fill].size)
+       esyslog("ERROR: last %d bytes of recording not written", blocks[fill].size);
+    Cancel(-1);
+    blockQueued.Broadcast();
+    for (int i = 0; !done && Active(); i++) {
+        if (i == 10)
+           dsyslog("waiting for %d blocks of recording to be written", queued);
+        blockWritten.TimedWait(mutex, 1000);
+        }
+  }
+  while (Active())
+        cCondWait::SleepMs(10);
+  for (int i = 0; i < WRITEBLOCKS; i++) {
+      free(blocks[i].data);
+      free(blocks[i].index);
+      }
+  free(held);
+}
+
+// Must be called with mutex locked, and with less than WRITEBLOCKS - 1 blocks queued
+void cAsyncWriter::QueueBlock(void)
+{
+  queued++;
+  fill = (fill + 1) % WRITEBLOCKS;
+  tWriteBlock *b = &blocks[fill];
+  b->size = 0;
+  b->newFile = false;
+  b->numIndex = 0;
+  blockQueued.Broadcast();
+}
+
+// Must be called with mutex locked
+bool cAsyncWriter::Queue(void)
+{
+  for (;;) {
+      tWriteBlock *b = &blocks[fill];
+      if (!b->size && !b->numIndex)
+         return !error; // nothing to do, or the writer thread has been faster
+      if (queued < WRITEBLOCKS - 1)
+         break;
+      if (error || !Active())
+         return false;
+      blockWritten.TimedWait(mutex, 100);
+      }
+  QueueBlock();
+  return !error;
+}
+
+bool cAsyncWriter::Put(const uchar *Data, int Count)
+{
+  cMutexLock MutexLock(&mutex);
+  while (Count > 0 && !error) {
+        tWriteBlock *b = &blocks[fill];
+        if (!b->size)
+           fillTime.Set();
+        else if (b->size == WRITEBLOCKSIZE) {
+           if (!Queue())
+              break;
+           continue;
+           }
+        int n = min(Count, WRITEBLOCKSIZE - b->size);
+        memcpy(b->data + b->size, Data, n);
+        b->size += n;
+        Data += n;
+        Count -= n;
+        }
+  return !error;
+}
+
+void cAsyncWriter::AddIndex(uchar PictureType)
+{
+  cMutexLock MutexLock(&mutex);
+  tWriteBlock *b = &blocks[fill];
+  if (b->numIndex >= b->maxIndex) {
+     int NewMax = b->maxIndex ? b->maxIndex * 2 : 256;
+     tWriteIndex *p = (tWriteIndex *)realloc(b->index, NewMax * sizeof(tWriteIndex));
+     if (!p) {
+        esyslog("ERROR: can't allocate index buffer");
+        return;
+        }
+     b->index = p;
+     b->maxIndex = NewMax;
+     }
+  b->index[b->numIndex].offset = b->size;
+  b->index[b->numIndex].pictureType = PictureType;
+  b->numIndex++;
+}
+
+void cAsyncWriter::NextFile(void)
+{
+  cMutexLock MutexLock(&mutex);
+  Queue();
+  blocks[fill].newFile = true;
+}
+
+bool cAsyncWriter::LowDiskSpace(void)
+{
+  cMutexLock MutexLock(&mutex);
+  if (lowDiskSpace) {
+     lowDiskSpace = false;
+     return true;
+     }
+  return false;
+}
+
+void cAsyncWriter::CheckDiskSpace(void)
+{
+  if (time(NULL) > lastDiskSpaceCheck + DISKCHECKINTERVAL) {
+     int Free = FreeDiskSpaceMB(fileName->Name());
+     lastDiskSpaceCheck = time(NULL);
+     if (Free < MINFREEDISKSPACE) {
+        dsyslog("low disk space (%d MB, limit is %d MB)", Free, MINFREEDISKSPACE);
+        cMutexLock MutexLock(&mutex);
+        lowDiskSpace = true;
+        }
+     }
+}
+
+void cAsyncWriter::PublishIndex(int InFile)
+{
+  // An entry makes the frame in front of it readable, so it is only added
+  // once the data up to its offset is in the file:
+  int n = 0;
+  while (n < numHeld && held[n].offset <= InFile) {
+        index->Add(held[n].pictureType, fileName->Number(), held[n].offset);
+        n++;
+        }
+  if (n) {
+     numHeld -= n;
+     memmove(held, held + n, numHeld * sizeof(tWriteIndex));
+     index->Flush();
+     }
+}
+
+bool cAsyncWriter::WriteBlock(tWriteBlock *Block)
+{
+  if (Block->newFile) {
+     if (recordFile && !recordFile->Flush())
+        LOG_ERROR_STR(fileName->Name());
+     if (index)
+        PublishIndex(fileSize);
+     recordFile = fileName->NextFile();
+     fileSize = 0;
+     }
+  if (!recordFile)
+     return false;
+  if (Block->size && recordFile->WriteBlock(Block->data, Block->size) < 0) {
+     LOG_ERROR_STR(fileName->Name());
+     return false;
+     }
+  // The index is written after the data, so it never points beyond what's in
+  // the file. The last partial page of a direct write isn't in the file until
+  // the next block (see cDirectWriter), so the entries behind it are held back:
+  if (index) {
+     if (numHeld + Block->numIndex > maxHeld) {
+        int NewMax = max(maxHeld * 2, numHeld + Block->numIndex);
+        tWriteIndex *p = (tWriteIndex *)realloc(held, NewMax * sizeof(tWriteIndex));
+        if (!p) {
+           esyslog("ERROR: out of memory for held index entries");
+           return false;
+           }
+        held = p;
+        maxHeld = NewMax;
+        }
+     for (int i = 0; i < Block->numIndex; i++) {
+         held[numHeld].offset = fileSize + Block->index[i].offset;
+         held[numHeld].pictureType = Block->index[i].pictureType;
+         numHeld++;
+         }
+     PublishIndex(fileSize + Block->size - recordFile->Pending());
+     }
+  fileSize += Block->size;
+  return true;
+}
+
+void cAsyncWriter::Action(void)
+{
+  SetThreadClass(tcFileWriter);
+  int Dropped = 0;
+  for (;;) {
+      tWriteBlock *b = NULL;
+      {
+        cMutexLock MutexLock(&mutex);
+        while (!queued && Running()) {
+              blockQueued.TimedWait(mutex, 100);
+              // Data that has been waiting too long is written even if the
+              // stream has stopped:
+              if (!queued && blocks[fill].size && fillTime.Elapsed() > MAXWRITEDELAY)
+                 QueueBlock();
+              }
+        if (!queued)
+           break;
+        b = &blocks[first];
+      }
+      // Only this thread sets 'error', so it can be read without locking here:
+      if (error)
+         Dropped++;
+      else if (!WriteBlock(b)) {
+         Dropped++;
+         cMutexLock MutexLock(&mutex);
+         error = true;
+         }
+      CheckDiskSpace();
+      cMutexLock MutexLock(&mutex);
+      first = (first + 1) % WRITEBLOCKS;
+      queued--;
+      blockWritten.Broadcast();
+      }
+  if (Dropped)
+     esyslog("ERROR: %d blocks of %s not written due to a write error", Dropped, fileName->Name());
+  if (numHeld && recordFile && recordFile->Flush())
+     PublishIndex(fileSize);
+  cMutexLock MutexLock(&mutex);
+  done = true;
+  blockWritten.Broadcast();
+}
+
+// --- cFileWriter -----------------------------------------------------------
+
 class cFileWriter : public cThread {
 private:
   cRemux *remux;
   cFileName *fileName;
+  dev_t device;
   cIndexFile *index;
+  cAsyncWriter *writer;
   uchar pictureType;
   int fileSize;
   int diffSize;
-  cUnbufferedFile *recordFile;
-  time_t lastDiskSpaceCheck;
-  bool RunningLowOnDiskSpace(void);
   bool NextFile(void);
 protected:
   virtual void Action(void);
@@ -48,50 +369,42 @@ cFileWriter::cFileWriter(const char *FileName, cRemux *Remux)
   fileName = NULL;
   remux = Remux;
   index = NULL;
+  writer = NULL;
   pictureType = NO_PICTURE;
   fileSize = 0;
   diffSize = 0;
-  lastDiskSpaceCheck = time(NULL);
   fileName = new cFileName(FileName, true);
-  recordFile = fileName->Open();
+  cUnbufferedFile *recordFile = fileName->Open();
+  device = recordFile ? VideoFileDevice(FileName) : 0;
   if (!recordFile)
      return;
+  SetVideoDiskBusy(device, true);
   // Create the index file:
   index = new cIndexFile(FileName, true);
   if (!index)
      esyslog("ERROR: can't allocate index");
      // let's continue without index, so we'll at least have the recording
+  writer = new cAsyncWriter(fileName, recordFile, index);
 }
 
 cFileWriter::~cFileWriter()
 {
   Cancel(3);
+  delete writer;
   delete index;
   delete fileName;
-}
-
-bool cFileWriter::RunningLowOnDiskSpace(void)
-{
-  if (time(NULL) > lastDiskSpaceCheck + DISKCHECKINTERVAL) {
-     int Free = FreeDiskSpaceMB(fileName->Name());
-     lastDiskSpaceCheck = time(NULL);
-     if (Free < MINFREEDISKSPACE) {
-        dsyslog("low disk space (%d MB, limit is %d MB)", Free, MINFREEDISKSPACE);
-        return true;
-        }
-     }
-  return false;
+  SetVideoDiskBusy(device, false);
 }
 
 bool cFileWriter::NextFile(void)
 {
-  if (recordFile && pictureType == I_FRAME) { // every file shall start with an I_FRAME
-     if (fileSize > MEGABYTE(Setup.MaxVideoFileSize) || RunningLowOnDiskSpace()) {
-        recordFile = fileName->NextFile();
+  if (writer && pictureType == I_FRAME) { // every file shall start with an I_FRAME
+     if (fileSize > MEGABYTE(Setup.MaxVideoFileSize) || writer->LowDiskSpace()) {
+        writer->NextFile();
         fileSize = 0;
         }
      }
-  return recordFile != NULL;
+  return writer && !writer->Error();
 }
 
 void cFileWriter::Action(void)
@@ -99,6 +412,7 @@ void cFileWriter::Action(void)
   time_t t = time(NULL);
   unsigned int skipped = 0;
 
+  SetThreadClass(tcRemux);
   while (Running()) {
         int Count;
         uchar *p = remux->Get(Count, &pictureType, 1);
@@ -121,21 +435,17 @@ void cFileWriter::Action(void)
 		      int plen;
 		      plen=remux->GetPATPMT(patpmt, 2*188);
 		      if (plen) {
-			      if (recordFile->Write(patpmt, plen) < 0) {
-				      LOG_ERROR_STR(fileName->Name());
+			      if (!writer->Put(patpmt, plen))
 				      break;
-			      }
 			      fileSize+=plen;
 		      }
 		      diffSize=0;
 	      }
 #endif
               if (index && pictureType != NO_PICTURE)
-                 index->Write(pictureType, fileName->Number(), fileSize);
-              if (recordFile->Write(p, Count) < 0) {
-                 LOG_ERROR_STR(fileName->Name());
+                 writer->AddIndex(pictureType);
+              if (!writer->Put(p, Count))
                  break;
-                 }
               fileSize += Count;
               diffSize += Count;
               remux->Del(Count);
@@ -155,18 +465,15 @@ void cFileWriter::Action(void)
 
 // ---
 
-cRecorder::cRecorder(const char *FileName, int Ca, int Priority, int VPid, const int *APids, const int *DPids, const int *SPids, cLiveBuffer *LiveBuffer)
+cRecorder::cRecorder(const char *FileName, int Ca, int Priority, int VPid, const int *APids, const int *DPids, const int *SPids, cLiveBuffer *LiveBuffer, tChannelID ChannelID)
 :cReceiver(Ca, Priority, VPid, APids, Setup.UseDolbyInRecordings ? DPids : NULL, SPids)
 ,cThread("recording")
 {
   // Make sure the disk is up and running:
 
   SpinUpDisk(FileName);
-#if 0
-  ringBuffer = new cRingBufferLinear(RECORDERBUFSIZE, TS_SIZE * 2, true, "Recorder");
-  ringBuffer->SetTimeouts(0, 100);
-#endif
-  remux = new cRemux(VPid, APids, Setup.UseDolbyInRecordings ? DPids : NULL, SPids, true);
+  remux = cRemux::Acquire(ChannelID, VPid, APids, Setup.UseDolbyInRecordings ? DPids : NULL, SPids, true);
+  feeder = new cRemuxFeeder(remux, RECORDERBUFSIZE, "recorder remux");
   fileName = strdup(FileName);
   writer = NULL;
   liveBuffer = LiveBuffer;
@@ -177,38 +484,35 @@ cRecorder::cRecorder(const char *FileName, int Ca, int Priority, int VPid, const
 cRecorder::~cRecorder()
 {
   Detach();
+  delete feeder;
   delete writer;
   delete remux;
-//  delete ringBuffer;
   free(fileName);
 }
 
 void cRecorder::Activate(bool On)
 {
   if (On) {
+     feeder->Activate(true);
      if (writer)
        writer->Start();
      Start();
      }
-  else
+  else {
+     feeder->Activate(false);
      Cancel(3);
+     }
 }
 
 void cRecorder::Receive(uchar *Data, int Length)
 {
-  if (Running()) {
-#if 0
-     int p = ringBuffer->Put(Data, Length);
-     if (p != Length && Running())
-        ringBuffer->ReportOverflow(Length - p);
-#else
-     remux->Put(Data, Length);
-#endif
-     }
+  if (Running())
+     feeder->Put(Data, Length);
 }
 
 void cRecorder::Action(void)
 {
+  SetThreadClass(tcRemux);
   while (Running()) {
            if (!writer && liveBuffer) {
               int c;
@@ -238,17 +542,6 @@ void cRecorder::Action(void)
         }
         continue;
         }
-#if 0
-        int r;
-        uchar *b = ringBuffer->Get(r);
-        if (b) {
-           int Count = remux->Put(b, r);
-           if (Count)
-              ringBuffer->Del(Count);
-           else
-              cCondWait::SleepMs(100); // avoid busy loop when resultBuffer is full in cRemux::Put()
-           }
-#endif
         usleep(100*1000); // FIXME
         }
 }
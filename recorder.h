@@ -39,8 +39,8 @@ public:
 
 class cRecorder : public cReceiver, cThread {
 private:
-  cRingBufferLinear *ringBuffer;
   cRemux *remux;
+  cRemuxFeeder *feeder;
   cFileWriter *writer;
   char *fileName;
   cLiveBuffer *liveBuffer;
@@ -49,7 +49,9 @@ protected:
   virtual void Receive(uchar *Data, int Length);
   virtual void Action(void);
 public:
-  cRecorder(const char *FileName, int Ca, int Priority, int VPid, const int *APids, const int *DPids, const int *SPids, cLiveBuffer *LiveBuffer = NULL);
+  cRecorder(const char *FileName, int Ca, int Priority, int VPid, const int *APids, const int *DPids, const int *SPids, cLiveBuffer *LiveBuffer = NULL, tChannelID ChannelID = tChannelID::InvalidID);
+       ///< If ChannelID is given, the remuxer is shared with other consumers of
+       ///< the same channel and PIDs (see cRemux::Acquire()).
   virtual ~cRecorder();
   cRemux* GetRemux(void) {return remux;}
   };
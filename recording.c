@@ -13,6 +13,9 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "channels.h"
@@ -80,7 +83,7 @@ cRemoveDeletedRecordingsThread::cRemoveDeletedRecordingsThread(void)
 
 void cRemoveDeletedRecordingsThread::Action(void)
 {
-  SetPriority(18); // TB: unimportant thread
+  SetThreadClass(tcBackground); // TB: unimportant thread
   // Make sure only one instance of VDR does this:
   cLockFile LockFile(VideoDirectory);
   if (LockFile.Lock()) {
@@ -521,6 +524,8 @@ cRecording::cRecording(cTimer *Timer, const cEvent *Event)
   name = NULL;
   fileSizeMB = -1; // unknown
   deleted = 0;
+  infoTime = 0;
+  seen = false;
   // set up the actual name:
   const char *Title = Event ? Event->Title() : NULL;
   const char *Subtitle = Event ? Event->ShortText() : NULL;
@@ -567,11 +572,13 @@ cRecording::cRecording(cTimer *Timer, const cEvent *Event)
   info->SetAux(Timer->Aux());
 }
 
-cRecording::cRecording(const char *FileName)
+cRecording::cRecording(const char *FileName, FILE *InfoFile)
 {
   resume = RESUME_NOT_INITIALIZED;
   fileSizeMB = -1; // unknown
   deleted = 0;
+  infoTime = 0;
+  seen = false;
   titleBuffer = NULL;
   sortBuffer = NULL;
   fileName = strdup(FileName);
@@ -595,10 +602,16 @@ cRecording::cRecording(const char *FileName)
         name[p - FileName] = 0;
         name = ExchangeChars(name, false);
         }
+     if (InfoFile) {
+        if (!info->Read(InfoFile))
+           esyslog("ERROR: EPG data problem in catalog entry for %s", fileName);
+        return;
+        }
      GetResume();
      // read an optional info file:
      char *InfoFileName = NULL;
      asprintf(&InfoFileName, "%s%s", fileName, INFOFILESUFFIX);
+     infoTime = LastModifiedTime(InfoFileName); // before reading, so that a later change is noticed
      FILE *f = fopen(InfoFileName, "r");
      if (f) {
         if (!info->Read(f))
@@ -951,6 +964,163 @@ void cRecording::ResetResume(void) const
   resume = RESUME_NOT_INITIALIZED;
 }
 
+// --- cScannedRecording -----------------------------------------------------
+
+class cScannedRecording : public cListObject {
+public:
+  char *fileName;
+  time_t infoTime;
+  cScannedRecording(const char *FileName);
+  ~cScannedRecording();
+  };
+
+cScannedRecording::cScannedRecording(const char *FileName)
+{
+  fileName = strdup(FileName);
+  infoTime = LastModifiedTime(cString::sprintf("%s%s", FileName, INFOFILESUFFIX));
+}
+
+cScannedRecording::~cScannedRecording()
+{
+  free(fileName);
+}
+
+static unsigned int FileNameHash(const char *FileName)
+{
+  unsigned int Hash = 2166136261U; // FNV-1a
+  while (*FileName)
+        Hash = (Hash ^ (unsigned char)*FileName++) * 16777619U;
+  return Hash;
+}
+
+// --- cScanWorker -----------------------------------------------------------
+
+#ifdef RBLITE
+#define MAXSCANWORKERS 2
+#else
+#define MAXSCANWORKERS 4 // the video directory may span several disks, each gets its own worker (up to this many)
+#endif
+
+class cScanRoot : public cListObject {
+public:
+  char *dirName;
+  cScanRoot(const char *DirName) { dirName = strdup(DirName); }
+  ~cScanRoot() { free(dirName); }
+  };
+
+class cScanWorker : public cThread {
+private:
+  cRecordings *recordings;
+  bool foreground;
+  bool loading;
+  bool complete;
+protected:
+  virtual void Action(void);
+public:
+  dev_t device;
+  cList<cScanRoot> roots;
+  cList<cScannedRecording> found;
+  cList<cRecording> loaded;
+  cScanWorker(cRecordings *Recordings, dev_t Device, bool Foreground);
+  virtual ~cScanWorker();
+  void Run(bool Loading, bool Wait);
+       ///< Walks the roots if Loading is false, otherwise reads the found
+       ///< recordings. If Wait is true, this is done in the calling thread.
+  bool Complete(void) { return complete; }
+  };
+
+cScanWorker::cScanWorker(cRecordings *Recordings, dev_t Device, bool Foreground)
+:cThread("video directory scan worker")
+{
+  recordings = Recordings;
+  device = Device;
+  foreground = Foreground;
+  loading = false;
+  complete = false;
+}
+
+cScanWorker::~cScanWorker()
+{
+  Cancel(3);
+}
+
+void cScanWorker::Run(bool Loading, bool Wait)
+{
+  loading = Loading;
+  complete = false;
+  if (Wait)
+     Action();
+  else
+     Start();
+}
+
+void cScanWorker::Action(void)
+{
+  if (!foreground)
+     SetThreadClass(tcBackground);
+  if (!loading) {
+     for (cScanRoot *r = roots.First(); r; r = roots.Next(r)) {
+         if (!recordings->ScanVideoDir(r->dirName, &found, foreground))
+            return;
+         }
+     }
+  else {
+     for (cScannedRecording *s = found.First(); s; s = found.Next(s)) {
+         if (!foreground && !recordings->Running())
+            return;
+         cRecording *r = new cRecording(s->fileName);
+         if (r->Name()) {
+            if (recordings->deleted) {
+               r->fileSizeMB = DirSizeMB(s->fileName);
+               r->deleted = time(NULL);
+               }
+            loaded.Add(r);
+            }
+         else
+            delete r;
+         }
+     }
+  complete = true;
+}
+
+static cScanWorker *GetScanWorker(cScanWorker **Workers, int &NumWorkers, cRecordings *Recordings, dev_t Device, bool Foreground)
+{
+  cScanWorker *w = NULL;
+  for (int i = 0; i < NumWorkers; i++) {
+      if (Workers[i]->device == Device)
+         return Workers[i];
+      if (!w || Workers[i]->roots.Count() < w->roots.Count())
+         w = Workers[i];
+      }
+  if (NumWorkers < MAXSCANWORKERS)
+     return Workers[NumWorkers++] = new cScanWorker(Recordings, Device, Foreground);
+  return w; // more disks than workers, so the least busy one takes this one, too
+}
+
+static bool RunScanWorkers(cScanWorker **Workers, int NumWorkers, bool Loading)
+{
+  for (int i = 0; i < NumWorkers; i++)
+      Workers[i]->Run(Loading, NumWorkers == 1);
+  bool Complete = true;
+  for (int i = 0; i < NumWorkers; i++) {
+      while (Workers[i]->Active())
+            cCondWait::SleepMs(10);
+      Complete &= Workers[i]->Complete();
+      }
+  return Complete;
+}
+
+static cRecording *FindRecording(cHash<cRecording> &Known, const char *FileName)
+{
+  cList<cHashObject> *List = Known.GetList(FileNameHash(FileName));
+  for (cHashObject *h = List ? List->First() : NULL; h; h = List->Next(h)) {
+      cRecording *r = (cRecording *)h->Object();
+      if (strcmp(r->FileName(), FileName) == 0)
+         return r;
+      }
+  return NULL;
+}
+
 // --- cRecordings -----------------------------------------------------------
 bool volatile cRecordings::DVDPlayerActive = false;
 
@@ -958,22 +1128,67 @@ cRecordings Recordings;
 
 char *cRecordings::updateFileName = NULL;
 
+#define CATALOGFILE     ".catalog"
+#define DELCATALOGFILE  ".catalog-del"
+#define CATALOGMAGIC    "VDR recordings catalog 1\n"
+
+#define INOTIFYMASK   (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#define RECORDINGMASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) // for the info file of a recording
+#define RESCANINTERVAL 900 // seconds, for changes inotify doesn't see (e.g. made by other hosts on NFS)
+
+struct tCatalogEntry {
+  int32_t fileNameLength;
+  int32_t infoLength;
+  int32_t fileSizeMB;
+  int32_t reserved;
+  int64_t infoTime;
+  };
+
 cRecordings::cRecordings(bool Deleted)
 :cThread("video directory scanner")
 {
+  catalogFileName = NULL;
   deleted = Deleted;
   lastUpdate = 0;
   state = 0;
+  changed = false;
+  watchFailed = false;
+  scanned = false;
+  catalogLoaded = false;
+  catalogDirty = false;
+  saveOnly = false;
+  inotifyFd = -1;
+  if (!deleted) {
+     // deleted recordings live in the same directories, so one set of watches is enough
+     inotifyFd = inotify_init();
+     if (inotifyFd >= 0) {
+        fcntl(inotifyFd, F_SETFL, fcntl(inotifyFd, F_GETFL) | O_NONBLOCK);
+        fcntl(inotifyFd, F_SETFD, FD_CLOEXEC);
+        }
+     else
+        LOG_ERROR;
+     }
 }
 
 cRecordings::~cRecordings()
 {
   Cancel(100); // avoid crash at shutdown 
+  if (inotifyFd >= 0)
+     close(inotifyFd);
+  free(catalogFileName);
 }
 
 void cRecordings::Action(void)
 {
-  Refresh();
+  SetThreadClass(tcBackground);
+  Lock();
+  bool SaveOnly = saveOnly;
+  saveOnly = false;
+  Unlock();
+  if (SaveOnly)
+     SaveCatalog();
+  else
+     Refresh();
 }
 
 const char *cRecordings::UpdateFileName(void)
@@ -983,33 +1198,287 @@ const char *cRecordings::UpdateFileName(void)
   return updateFileName;
 }
 
+const char *cRecordings::CatalogFileName(void)
+{
+  if (!catalogFileName)
+     catalogFileName = strdup(AddDirectory(VideoDirectory, deleted ? DELCATALOGFILE : CATALOGFILE));
+  return catalogFileName;
+}
+
+void cRecordings::LoadCatalog(void)
+{
+  int f = open(CatalogFileName(), O_RDONLY);
+  if (f < 0) {
+     if (errno != ENOENT)
+        LOG_ERROR_STR(CatalogFileName());
+     return;
+     }
+  char *Buffer = NULL;
+  ssize_t Size = 0;
+  struct stat st;
+  if (fstat(f, &st) == 0 && (Buffer = MALLOC(char, st.st_size)) != NULL)
+     Size = safe_read(f, Buffer, st.st_size);
+  close(f);
+  int n = 0;
+  int MagicLength = strlen(CATALOGMAGIC);
+  if (Buffer && Size > MagicLength && strncmp(Buffer, CATALOGMAGIC, MagicLength) == 0) {
+     char *p = Buffer + MagicLength;
+     char *End = Buffer + Size;
+     while (p + sizeof(tCatalogEntry) <= End) {
+           tCatalogEntry e;
+           memcpy(&e, p, sizeof(e));
+           p += sizeof(e);
+           if (e.fileNameLength <= 0 || e.infoLength <= 0 || End - p < e.fileNameLength + e.infoLength) {
+              esyslog("ERROR: recordings catalog %s is corrupted", CatalogFileName());
+              break;
+              }
+           char *FileName = strndup(p, e.fileNameLength);
+           p += e.fileNameLength;
+           FILE *InfoFile = fmemopen(p, e.infoLength, "r");
+           p += e.infoLength;
+           if (!InfoFile) {
+              LOG_ERROR;
+              free(FileName);
+              break;
+              }
+           cRecording *r = new cRecording(FileName, InfoFile);
+           fclose(InfoFile);
+           free(FileName);
+           if (r->Name()) {
+              r->infoTime = e.infoTime;
+              r->fileSizeMB = e.fileSizeMB;
+              if (deleted)
+                 r->deleted = time(NULL);
+              Lock();
+              Add(r);
+              Unlock();
+              n++;
+              }
+           else
+              delete r;
+           }
+     }
+  else if (Size)
+     esyslog("ERROR: %s is not a recordings catalog", CatalogFileName());
+  free(Buffer);
+  if (n) {
+     Lock();
+     ChangeState();
+     Unlock();
+     dsyslog("loaded %d recordings from %s", n, CatalogFileName());
+     }
+}
+
+bool cRecordings::SaveCatalog(void)
+{
+  cMutexLock MutexLock(&catalogMutex); // a foreground Refresh() may save it at the same time
+  char *Buffer = NULL;
+  size_t Size = 0;
+  FILE *m = open_memstream(&Buffer, &Size);
+  if (!m) {
+     LOG_ERROR;
+     return false;
+     }
+  fputs(CATALOGMAGIC, m);
+  Lock();
+  for (cRecording *r = First(); r; r = Next(r)) {
+      char *Info = NULL;
+      size_t InfoLength = 0;
+      FILE *i = open_memstream(&Info, &InfoLength);
+      if (i) {
+         r->info->Write(i);
+         fclose(i);
+         if (InfoLength) {
+            tCatalogEntry e = { int32_t(strlen(r->FileName())), int32_t(InfoLength), r->fileSizeMB, 0, r->infoTime };
+            fwrite(&e, sizeof(e), 1, m);
+            fwrite(r->FileName(), e.fileNameLength, 1, m);
+            fwrite(Info, InfoLength, 1, m);
+            }
+         free(Info);
+         }
+      }
+  catalogDirty = false;
+  Unlock();
+  bool result = false;
+  if (fclose(m) == 0) {
+     cSafeFile f(CatalogFileName());
+     if (f.Open()) {
+        if (fwrite(Buffer, Size, 1, f) != 1)
+           LOG_ERROR_STR(CatalogFileName());
+        result = f.Close();
+        }
+     }
+  else
+     LOG_ERROR;
+  free(Buffer);
+  if (!result) {
+     Lock();
+     catalogDirty = true;
+     Unlock();
+     }
+  return result;
+}
+
+void cRecordings::Watch(const char *DirName, bool Recording)
+{
+  if (inotifyFd >= 0 && inotify_add_watch(inotifyFd, DirName, Recording ? RECORDINGMASK : INOTIFYMASK) < 0) {
+     Lock();
+     if (!watchFailed)
+        LOG_ERROR_STR(DirName);
+     watchFailed = true;
+     Unlock();
+     }
+}
+
 void cRecordings::Refresh(bool Foreground)
 {
-  lastUpdate = time(NULL); // doing this first to make sure we don't miss anything
   Lock();
-  Clear();
-  ChangeState();
+  lastUpdate = time(NULL); // doing this first to make sure we don't miss anything
+  changed = false;
+  watchFailed = false;
+  bool LoadFromCatalog = !catalogLoaded;
+  catalogLoaded = true;
   Unlock();
-  ScanVideoDir(VideoDirectory, Foreground);
+  if (LoadFromCatalog)
+     LoadCatalog();
+  cScanWorker *Workers[MAXSCANWORKERS];
+  int NumWorkers = 0;
+  // without a complete scan we can't tell which recordings are gone:
+  bool Complete = ScanRoots(Workers, NumWorkers, Foreground) && RunScanWorkers(Workers, NumWorkers, false);
+  if (Complete) {
+     // Drop the recordings that are gone and those that are unchanged from
+     // the found ones, so that only new and modified ones remain:
+     int Modified = 0;
+     Lock();
+     {
+       cHash<cRecording> Known(max(Count(), HASHSIZE));
+       for (cRecording *r = First(); r; r = Next(r)) {
+           r->seen = false;
+           Known.Add(r, FileNameHash(r->FileName()));
+           }
+       for (int i = 0; i < NumWorkers; i++) {
+           cList<cScannedRecording> &Found = Workers[i]->found;
+           for (cScannedRecording *s = Found.First(); s; ) {
+               cScannedRecording *next = Found.Next(s);
+               cRecording *r = FindRecording(Known, s->fileName);
+               if (r) {
+                  r->seen = true; // a modified one is replaced below
+                  if (r->infoTime == s->infoTime)
+                     Found.Del(s);
+                  }
+               s = next;
+               }
+           Modified += Found.Count();
+           }
+     }
+     bool Removed = false;
+     for (cRecording *r = First(); r; ) {
+         cRecording *next = Next(r);
+         if (!r->seen) {
+            Del(r);
+            Removed = true;
+            }
+         r = next;
+         }
+     if (Removed) {
+        ChangeState();
+        catalogDirty = true;
+        }
+     Unlock();
+     // Read the new and modified recordings and merge them in one go:
+     if (Modified && RunScanWorkers(Workers, NumWorkers, true)) {
+        Lock();
+        {
+          cHash<cRecording> Known(max(Count(), HASHSIZE));
+          for (cRecording *r = First(); r; r = Next(r))
+              Known.Add(r, FileNameHash(r->FileName()));
+          for (int i = 0; i < NumWorkers; i++) {
+              cList<cRecording> &Loaded = Workers[i]->loaded;
+              while (cRecording *r = Loaded.First()) {
+                    Loaded.Del(r, false);
+                    cRecording *old = FindRecording(Known, r->FileName());
+                    if (old) {
+                       if (deleted)
+                          r->deleted = old->deleted;
+                       Known.Del(old, FileNameHash(old->FileName()));
+                       Del(old);
+                       }
+                    Add(r);
+                    }
+              }
+        }
+        ChangeState();
+        catalogDirty = true;
+        Unlock();
+        }
+     else if (Modified)
+        Complete = false;
+     }
+  for (int i = 0; i < NumWorkers; i++)
+      delete Workers[i];
+  if (Complete) {
+     Lock();
+     scanned = true;
+     bool Save = catalogDirty;
+     Unlock();
+     if (Save)
+        SaveCatalog();
+     }
 }
 
-void cRecordings::ScanVideoDir(const char *DirName, bool Foreground, int LinkLevel)
+bool cRecordings::ScanRoots(cScanWorker **Workers, int &NumWorkers, bool Foreground)
 {
-#ifdef RBLITE
-  SetPriority(17); // TB: unimportant thread
-#else
-  SetPriority(1); // TB: unimportant thread
-#endif
+  if (DVDPlayerActive)
+      return false;
 
+  Watch(VideoDirectory, false);
+  struct stat st;
+  if (stat(VideoDirectory, &st) != 0) {
+     LOG_ERROR_STR(VideoDirectory);
+     return false;
+     }
+  // the top level directories are distributed among the workers by the disk they are on:
+  GetScanWorker(Workers, NumWorkers, this, st.st_dev, Foreground);
+  cReadDir d(VideoDirectory);
+  struct dirent *e;
+  while ((Foreground || Running()) && (e = d.Next()) != NULL) {
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..") && (e->d_type == DT_DIR || e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)) {
+           cString DirName = cString::sprintf("%s/%s", VideoDirectory, e->d_name);
+           if (stat(DirName, &st) == 0 && S_ISDIR(st.st_mode)) {
+              cScanWorker *w = GetScanWorker(Workers, NumWorkers, this, st.st_dev, Foreground);
+              if (endswith(DirName, deleted ? DELEXT : RECEXT)) {
+                 Watch(DirName, true);
+                 w->found.Add(new cScannedRecording(DirName));
+                 }
+              else
+                 w->roots.Add(new cScanRoot(DirName));
+              }
+           }
+        }
+  return Foreground || Running();
+}
+
+bool cRecordings::ScanVideoDir(const char *DirName, cList<cScannedRecording> *Found, bool Foreground, int LinkLevel)
+{
   if (DVDPlayerActive)
-      return;
+      return false;
 
+  // watch the directory before reading it, so that nothing created in between is missed:
+  Watch(DirName, false);
   cReadDir d(DirName);
   struct dirent *e;
   while ((Foreground || Running()) && (e = d.Next()) != NULL) {
         if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..")) {
+           if (e->d_type != DT_DIR && e->d_type != DT_LNK && e->d_type != DT_UNKNOWN)
+              continue; // no need to stat plain files
            char *buffer;
            asprintf(&buffer, "%s/%s", DirName, e->d_name);
+           if (e->d_type == DT_DIR && endswith(buffer, deleted ? DELEXT : RECEXT)) {
+              Watch(buffer, true);
+              Found->Add(new cScannedRecording(buffer));
+              free(buffer);
+              continue;
+              }
            struct stat st;
            if (stat(buffer, &st) == 0) {
               int Link = 0;
@@ -1031,28 +1500,21 @@ void cRecordings::ScanVideoDir(const char *DirName, bool Foreground, int LinkLev
                  }
               if (S_ISDIR(st.st_mode)) {
                  if (endswith(buffer, deleted ? DELEXT : RECEXT)) {
-                    cRecording *r = new cRecording(buffer);
-                    if (r->Name()) {
-                       Lock();
-                       Add(r);
-                       ChangeState();
-                       Unlock();
-                       if (deleted) {
-                          r->fileSizeMB = DirSizeMB(buffer);
-                          r->deleted = time(NULL);
-                          }
-                       }
-                    else
-                       delete r;
+                    Watch(buffer, true);
+                    Found->Add(new cScannedRecording(buffer));
+                    }
+                 else if (!ScanVideoDir(buffer, Found, Foreground, LinkLevel + Link)) {
+                    free(buffer);
+                    return false;
                     }
-                 else
-                    ScanVideoDir(buffer, Foreground, LinkLevel + Link);
                  }
               }
            free(buffer);
            }
         }
-	cCondWait::SleepMs(100);
+  if (!Foreground)
+     cCondWait::SleepMs(100);
+  return Foreground || Running();
 }
 
 bool cRecordings::StateChanged(int &State)
@@ -1067,26 +1529,66 @@ void cRecordings::TouchUpdate(void)
 {
   bool needsUpdate = NeedsUpdate();
   TouchFile(UpdateFileName());
-  if (!needsUpdate)
+  if (!needsUpdate) {
+     Lock();
      lastUpdate = time(NULL); // make sure we don't tigger ourselves
+     Unlock();
+     }
 }
 
 bool cRecordings::NeedsUpdate(void)
 {
+  bool Changed = false;
+  if (inotifyFd >= 0) {
+     char Buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+     ssize_t n;
+     while ((n = read(inotifyFd, Buffer, sizeof(Buffer))) > 0) {
+           for (char *p = Buffer; p < Buffer + n; ) {
+               struct inotify_event *e = (struct inotify_event *)p;
+               if (e->mask & IN_Q_OVERFLOW)
+                  Changed = true; // events have been lost, so everything has to be scanned again
+               else if (e->mask & IN_ISDIR)
+                  Changed = true;
+               else if (e->len && strcmp(e->name, INFOFILESUFFIX + 1) == 0)
+                  Changed = true; // other plain files (like our own catalog) don't matter
+               p += sizeof(struct inotify_event) + e->len;
+               }
+           }
+     }
+  time_t Now = time(NULL);
   time_t lastModified = LastModifiedTime(UpdateFileName());
-  if (lastModified > time(NULL))
-     return false; // somebody's clock isn't running correctly
-  return lastUpdate < lastModified;
+  Lock();
+  if (Changed)
+     changed = true;
+  // (a '.update' file from the future means somebody's clock isn't running correctly)
+  bool Result = changed || (lastUpdate < lastModified && lastModified <= Now) || Now - lastUpdate > RESCANINTERVAL;
+  // Recordings that VDR itself has added or deleted are saved in the background:
+  bool Save = catalogDirty && scanned && !Result && !Active();
+  if (Save)
+     saveOnly = true;
+  Unlock();
+  if (Save)
+     Start();
+  return Result;
 }
 
 bool cRecordings::Update(bool Wait)
 {
   if (Wait) {
-     Refresh(true);
+     // with all directories being watched there's no need to scan again if nothing has changed:
+     Lock();
+     bool Watched = scanned && inotifyFd >= 0 && !watchFailed;
+     Unlock();
+     if (!(Watched && !Active() && !NeedsUpdate()))
+        Refresh(true);
      return Count() > 0;
      }
-  else
+  else {
+     Lock();
+     saveOnly = false;
+     Unlock();
      Start();
+     }
   return false;
 }
 
@@ -1107,6 +1609,7 @@ void cRecordings::AddByName(const char *FileName, bool TriggerUpdate)
      recording = new cRecording(FileName);
      Add(recording);
      ChangeState();
+     catalogDirty = true;
      if (TriggerUpdate)
         TouchUpdate();
      }
@@ -1125,10 +1628,12 @@ void cRecordings::DelByName(const char *FileName)
         recording->fileSizeMB = DirSizeMB(recording->FileName());
         recording->deleted = time(NULL);
         DeletedRecordings.Add(recording);
+        DeletedRecordings.catalogDirty = true;
         }
      else
         delete recording;
      ChangeState();
+     catalogDirty = true;
      TouchUpdate();
      }
 }
@@ -1327,14 +1832,219 @@ void cRecordingUserCommand::InvokeCommand(const char *State, const char *Recordi
 // The minimum age of an index file for considering it no longer to be written:
 #define MININDEXAGE    3600 // seconds
 
+// The address space initially reserved for mapping an index file:
+#define INDEXMAPRESERVE MEGABYTE(64) // 64MB = some 90 hours at 25 frames per second
+
+// --- cIndexMap -------------------------------------------------------------
+
+// All cIndexFile objects reading the same index file share one read-only
+// mapping of it. The mapping reserves more address space than the file
+// currently has, so that the pages written later by a recording become
+// visible without remapping. If a file ever outgrows its reservation, it is
+// mapped anew, and the old mappings are kept until the last user is gone,
+// because readers may still be looking at them. Maps are identified by the
+// device and inode of their file, so that an index file that has been
+// replaced under the same name (e.g. by a new recording) gets a new map.
+
+class cIndexMap : public cListObject {
+private:
+  static cMutex mutex;
+  static cList<cIndexMap> maps;
+  static cMutex growMutex;
+  static cCondVar grown;
+  char *fileName;
+  dev_t dev;
+  ino_t ino;
+  int f;
+  int users;
+  int last;
+  size_t mapped;
+  cIndexFile::tIndex *map;
+  cIndexFile::tIndex **oldMaps;
+  size_t *oldSizes;
+  int numOldMaps;
+  cIndexMap(const char *FileName);
+  bool Map(size_t Size);
+public:
+  ~cIndexMap();
+  static cIndexMap *Acquire(const char *FileName);
+       ///< Returns the map for the given index file, creating it if necessary,
+       ///< or NULL if the file can't be mapped. Every map obtained this way
+       ///< must be given back with Release().
+  static void Release(cIndexMap *Map);
+  static void Notify(void);
+       ///< Tells all waiting readers that an index file has grown.
+  static void Wait(int TimeoutMs);
+       ///< Waits for a call to Notify(), but at most TimeoutMs milliseconds
+       ///< (index files written by other processes are only noticed then).
+  bool Update(cIndexFile::tIndex *&Index, int &Last);
+       ///< Brings the map up to date with the index file and returns its
+       ///< current contents in Index and Last.
+  bool Growing(void) { return f >= 0; }
+  };
+
+cMutex cIndexMap::mutex;
+cList<cIndexMap> cIndexMap::maps;
+cMutex cIndexMap::growMutex;
+cCondVar cIndexMap::grown;
+
+cIndexMap::cIndexMap(const char *FileName)
+{
+  fileName = strdup(FileName);
+  dev = 0;
+  ino = 0;
+  f = -1;
+  users = 0;
+  last = -1;
+  mapped = 0;
+  map = NULL;
+  oldMaps = NULL;
+  oldSizes = NULL;
+  numOldMaps = 0;
+}
+
+cIndexMap::~cIndexMap()
+{
+  if (map)
+     munmap(map, mapped);
+  for (int i = 0; i < numOldMaps; i++)
+      munmap(oldMaps[i], oldSizes[i]);
+  free(oldMaps);
+  free(oldSizes);
+  if (f >= 0)
+     close(f);
+  free(fileName);
+}
+
+bool cIndexMap::Map(size_t Size)
+{
+  size_t NewSize = mapped ? mapped : INDEXMAPRESERVE;
+  while (NewSize < Size)
+        NewSize *= 2;
+  void *p = mmap(NULL, NewSize, PROT_READ, MAP_SHARED, f, 0);
+  if (p == MAP_FAILED) {
+     LOG_ERROR_STR(fileName);
+     return false;
+     }
+  if (map) {
+     cIndexFile::tIndex **m = (cIndexFile::tIndex **)realloc(oldMaps, (numOldMaps + 1) * sizeof(*oldMaps));
+     size_t *s = (size_t *)realloc(oldSizes, (numOldMaps + 1) * sizeof(*oldSizes));
+     if (m)
+        oldMaps = m;
+     if (s)
+        oldSizes = s;
+     if (!m || !s) {
+        esyslog("ERROR: can't keep old mapping of '%s'", fileName);
+        munmap(p, NewSize);
+        return false;
+        }
+     oldMaps[numOldMaps] = map;
+     oldSizes[numOldMaps] = mapped;
+     numOldMaps++;
+     }
+  map = (cIndexFile::tIndex *)p;
+  mapped = NewSize;
+  return true;
+}
+
+cIndexMap *cIndexMap::Acquire(const char *FileName)
+{
+  int f = open(FileName, O_RDONLY);
+  struct stat buf;
+  if (f < 0 || fstat(f, &buf) < 0) {
+     LOG_ERROR_STR(FileName);
+     if (f >= 0)
+        close(f);
+     return NULL;
+     }
+  cMutexLock MutexLock(&mutex);
+  cIndexMap *m;
+  for (m = maps.First(); m; m = maps.Next(m)) {
+      if (m->dev == buf.st_dev && m->ino == buf.st_ino)
+         break;
+      }
+  if (m)
+     close(f);
+  else {
+     m = new cIndexMap(FileName);
+     m->dev = buf.st_dev;
+     m->ino = buf.st_ino;
+     m->f = f;
+     cIndexFile::tIndex *Index;
+     int Last;
+     if (!m->Update(Index, Last) || Last < 0) {
+        delete m;
+        return NULL;
+        }
+     // we don't close f here, see Update()!
+     maps.Add(m);
+     }
+  m->users++;
+  return m;
+}
+
+void cIndexMap::Release(cIndexMap *Map)
+{
+  if (Map) {
+     cMutexLock MutexLock(&mutex);
+     if (--Map->users <= 0)
+        maps.Del(Map);
+     }
+}
+
+void cIndexMap::Notify(void)
+{
+  cMutexLock MutexLock(&growMutex);
+  grown.Broadcast();
+}
+
+void cIndexMap::Wait(int TimeoutMs)
+{
+  cMutexLock MutexLock(&growMutex);
+  grown.TimedWait(growMutex, TimeoutMs);
+}
+
+bool cIndexMap::Update(cIndexFile::tIndex *&Index, int &Last)
+{
+  cMutexLock MutexLock(&mutex);
+  if (f >= 0) {
+     struct stat buf;
+     if (fstat(f, &buf) == 0) {
+        if (buf.st_size % sizeof(cIndexFile::tIndex) && last < 0)
+           esyslog("ERROR: invalid file size (%ld) in '%s'", buf.st_size, fileName);
+        int newLast = buf.st_size / sizeof(cIndexFile::tIndex) - 1;
+        if (newLast > last) {
+           if (size_t(buf.st_size) > mapped && !Map(buf.st_size)) {
+              close(f);
+              f = -1;
+              }
+           else
+              last = newLast;
+           }
+        if (f >= 0 && time(NULL) - buf.st_mtime > MININDEXAGE) {
+           // apparently the index file is not being written any more
+           close(f);
+           f = -1;
+           }
+        }
+     else
+        LOG_ERROR_STR(fileName);
+     }
+  Index = map;
+  Last = last;
+  return map != NULL;
+}
+
 cIndexFile::cIndexFile(const char *FileName, bool Record)
 :resumeFile(FileName)
 {
   f = -1;
   fileName = NULL;
-  size = 0;
   last = -1;
   index = NULL;
+  indexMap = NULL;
+  pending = NULL;
+  numPending = maxPending = 0;
   if (FileName) {
      fileName = MALLOC(char, strlen(FileName) + strlen(INDEXFILESUFFIX) + 1);
      if (fileName) {
@@ -1352,25 +2062,9 @@ cIndexFile::cIndexFile(const char *FileName, bool Record)
                  }
               last = (buf.st_size + delta) / sizeof(tIndex) - 1;
               if (!Record && last >= 0) {
-                 size = last + 1;
-                 index = MALLOC(tIndex, size);
-                 if (index) {
-                    f = open(fileName, O_RDONLY);
-                    if (f >= 0) {
-                       if ((int)safe_read(f, index, buf.st_size) != buf.st_size) {
-                          esyslog("ERROR: can't read from file '%s'", fileName);
-                          free(index);
-                          index = NULL;
-                          close(f);
-                          f = -1;
-                          }
-                       // we don't close f here, see CatchUp()!
-                       }
-                    else
-                       LOG_ERROR_STR(fileName);
-                    }
-                 else
-                    esyslog("ERROR: can't allocate %zd bytes for index '%s'", size * sizeof(tIndex), fileName);
+                 indexMap = cIndexMap::Acquire(fileName);
+                 if (indexMap)
+                    indexMap->Update(index, last);
                  }
               }
            else
@@ -1397,60 +2091,25 @@ cIndexFile::cIndexFile(const char *FileName, bool Record)
 
 cIndexFile::~cIndexFile()
 {
+  Flush();
   if (f >= 0)
      close(f);
+  cIndexMap::Release(indexMap);
   free(fileName);
-  free(index);
+  free(pending);
 }
 
 bool cIndexFile::CatchUp(int Index)
 {
   // returns true unless something really goes wrong, so that 'index' becomes NULL
-  if (index && f >= 0) {
+  if (index && indexMap && indexMap->Growing()) {
      cMutexLock MutexLock(&mutex);
      for (int i = 0; i <= MAXINDEXCATCHUP && (Index < 0 || Index >= last); i++) {
-         struct stat buf;
-         if (fstat(f, &buf) == 0) {
-            if (time(NULL) - buf.st_mtime > MININDEXAGE) {
-               // apparently the index file is not being written any more
-               close(f);
-               f = -1;
-               break;
-               }
-            int newLast = buf.st_size / sizeof(tIndex) - 1;
-            if (newLast > last) {
-               if (size <= newLast) {
-                  size *= 2;
-                  if (size <= newLast)
-                     size = newLast + 1;
-                  }
-               index = (tIndex *)realloc(index, size * sizeof(tIndex));
-               if (index) {
-                  int offset = (last + 1) * sizeof(tIndex);
-                  int delta = (newLast - last) * sizeof(tIndex);
-                  if (lseek(f, offset, SEEK_SET) == offset) {
-                     if (safe_read(f, &index[last + 1], delta) != delta) {
-                        esyslog("ERROR: can't read from index");
-                        free(index);
-                        index = NULL;
-                        close(f);
-                        f = -1;
-                        break;
-                        }
-                     last = newLast;
-                     }
-                  else
-                     LOG_ERROR_STR(fileName);
-                  }
-               else
-                  esyslog("ERROR: can't realloc() index");
-               }
-            }
-         else
-            LOG_ERROR_STR(fileName);
-         if (Index < last - (i ? 2 * INDEXSAFETYLIMIT : 0) || Index > 10 * INDEXSAFETYLIMIT) // keep off the end in case of "Pause live video"
+         if (!indexMap->Update(index, last))
+            break;
+         if (Index < last - (i ? 2 * INDEXSAFETYLIMIT : 0) || Index > 10 * INDEXSAFETYLIMIT || !indexMap->Growing()) // keep off the end in case of "Pause live video"
             break;
-         cCondWait::SleepMs(1000);
+         cIndexMap::Wait(1000);
          }
      }
   return index != NULL;
@@ -1458,6 +2117,8 @@ bool cIndexFile::CatchUp(int Index)
 
 bool cIndexFile::Write(uchar PictureType, uchar FileNumber, int FileOffset)
 {
+  if (!Flush())
+     return false;
   if (f >= 0) {
      tIndex i = { FileOffset, PictureType, FileNumber, 0 };
      if (safe_write(f, &i, sizeof(i)) < 0) {
@@ -1467,6 +2128,43 @@ bool cIndexFile::Write(uchar PictureType, uchar FileNumber, int FileOffset)
         return false;
         }
      last++;
+     cIndexMap::Notify();
+     }
+  return f >= 0;
+}
+
+bool cIndexFile::Add(uchar PictureType, uchar FileNumber, int FileOffset)
+{
+  if (f >= 0) {
+     if (numPending >= maxPending) {
+        int NewMax = maxPending ? maxPending * 2 : 256;
+        tIndex *p = (tIndex *)realloc(pending, NewMax * sizeof(tIndex));
+        if (!p) {
+           esyslog("ERROR: can't allocate index buffer");
+           return Flush() && Write(PictureType, FileNumber, FileOffset);
+           }
+        pending = p;
+        maxPending = NewMax;
+        }
+     tIndex i = { FileOffset, PictureType, FileNumber, 0 };
+     pending[numPending++] = i;
+     }
+  return f >= 0;
+}
+
+bool cIndexFile::Flush(void)
+{
+  if (f >= 0 && numPending) {
+     if (safe_write(f, pending, numPending * sizeof(tIndex)) < 0) {
+        LOG_ERROR_STR(fileName);
+        close(f);
+        f = -1;
+        }
+     else {
+        last += numPending;
+        cIndexMap::Notify();
+        }
+     numPending = 0;
      }
   return f >= 0;
 }
@@ -1546,7 +2244,7 @@ int cIndexFile::Get(uchar FileNumber, int FileOffset)
 
 bool cIndexFile::IsStillRecording()
 {
-  return f >= 0;
+  return indexMap ? indexMap->Growing() : f >= 0;
 }
 
 // --- cFileName -------------------------------------------------------------
@@ -70,6 +70,7 @@ public:
 
 class cRecording : public cListObject {
   friend class cRecordings;
+  friend class cScanWorker;
 private:
   mutable int resume;
   mutable char *titleBuffer;
@@ -78,6 +79,8 @@ private:
   mutable char *name;
   mutable int fileSizeMB;
   cRecordingInfo *info;
+  time_t infoTime;
+  bool seen;
   static char *StripEpisodeName(char *s);
   char *SortName(void) const;
   int GetResume(void) const;
@@ -88,7 +91,9 @@ public:
   int lifetime;
   time_t deleted;
   cRecording(cTimer *Timer, const cEvent *Event);
-  cRecording(const char *FileName);
+  cRecording(const char *FileName, FILE *InfoFile = NULL);
+       // If InfoFile is given, the recording's info is read from it instead of
+       // the recording's 'info.vdr' (used when loading the recordings catalog).
   virtual ~cRecording();
   virtual int Compare(const cListObject &ListObject) const;
   const char *Name(void) const { return name; }
@@ -119,15 +124,41 @@ public:
        // Returns false in case of error
   };
 
+class cScannedRecording;
+class cScanWorker;
+
 class cRecordings : public cList<cRecording>, public cThread {
+  friend class cScanWorker;
 private:
   static char *updateFileName;
+  char *catalogFileName;
   bool deleted;
   time_t lastUpdate;
   int state;
+  int inotifyFd;
+  bool changed;      // these flags are protected by Lock()
+  bool watchFailed;
+  bool scanned;
+  bool catalogLoaded;
+  bool catalogDirty;
+  bool saveOnly;
+  cMutex catalogMutex;
   const char *UpdateFileName(void);
+  const char *CatalogFileName(void);
+  void LoadCatalog(void);
+       ///< Fills the list from the catalog file written by SaveCatalog(), so that
+       ///< the recordings are available before the video directory has been scanned.
+  bool SaveCatalog(void);
+  void Watch(const char *DirName, bool Recording);
+       ///< Watches DirName for the changes that require a new scan.
   void Refresh(bool Foreground = false);
-  void ScanVideoDir(const char *DirName, bool Foreground = false, int LinkLevel = 0);
+       ///< Scans the video directory and brings the list up to date. Recordings
+       ///< whose info file hasn't changed since the last scan are kept as they are,
+       ///< only new and modified ones are read from disk.
+  bool ScanRoots(cScanWorker **Workers, int &NumWorkers, bool Foreground);
+       ///< Distributes the top level directories of the video directory among
+       ///< the scan workers, so that each disk is scanned by its own thread.
+  bool ScanVideoDir(const char *DirName, cList<cScannedRecording> *Found, bool Foreground = false, int LinkLevel = 0);
 protected:
   void Action(void);
 public:
@@ -148,6 +179,11 @@ public:
        ///< instances of VDR that access the same video directory can be triggered
        ///< to update their recordings list.
   bool NeedsUpdate(void);
+       ///< Returns true if the '.update' file has been touched, if a recording
+       ///< directory has been created, moved or removed, or an info file has
+       ///< been written since the last update, or if the last update is more
+       ///< than RESCANINTERVAL ago. Also has the catalog saved in the background
+       ///< if VDR itself has added or deleted recordings.
   void ChangeState(void) { state++; }
   bool StateChanged(int &State);
   void ResetResume(const char *ResumeFileName = NULL);
@@ -222,13 +258,19 @@ public:
 #define MAXVIDEOFILESIZE 2000 // MB
 #define MINVIDEOFILESIZE  100 // MB
 
+class cIndexMap;
+
 class cIndexFile {
+  friend class cIndexMap;
 private:
   struct tIndex { int offset; uchar type; uchar number; short reserved; };
   int f;
   char *fileName;
-  int size, last;
+  int last;
   tIndex *index;
+  cIndexMap *indexMap;
+  tIndex *pending;
+  int numPending, maxPending;
   cResumeFile resumeFile;
   cMutex mutex;
   bool CatchUp(int Index = -1);
@@ -237,6 +279,10 @@ public:
   ~cIndexFile();
   bool Ok(void) { return index != NULL; }
   bool Write(uchar PictureType, uchar FileNumber, int FileOffset);
+  bool Add(uchar PictureType, uchar FileNumber, int FileOffset);
+       ///< Like Write(), but only buffers the entry until the next call to Flush().
+  bool Flush(void);
+       ///< Writes all entries buffered by Add() with a single write() call.
   bool Get(int Index, uchar *FileNumber, int *FileOffset, uchar *PictureType = NULL, int *Length = NULL);
   int GetNextIFrame(int Index, bool Forward, uchar *FileNumber = NULL, int *FileOffset = NULL, int *Length = NULL, bool StayOffEnd = false);
   int Get(uchar FileNumber, int FileOffset);
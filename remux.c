@@ -163,7 +163,39 @@ int cRemux::GetPacketLength(const uchar *Data, int Count, int Offset)
 }
 
 //--------------------------------------------------------------------------
-// Using tuned subroutine in tools.c for FindPacketHeader
+// Classifies the start codes in Data, which are all found in one pass by
+// the vectorized FindStartCodes() in tsscan.c. Returns the stream format
+// of the first picture start code or h.264 AUD, or SF_UNKNOWN.
+//--------------------------------------------------------------------------
+#define MAXSTARTCODES 32
+
+static int ClassifyStartCodes(const uchar *Data, int Count, uchar &PictureType)
+{
+	int Offsets[MAXSTARTCODES];
+	int n=0;
+
+	while (n < Count) {
+		int Found=FindStartCodes(Data+n, Count-n, Offsets, MAXSTARTCODES);
+		for(int i=0;i<Found;i++) {
+			const uchar *p=Data+n+Offsets[i]+2;
+			switch (p[1]) {
+			case SC_PICTURE: PictureType = (p[3] >> 3) & 0x07;
+				return SF_MPEG2;
+			case 6: // TB: needed for ARD FestivalHD
+			case 9: // Access Unit Delimiter AUD in h.264
+				if (p[2]==0x10)
+					PictureType=I_FRAME;
+				else
+					PictureType=B_FRAME;
+				return SF_H264;
+			}
+		}
+		if (Found < MAXSTARTCODES)
+			break;
+		n+=Offsets[Found-1]+1;
+	}
+	return SF_UNKNOWN;
+}
 //--------------------------------------------------------------------------
 int cRemux::ScanVideoPacket(const uchar *Data, int Count, int Offset, uchar &PictureType, int &StreamFormat)
 {
@@ -177,27 +209,12 @@ int cRemux::ScanVideoPacket(const uchar *Data, int Count, int Offset, uchar &Pic
 			const uchar *p = Data + Offset + PesPayloadOffset + 0*2;
 			const uchar *pLimit = Data + Offset + Length - 3;
 
-			while (p < pLimit) {
-				int x;
-				x=FindPacketHeader(p, 0, pLimit - p);
-				if (x!=-1) {           // found 0x000001
-					p+=x+2;
-					switch (p[1]) {
-					case SC_PICTURE: PictureType = (p[3] >> 3) & 0x07;
-						StreamFormat = SF_MPEG2;
-						return Length;
-					case 6: // TB: needed for ARD FestivalHD
-					case 9: // Access Unit Delimiter AUD in h.264
-						StreamFormat = SF_H264;
-						if (p[2]==0x10)
-                                                        PictureType=I_FRAME;
-                                                else
-                                                        PictureType=B_FRAME;
-                                                return 0;
-					}
-				}
-				else
-					break;
+			if (p < pLimit) {
+				StreamFormat = ClassifyStartCodes(p, pLimit - p, PictureType);
+				if (StreamFormat == SF_MPEG2)
+					return Length;
+				if (StreamFormat == SF_H264)
+					return 0;
 			}
 		}
 
@@ -238,28 +255,11 @@ int cRemux::ScanVideoPacketTS(const uchar *Data, int Count, uchar &PictureType,
 	const uchar *p = buffer;
 	const uchar *pLimit = buffer +l - 3;
 	
-	while (p < pLimit) {
-		int x;
-		x=FindPacketHeader(p, 0, pLimit - p);
-		if (x!=-1) {           // found 0x000001
-			p+=x+2;
-			switch (p[1]) {
-			case SC_PICTURE: PictureType = (p[3] >> 3) & 0x07;
-				StreamFormat = SF_MPEG2;
-				return 0;
-			case 6: // TB: needed for ARD FestivalHD
-			case 9: // Access Unit Delimiter AUD in h.264
-				StreamFormat = SF_H264;
-				if (p[2]==0x10)
-					PictureType=I_FRAME;
-				else
-					PictureType=B_FRAME;
-				return 0;
-			}
-		}
-		else
-			break;
-	}		
+	if (p < pLimit) {
+		StreamFormat = ClassifyStartCodes(p, pLimit - p, PictureType);
+		if (StreamFormat != SF_UNKNOWN)
+			return 0;
+	}
 	return -1;
 }
 //--------------------------------------------------------------------------
@@ -301,30 +301,57 @@ typedef struct {
 	uint64 timestamp;
 } posData;
 
+// Every reader has its own cursor, the writer only overwrites what the
+// slowest active reader has consumed. A reader may lag behind by at most
+// MAXREADERLAG bytes (or half of the packets) while another one keeps up:
+// when the writer runs out of space, such a reader is resynced to the
+// writer's position and the data it missed is counted in its 'overrun'. If it currently holds packets (between
+// GetStart*() and GetEnd()), only these are kept until it releases them.
+typedef struct {
+	int rp;
+	posData *posRead;
+	int posReadNum;
+	int invalidate;
+	int active;
+	int dropped;    // resynced while holding packets, takes effect in GetEnd()
+	int heldOffset; // the data the reader holds
+	int heldEnd;
+	int heldSize;
+	int heldFlags;
+	int overrun;    // bytes skipped since the last call to Overrun()
+} posCursor;
+
+#define MAXREADERLAG (dataSize/2)
+
 class cPacketBuffer {
 	int dataSize;
 	int posSize;
 	uchar *dataBuffer;
 	posData *posBuffer;
-	int rp,wp;      
-	posData *posRead,*posWrite;
-	int posReadNum;
-	int invalidate;
+	int wp;      
+	posData *posWrite;
+	posCursor cursor[MAXREMUXREADERS];
 	int putTimeout,getTimeout;
+	cMutex mutex; // protects wp and the cursors against the writer
 
+	int SlowestReader(void);
+	int Lag(posCursor *c);
+	bool Fits(int offset, int size, int rp);
 	int FindSpace(int size);
-	
-	uchar* GetStartSub(int *readp, int timeout, int *size, int *flags, uint64 *timestamp);
+	bool DropLaggingReaders(void);
+	bool WaitForData(int readp, int timeout);
+	uchar* GetStartSub(posCursor *c, int readp, int *size, int *flags, uint64 *timestamp);
 public:
 	cPacketBuffer(int Size, int Packets);
 	~cPacketBuffer();
 	uchar* PutStart(int size);
 	void   PutEnd(int size, int flags, uint64 timestamp);
-	uchar* GetStart(int *size, int *flags, uint64 *timestamp);
-	uchar* GetStartMultiple(int *size, int *flags, uint64 *timestamp);
-	void   GetEnd(void);
-	void   GetEndMultiple(void);
-	void   Invalidate(void);
+	void   ActivateReader(int Reader, bool On);
+	uchar* GetStart(int Reader, int *size, int *flags, uint64 *timestamp);
+	uchar* GetStartMultiple(int Reader, int *size, int *flags, uint64 *timestamp);
+	void   GetEnd(int Reader);
+	void   Invalidate(int Reader);
+	int    Overrun(int Reader);
 	void SetTimeouts(int PutTimeout, int GetTimeout);
 };
 //--------------------------------------------------------------------------
@@ -350,11 +377,9 @@ cPacketBuffer::cPacketBuffer(int Size, int Packets)
 	posSize=Packets;
 	dataSize=Size;
 	memset(posBuffer,0, Packets*sizeof(posData));
-	rp=wp=0;
-	posRead=NULL;
+	wp=0;
 	posWrite=NULL;
-	posReadNum=0;
-	invalidate=0;
+	memset(cursor,0, sizeof(cursor));
 	putTimeout=getTimeout=0;
 }
 //--------------------------------------------------------------------------
@@ -364,36 +389,121 @@ cPacketBuffer::~cPacketBuffer(void)
 	free(posBuffer);
 }
 //--------------------------------------------------------------------------
+// Must be called with mutex locked, readers that have been resynced while
+// holding packets don't count
+int cPacketBuffer::SlowestReader(void)
+{
+	int rp=wp;
+	int maxFill=0;
+	for(int i=0;i<MAXREMUXREADERS;i++) {
+		if (cursor[i].active && !cursor[i].dropped) {
+			int r=cursor[i].rp;
+			int fill=(wp-r)&(posSize-1);
+			if (fill>maxFill) {
+				maxFill=fill;
+				rp=r;
+			}
+		}
+	}
+	return rp;
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked, returns the number of bytes between
+// the reader's position and the end of the most recently written packet
+int cPacketBuffer::Lag(posCursor *c)
+{
+	if (c->rp==wp)
+		return 0;
+	posData *pr=posBuffer+c->rp;
+	posData *pw=posBuffer+((wp-1)&(posSize-1));
+	int lag=pw->offset+pw->realSize-pr->offset;
+	if (lag<=0)
+		lag+=dataSize;
+	return lag;
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked, returns true if size bytes at offset
+// are neither unread by the reader at rp nor held by a resynced reader
+bool cPacketBuffer::Fits(int offset, int size, int rp)
+{
+	if (offset<0 || offset+size>=dataSize)
+		return false;
+	if (rp!=wp) {
+		posData *pr=posBuffer+rp;
+		posData *pw=posBuffer+((wp-1)&(posSize-1));
+		int wend=pw->offset+pw->realSize;
+		if (pr->offset<=pw->offset) {
+			// free are [wend, dataSize) and [0, pr->offset)
+			if (offset<wend && offset+size>=pr->offset)
+				return false;
+		}
+		else if (offset<wend || offset+size>=pr->offset)
+			return false;
+	}
+	for(int i=0;i<MAXREMUXREADERS;i++) {
+		posCursor *c=cursor+i;
+		if (c->active && c->dropped && offset<c->heldEnd && offset+size>c->heldOffset)
+			return false;
+	}
+	return true;
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked
 int cPacketBuffer::FindSpace(int size)
 {
-	int wpm=(wp-1)&(posSize-1);
-	posData *pr,*pw;
+	int rp=SlowestReader();
 
-	if (wpm<0)
-		wpm+=posSize;
+	if (((wp+1)&(posSize-1))==rp)
+		return -1; // no free entry in posBuffer
 
-	if (rp==wp) {
-		if (size>dataSize)
-			return -1;
+	if (rp!=wp) {
+		posData *pw=posBuffer+((wp-1)&(posSize-1));
+		if (Fits(pw->offset+pw->realSize,size,rp))
+			return pw->offset+pw->realSize;
+	}
+	if (Fits(0,size,rp))
 		return 0;
+	// Go past the packets resynced readers still hold:
+	for(int i=0;i<MAXREMUXREADERS;i++) {
+		posCursor *c=cursor+i;
+		if (c->active && c->dropped && Fits(c->heldEnd,size,rp))
+			return c->heldEnd;
 	}
-	pr=posBuffer+rp;
-	pw=posBuffer+wpm;
-
-	if (pr->offset <= pw->offset) {
-		if (pw->offset+pw->realSize+size < dataSize) {
-			return pw->offset+pw->realSize;
+	return -1;
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked, returns true if a reader was resynced
+bool cPacketBuffer::DropLaggingReaders(void)
+{
+	int lag[MAXREMUXREADERS];
+	bool behind[MAXREMUXREADERS];
+	bool keepingUp=false;
+	for(int i=0;i<MAXREMUXREADERS;i++) {
+		posCursor *c=cursor+i;
+		lag[i]=0;
+		behind[i]=false;
+		if (c->active && !c->dropped) {
+			lag[i]=Lag(c);
+			behind[i]=lag[i]>MAXREADERLAG || ((wp-c->rp)&(posSize-1))>posSize/2;
+			if (!behind[i])
+				keepingUp=true;
 		}
-		if (size <pr->offset)
-			return 0;
-		return -1;
 	}
-	else {
-		if (pw->offset+pw->realSize+size<dataSize)
-			return pw->offset+pw->realSize;
-		return -1;
+	if (!keepingUp)
+		return false; // nobody would benefit, the writer waits as usual
+	bool dropped=false;
+	for(int i=0;i<MAXREMUXREADERS;i++) {
+		posCursor *c=cursor+i;
+		if (behind[i]) {
+			c->overrun+=lag[i];
+			if (c->posRead)
+				c->dropped=1;
+			else
+				c->rp=wp;
+			dropped=true;
+		}
 	}
-	return -1;
+	return dropped;
 }
 //--------------------------------------------------------------------------
 uchar* cPacketBuffer::PutStart(int size)
@@ -406,7 +516,12 @@ uchar* cPacketBuffer::PutStart(int size)
 //	rsize= (size+15)&~15;
 	rsize=size;
 	while(true) {
-		offset=FindSpace(rsize);
+		{
+			cMutexLock MutexLock(&mutex);
+			offset=FindSpace(rsize);
+			if (offset==-1 && DropLaggingReaders())
+				offset=FindSpace(rsize);
+		}
 		if (offset!=-1)
 			break;
 		if (putTimeout && !starttime)
@@ -437,91 +552,137 @@ void cPacketBuffer::PutEnd(int size, int flags, uint64 timestamp)
 	posWrite->size=size;
 	posWrite->flags=flags;
 	posWrite->timestamp=timestamp;
+	cMutexLock MutexLock(&mutex);
 	wp=(wp+1)&(posSize-1);
 }
 //--------------------------------------------------------------------------
-uchar* cPacketBuffer::GetStartSub(int *readp, int timeout, int *size, int *flags, uint64 *timestamp)
+void cPacketBuffer::ActivateReader(int Reader, bool On)
 {
-	int starttime=0;
+	cMutexLock MutexLock(&mutex);
+	posCursor *c=cursor+Reader;
+	if (On) {
+		c->rp=wp;
+		c->posRead=NULL;
+		c->posReadNum=0;
+		c->invalidate=0;
+		c->overrun=0;
+	}
+	c->dropped=0;
+	c->active=On;
+}
+//--------------------------------------------------------------------------
+bool cPacketBuffer::WaitForData(int readp, int timeout)
+{
+	uint64 starttime=0;
 
 	if (timeout)
 		starttime=Now();
 //	printf("GET rp %i wp %i\n",readp,wp);
-	while(*readp==wp) {
+	while(readp==wp) {
 		if (!timeout || (Now()-starttime) > (uint64)(timeout))
-			return 0;
+			return false;
 		usleep(20*1000);
 	}
+	return true;
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked
+uchar* cPacketBuffer::GetStartSub(posCursor *c, int readp, int *size, int *flags, uint64 *timestamp)
+{
+	if (readp==wp)
+		return 0;
 #if 0	
 	if (readp>posSize) {
 		// Fixme sync
 		return 0;
 	}
 #endif
-	posRead=posBuffer+*readp;
+	c->posRead=posBuffer+readp;
 	
 	if (flags)
-		*flags=posRead->flags;
+		*flags=c->posRead->flags;
 	if (size)
-		*size=posRead->size;
+		*size=c->posRead->size;
 	if (timestamp)
-		*timestamp=posRead->timestamp;
-//	printf("GET rp %i, offset %x\n",readp,posRead->offset);
-	return dataBuffer+posRead->offset;	
+		*timestamp=c->posRead->timestamp;
+//	printf("GET rp %i, offset %x\n",readp,c->posRead->offset);
+	return dataBuffer+c->posRead->offset;	
 }
 //--------------------------------------------------------------------------
-uchar* cPacketBuffer::GetStart(int *size, int *flags, uint64 *timestamp)
+uchar* cPacketBuffer::GetStart(int Reader, int *size, int *flags, uint64 *timestamp)
 {
-	if (posRead) {
+	posCursor *c=cursor+Reader;
+	if (c->posRead) {
 #if 1
+		// The packet may already have been replaced in posBuffer if the
+		// reader has been resynced:
 		if (flags)
-	                *flags=posRead->flags;
+	                *flags=c->heldFlags;
 		if (size)
-			*size=posRead->size;
-		return dataBuffer+posRead->offset;
+			*size=c->heldSize;
+		return dataBuffer+c->heldOffset;
 #else
-		GetEnd();
+		GetEnd(Reader);
 #endif		
 	}
 
-	if (invalidate) {
-		rp=wp;
-		invalidate=0;
+	if (!WaitForData(c->rp,getTimeout) && !c->invalidate)
+		return 0;
+	cMutexLock MutexLock(&mutex);
+	if (c->invalidate) {
+		c->rp=wp;
+		c->invalidate=0;
 		return 0;
 	}
-	posReadNum=1;
-	return GetStartSub(&rp,getTimeout,size,flags,timestamp);
+	c->posReadNum=1;
+	uchar *buf=GetStartSub(c,c->rp,size,flags,timestamp);
+	if (buf) {
+		c->heldOffset=c->posRead->offset;
+		c->heldEnd=c->heldOffset+c->posRead->realSize;
+		c->heldSize=c->posRead->size;
+		c->heldFlags=c->posRead->flags;
+	}
+	return buf;
 }
 //--------------------------------------------------------------------------
-void cPacketBuffer::GetEnd(void)
+void cPacketBuffer::GetEnd(int Reader)
 {
-	if (!posRead)
+	cMutexLock MutexLock(&mutex);
+	posCursor *c=cursor+Reader;
+	if (!c->posRead)
 		return;
-	rp=(rp+posReadNum)&(posSize-1);
-	posRead=NULL;
-	posReadNum=0;
+	c->rp=(c->rp+c->posReadNum)&(posSize-1);
+	if (c->dropped) {
+		c->rp=wp;
+		c->dropped=0;
+	}
+	c->posRead=NULL;
+	c->posReadNum=0;
 }
 //--------------------------------------------------------------------------
 // Try to get multiple PES at once
-uchar* cPacketBuffer::GetStartMultiple(int *size, int *flags, uint64 *timestamp)
+uchar* cPacketBuffer::GetStartMultiple(int Reader, int *size, int *flags, uint64 *timestamp)
 {
+	posCursor *c=cursor+Reader;
 	uchar *buf,*lastbuf,*startbuf;
 	int sz,fl;
 	int readp,packets;
 	int totalsize;
 	int startflags;
-	int timeout=getTimeout;
 	uint64 tsp, starttsp;
 #if 0
-	if (posRead)
-		GetEnd();
+	if (c->posRead)
+		GetEnd(Reader);
 #endif	
-	if (invalidate) {
-		rp=wp;
-		invalidate=0;
+	if (!WaitForData(c->rp,getTimeout) && !c->invalidate)
+		return 0;
+	cMutexLock MutexLock(&mutex);
+	if (c->invalidate) {
+		c->rp=wp;
+		c->invalidate=0;
 		return 0;
 	}
-	readp=rp;
+	readp=c->rp;
 	startbuf=NULL;
 	lastbuf=NULL;
 	totalsize=0;
@@ -530,7 +691,7 @@ uchar* cPacketBuffer::GetStartMultiple(int *size, int *flags, uint64 *timestamp)
 	starttsp=0;
 	while(1) {
 		sz=0;
-		buf=GetStartSub(&readp,timeout,&sz,&fl,&tsp);
+		buf=GetStartSub(c,readp,&sz,&fl,&tsp);
 //		printf("GOT %x %i\n",buf,sz);
 		if (!startbuf) {
 			if (!buf)
@@ -548,7 +709,12 @@ uchar* cPacketBuffer::GetStartMultiple(int *size, int *flags, uint64 *timestamp)
 					*flags=startflags;
 				if (timestamp)
 					*timestamp=starttsp;
-				posReadNum=packets;
+				c->posReadNum=packets;
+				c->posRead=posBuffer+c->rp;
+				c->heldOffset=startbuf-dataBuffer;
+				c->heldEnd=lastbuf-dataBuffer+posBuffer[(readp-1)&(posSize-1)].realSize;
+				c->heldSize=totalsize;
+				c->heldFlags=startflags;
 				return startbuf;
 			}
 		}
@@ -556,7 +722,6 @@ uchar* cPacketBuffer::GetStartMultiple(int *size, int *flags, uint64 *timestamp)
 		packets++;
 		totalsize+=sz;
 		lastbuf=buf;
-		timeout=0;
 	}
 	return NULL;
 }
@@ -567,9 +732,18 @@ void cPacketBuffer::SetTimeouts(int PutTimeout, int GetTimeout)
 	getTimeout=GetTimeout;
 }
 //--------------------------------------------------------------------------
-void cPacketBuffer::Invalidate(void)
+void cPacketBuffer::Invalidate(int Reader)
+{
+	cursor[Reader].invalidate=1;
+}
+//--------------------------------------------------------------------------
+int cPacketBuffer::Overrun(int Reader)
 {
-	invalidate=1;
+	cMutexLock MutexLock(&mutex);
+	posCursor *c=cursor+Reader;
+	int n=c->overrun;
+	c->overrun=0;
+	return n;
 }
 
 //--------------------------------------------------------------------------
@@ -1177,23 +1351,53 @@ int cRepackerAC3Fast::PutRaw(const uchar *Data, int Count, int Flag, uint64 time
 #endif
 
 //--------------------------------------------------------------------------
-// cRemux
+//--------------------------------------------------------------------------
+// cRemuxCore
 //--------------------------------------------------------------------------
 
-cRemux::cRemux(int VPid, const int *APids, const int *DPids, 
-	       const int *SPids, bool ExitOnFailure, enum eRemuxMode Rmode, bool SyncEarly)
+cMutex cRemuxCore::mutex;
+cList<cRemuxCore> cRemuxCore::cores;
+
+static void CopyPids(int *Dest, const int *Source, int Max)
 {
-	exitOnFailure = ExitOnFailure;
+	int n=0;
+	if (Source) {
+		while (n<Max && Source[n]) {
+			Dest[n]=Source[n];
+			n++;
+		}
+	}
+	Dest[n]=0;
+}
+//--------------------------------------------------------------------------
+static bool SamePids(const int *Pids, const int *Other)
+{
+	if (!Other)
+		return !*Pids;
+	while (*Pids && *Pids==*Other) {
+		Pids++;
+		Other++;
+	}
+	return *Pids==*Other;
+}
+//--------------------------------------------------------------------------
+cRemuxCore::cRemuxCore(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids, enum eRemuxMode Rmode)
+{
+	channelID=ChannelID;
+	keyVPid=VPid;
+	CopyPids(keyAPids, APids, MAXAPIDS);
+	CopyPids(keyDPids, DPids, MAXDPIDS);
+	CopyPids(keySPids, SPids, MAXSPIDS);
+	for(int n=0;n<MAXREMUXREADERS;n++)
+		reader[n]=NULL;
+	feeder=NULL;
+	putTimeout=0;
+	lastPacketValid=false;
+
 	isRadio = VPid == 0 || VPid == 1 || VPid == 0x1FFF;
-	numUPTerrors = 0;
-	synced = false;
-	syncEarly = SyncEarly;
-	skipped = 0;
 	numTracks = 0;
-	resultSkipped = 0;
 	timestamp=0;
 	rmode=Rmode;
-	tsindex=0;
 	
 	tsmode=rAuto;
 	sfmode=SF_UNKNOWN;
@@ -1217,15 +1421,8 @@ cRemux::cRemux(int VPid, const int *APids, const int *DPids,
 		dpids[n]=0;
 	}
 	
-	for(int n=0;n<MAXTRACKS;n++) {
+	for(int n=0;n<MAXTRACKS;n++)
 		repacker[n]=NULL;
-		rp_data[n]=NULL;
-		rp_count[n]=0;
-		rp_flags[n]=0;
-		rp_ts[n]=0;
-	}
-
-	lastGet=-1;
 
 	if (VPid) {
 		repacker[numTracks++] = new cRepackerFast(VPid, 0xE0, 0x00);
@@ -1257,32 +1454,104 @@ cRemux::cRemux(int VPid, const int *APids, const int *DPids,
            ts2pes[numTracks++] = new cTS2PES(*SPids++, 0x00, 0x28 + n++);
 	   }
 	*/
-	SetTimeouts(0,1000);
-}
-//--------------------------------------------------------------------------
-void cRemux::SetTimeouts(int PutTimeout, int GetTimeout)
-{
 	for(int i=0;i<numTracks;i++)
-		repacker[i]->packetBuffer->SetTimeouts(PutTimeout,0);
-	getTimeout=GetTimeout;
+		repacker[i]->packetBuffer->SetTimeouts(0,0);
 }
 //--------------------------------------------------------------------------
-cRemux::~cRemux(void)
+cRemuxCore::~cRemuxCore()
 {
 	for(int i=0;i<numTracks;i++)
 		delete(repacker[i]);
 	printf("Destroy remux\n");
 }
 //--------------------------------------------------------------------------
-int cRemux::Put(const uchar *Data, int Count)
+bool cRemuxCore::Matches(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids)
+{
+	return channelID==ChannelID && keyVPid==VPid && SamePids(keyAPids, APids) && SamePids(keyDPids, DPids) && SamePids(keySPids, SPids);
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked
+int cRemuxCore::AddReader(cRemux *Remux)
+{
+	for(int n=0;n<MAXREMUXREADERS;n++) {
+		if (!reader[n]) {
+			for(int i=0;i<numTracks;i++)
+				repacker[i]->packetBuffer->ActivateReader(n, true);
+			reader[n]=Remux;
+			if (!feeder)
+				feeder=Remux;
+			return n;
+		}
+	}
+	return -1;
+}
+//--------------------------------------------------------------------------
+// Must be called with mutex locked, returns true if this was the last reader
+bool cRemuxCore::DelReader(cRemux *Remux)
+{
+	bool Last=true;
+	for(int n=0;n<MAXREMUXREADERS;n++) {
+		if (reader[n]==Remux) {
+			for(int i=0;i<numTracks;i++)
+				repacker[i]->packetBuffer->ActivateReader(n, false);
+			reader[n]=NULL;
+		}
+		else if (reader[n])
+			Last=false;
+	}
+	if (feeder==Remux) {
+		// Hand over to one of the remaining readers:
+		feeder=NULL;
+		for(int n=0;n<MAXREMUXREADERS && !feeder;n++)
+			feeder=reader[n];
+	}
+	return Last;
+}
+//--------------------------------------------------------------------------
+void cRemuxCore::Clear(void)
+{
+	for(int n=0;n<MAXREMUXREADERS;n++) {
+		if (reader[n])
+			reader[n]->Clear();
+	}
+}
+//--------------------------------------------------------------------------
+int cRemuxCore::Put(const uchar *Data, int Count, int PutTimeout)
 {
 	int adapfield;
 	int pid;
 	int pes_start;
 	unsigned int offset;
 
+	// Every reader has its own put timeout, the one of the feeder applies:
+	if (PutTimeout!=putTimeout) {
+		for(int i=0;i<numTracks;i++)
+			repacker[i]->packetBuffer->SetTimeouts(PutTimeout,0);
+		putTimeout=PutTimeout;
+	}
 	Count=TS_SIZE*(Count/TS_SIZE);
-	for (int i = 0; i < Count; i += TS_SIZE, Data+=TS_SIZE) {
+	if (Count) {
+		memcpy(lastPacket, Data+Count-TS_SIZE, TS_SIZE);
+		lastPacketValid=true;
+	}
+	for (int i = 0, run = 0, t = -1; i < Count; i += TS_SIZE, Data+=TS_SIZE, run -= TS_SIZE) {
+
+		// Look up the repacker only once for every run of packets with the same PID:
+		if (run <= 0) {
+			run=TsPidRun(Data, Count-i);
+			pid=TsPid(Data);
+			for (t = 0; t < numTracks && repacker[t]->GetPid() != pid; t++)
+				;
+			if (t == numTracks)
+				t = -1;
+		}
+		if (t < 0) {
+			// skip the rest of this run
+			Data+=run-TS_SIZE;
+			i+=run-TS_SIZE;
+			run=0;
+			continue;
+		}
 
 // already filtered out by dvb-api
 #if 0
@@ -1307,35 +1576,133 @@ int cRemux::Put(const uchar *Data, int Count)
 			
 		pes_start=Data[1]&0x40; // remember if this TS started a PES
 		
-		pid=((Data[1]&0x1f)<<8)|Data[2];
-		for (int t = 0; t < numTracks; t++) {
-			if (repacker[t]->GetPid() == pid) {
 #ifdef ENABLE_TS_MODE
-				// Do we need raw TS?
-				if (tsmode_valid>0 && (tsmode==rTS)) {
-					if (tsmode_valid==1) {
-						printf("READER %i %i\n",tsmode,sfmode);
-						Clear();
-						tsmode_valid=2;
-					}
-					if (repacker[t]->PutRaw(Data, TS_SIZE, pes_start,timestamp++)) {
-						printf("CLEAR PID %x\n",pid);
-						Clear();
-					}
-				}
-				else 
-#endif				
-				{
-					if (repacker[t]->Put(Data+offset, TS_SIZE-offset, pes_start,timestamp++)) 
-						Clear();
-				}
-				break;
+		// Do we need raw TS?
+		if (tsmode_valid>0 && (tsmode==rTS)) {
+			if (tsmode_valid==1) {
+				printf("READER %i %i\n",tsmode,sfmode);
+				Clear();
+				tsmode_valid=2;
+			}
+			if (repacker[t]->PutRaw(Data, TS_SIZE, pes_start,timestamp++)) {
+				printf("CLEAR PID %x\n",pid);
+				Clear();
 			}
 		}
+		else 
+#endif				
+		{
+			if (repacker[t]->Put(Data+offset, TS_SIZE-offset, pes_start,timestamp++)) 
+				Clear();
+		}
 	}
 	
 	return Count;
 }
+// cRemux
+//--------------------------------------------------------------------------
+
+
+cRemux::cRemux(int VPid, const int *APids, const int *DPids, 
+	       const int *SPids, bool ExitOnFailure, enum eRemuxMode Rmode, bool SyncEarly)
+{
+	cMutexLock MutexLock(&cRemuxCore::mutex);
+	Attach(new cRemuxCore(tChannelID::InvalidID, VPid, APids, DPids, SPids, Rmode), ExitOnFailure, SyncEarly);
+}
+//--------------------------------------------------------------------------
+cRemux::cRemux(cRemuxCore *Core, bool ExitOnFailure, bool SyncEarly)
+{
+	Attach(Core, ExitOnFailure, SyncEarly);
+}
+//--------------------------------------------------------------------------
+// Must be called with cRemuxCore::mutex locked
+void cRemux::Attach(cRemuxCore *Core, bool ExitOnFailure, bool SyncEarly)
+{
+	core = Core;
+	exitOnFailure = ExitOnFailure;
+	numUPTerrors = 0;
+	synced = false;
+	syncEarly = SyncEarly;
+	skipped = 0;
+	resultSkipped = 0;
+	tsindex=0;
+	patpmt_valid=0;
+	
+	for(int n=0;n<MAXTRACKS;n++) {
+		rp_data[n]=NULL;
+		rp_count[n]=0;
+		rp_flags[n]=0;
+		rp_ts[n]=0;
+	}
+
+	lastGet=-1;
+	putTimeout=0;
+	getTimeout=1000;
+	reader = core->AddReader(this);
+}
+//--------------------------------------------------------------------------
+cRemux *cRemux::Acquire(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure)
+{
+	if (!ChannelID.Valid())
+		return new cRemux(VPid, APids, DPids, SPids, ExitOnFailure);
+	cMutexLock MutexLock(&cRemuxCore::mutex);
+	cRemuxCore *Core = NULL;
+	for (cRemuxCore *c = cRemuxCore::cores.First(); c && !Core; c = cRemuxCore::cores.Next(c)) {
+		if (c->Matches(ChannelID, VPid, APids, DPids, SPids)) {
+			for(int n=0;n<MAXREMUXREADERS && !Core;n++) {
+				if (!c->reader[n])
+					Core = c;
+			}
+		}
+	}
+	if (Core)
+		dsyslog("sharing remuxer for channel %s", *ChannelID.ToString());
+	else {
+		Core = new cRemuxCore(ChannelID, VPid, APids, DPids, SPids, rPES);
+		cRemuxCore::cores.Add(Core);
+	}
+	return new cRemux(Core, ExitOnFailure, false);
+}
+//--------------------------------------------------------------------------
+void cRemux::SetTimeouts(int PutTimeout, int GetTimeout)
+{
+	// The put timeout is applied to the shared packet buffers while this
+	// remuxer is feeding them (see cRemuxCore::Put()):
+	putTimeout=PutTimeout;
+	getTimeout=GetTimeout;
+}
+//--------------------------------------------------------------------------
+cRemux::~cRemux(void)
+{
+	cMutexLock MutexLock(&cRemuxCore::mutex);
+	if (core->DelReader(this)) {
+		if (core->channelID.Valid())
+			cRemuxCore::cores.Del(core);
+		else
+			delete core;
+	}
+}
+//--------------------------------------------------------------------------
+int cRemux::Put(const uchar *Data, int Count)
+{
+	// Only the feeding remuxer puts data into shared repackers:
+	if (core->feeder != this)
+		return Count;
+	return core->Put(Data, Count, putTimeout);
+}
+//--------------------------------------------------------------------------
+int cRemux::Fed(const uchar *Data, int Count)
+{
+	cMutexLock MutexLock(&cRemuxCore::mutex);
+	if (!core->lastPacketValid)
+		return 0;
+	// The most recent occurrence is the one we're looking for:
+	for (int n = TS_SIZE*(Count/TS_SIZE)-TS_SIZE; n >= 0; n -= TS_SIZE) {
+		if (memcmp(Data+n, core->lastPacket, TS_SIZE)==0)
+			return n+TS_SIZE;
+	}
+	return 0;
+}
 //--------------------------------------------------------------------------
 extern struct timeval switchTime;
 uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
@@ -1353,14 +1720,24 @@ uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
 
 	Count=0;
 
+	// Start over if this reader has fallen too far behind the others:
+	int lost=0;
+	for(int i=0;i<core->numTracks;i++)
+		lost+=core->repacker[i]->packetBuffer->Overrun(reader);
+	if (lost) {
+		skipped+=lost;
+		esyslog("ERROR: remuxer reader %d fell behind, %d bytes skipped (%d total)", reader, lost, skipped);
+		Clear();
+	}
+
 	while(1) 
 	{
-		for(int i=0;i<numTracks;i++) {
+		for(int i=0;i<core->numTracks;i++) {
 			if (!rp_data[i]) {
 				if (mode)
-					rp_data[i]=repacker[i]->packetBuffer->GetStartMultiple(&rp_count[i],&rp_flags[i], &rp_ts[i]);
+					rp_data[i]=core->repacker[i]->packetBuffer->GetStartMultiple(reader,&rp_count[i],&rp_flags[i], &rp_ts[i]);
 				else
-					rp_data[i]=repacker[i]->packetBuffer->GetStart(&rp_count[i],&rp_flags[i], &rp_ts[i]);
+					rp_data[i]=core->repacker[i]->packetBuffer->GetStart(reader,&rp_count[i],&rp_flags[i], &rp_ts[i]);
 			}
 			if (rp_data[i])
 				data_available=1;
@@ -1393,7 +1770,7 @@ uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
 	}
 	else {
 		uint64 min_ts=0xffffffffffffffffLL;
-		for(int i=0;i<numTracks;i++) {
+		for(int i=0;i<core->numTracks;i++) {
 			if (rp_data[i]) {
 				if (rp_ts[i]<min_ts) {
 					n=i;
@@ -1409,7 +1786,7 @@ uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
 	lastGet=n;
 
 #ifdef ENABLE_TS_MODE
-	if (tsmode_valid==2 && (tsmode==rTS)) {
+	if (core->tsmode_valid==2 && (core->tsmode==rTS)) {
 		if (n==0 && flags) { 
 			/* Assumption/HACK: only a flagged PES packet starts a new frame
 			   and frame type fits in the first packet
@@ -1435,35 +1812,35 @@ uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
 			int l=ScanVideoPacket(resultData, resultCount, 0, pt, sf);
 
 #ifdef ENABLE_TS_MODE
-			if (!tsmode_valid) { // Find type (MPEG2/h264)
+			if (!core->tsmode_valid) { // Find type (MPEG2/h264)
 				if (sf!=SF_UNKNOWN) {
                                        struct timeval now;
                                        gettimeofday(&now, NULL);
                                        float secs = ((float)((1000000 * now.tv_sec + now.tv_usec) - (switchTime.tv_sec * 1000000 + switchTime.tv_usec))) / 1000000;
                                        printf("\n\n======================= DETECTED %i : time since channelswitch-start: secs: %f\n\n",sf, secs);
-					sfmode=sf;
-                                        rmode = rAuto; // TB: hack to force rmode to rAuto
-					switch(rmode) {
+					core->sfmode=sf;
+                                        core->rmode = rAuto; // TB: hack to force rmode to rAuto
+					switch(core->rmode) {
 					case rAuto:
 						if (sf==SF_MPEG2) {
-							tsmode=rPES;
-							tsmode_valid=1;
+							core->tsmode=rPES;
+							core->tsmode_valid=1;
 						}
 						if (sf==SF_H264) {
-							tsmode=rTS;
+							core->tsmode=rTS;
 							Clear(); // Throw away already packed PES buffers
-							tsmode_valid=1;
+							core->tsmode_valid=1;
 							return NULL;
 						}
 						break;
 					case rPES:
-						tsmode=rPES;
-						tsmode_valid=1;
+						core->tsmode=rPES;
+						core->tsmode_valid=1;
 						break;
 					case rTS:
-						tsmode=rTS;
+						core->tsmode=rTS;
 						Clear();
-						tsmode_valid=1;
+						core->tsmode_valid=1;
 						return NULL;
 					}
 				}
@@ -1491,13 +1868,13 @@ uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
 				}
 			}
 		}
-		else if (isRadio || (!synced && syncEarly)) {
+		else if (core->isRadio || (!synced && syncEarly)) {
 		  pt=I_FRAME;
 		  synced=true;
-		  if (!isRadio) 
+		  if (!core->isRadio) 
               fprintf(stderr, "audio: synced early\n");	
 		}
-	    else if (!synced && PictureType && isRadio) {
+	    else if (!synced && PictureType && core->isRadio) {
 		   lastGet=-1; // Hold back audio to get faster AV-sync
 		}
     }
@@ -1521,8 +1898,8 @@ uchar* cRemux::Get(int &Count, uchar *PictureType, int mode, int *start)
 // Count is ignored due to packet structure
 void cRemux::Del(int Count)
 {
-	if (lastGet!=-1 && repacker[lastGet]) {
-		repacker[lastGet]->packetBuffer->GetEnd();
+	if (lastGet!=-1 && core->repacker[lastGet]) {
+		core->repacker[lastGet]->packetBuffer->GetEnd(reader);
 		rp_data[lastGet]=NULL;
 	}
 }
@@ -1531,10 +1908,10 @@ void cRemux::Clear(void)
 {
 //	printf("CLEAR\n");
 
-	for(int i=0;i<numTracks;i++) {
-		repacker[i]->packetBuffer->GetEnd();
+	for(int i=0;i<core->numTracks;i++) {
+		core->repacker[i]->packetBuffer->GetEnd(reader);
 		rp_data[i]=NULL;
-		repacker[i]->packetBuffer->Invalidate();
+		core->repacker[i]->packetBuffer->Invalidate(reader);
 	}
 	synced=0;
 }
@@ -1649,28 +2026,28 @@ int cRemux::GetPATPMT(uchar *data, int maxlen)
 	data[10]=0xc3;
 	data[11]=0x00;
 	data[12]=0x00;
-	data[13]=0xe0 | (vpid>>8); // PCR
-	data[14]=(vpid);
+	data[13]=0xe0 | (core->vpid>>8); // PCR
+	data[14]=(core->vpid);
 	data[15]=0xf0;
 	data[16]=00;
 	
 	len=17;
 
-	if (sfmode==SF_H264)
-		len+=makeStreamType(data+len, 1, vpid);
+	if (core->sfmode==SF_H264)
+		len+=makeStreamType(data+len, 1, core->vpid);
 	else
-		len+=makeStreamType(data+len, 0, vpid);
+		len+=makeStreamType(data+len, 0, core->vpid);
 
 	for(n=0;n<16;n++) {
-		if (!apids[n])
+		if (!core->apids[n])
 			break;
-		len+=makeStreamType(data+len, 2, apids[n]);
+		len+=makeStreamType(data+len, 2, core->apids[n]);
 	}
 
 	for(n=0;n<16;n++) {
-		if (!dpids[n])
+		if (!core->dpids[n])
 			break;
-		len+=makeStreamType(data+len, 3, dpids[n]);
+		len+=makeStreamType(data+len, 3, core->dpids[n]);
 	}
        
 	data[7]=len-8+4;
@@ -1684,3 +2061,76 @@ int cRemux::GetPATPMT(uchar *data, int maxlen)
 	return 2*TS_SIZE;
 }
 //--------------------------------------------------------------------------
+// cRemuxFeeder
+//--------------------------------------------------------------------------
+cRemuxFeeder::cRemuxFeeder(cRemux *Remux, int Size, const char *Description)
+:cThread(Description)
+{
+  remux = Remux;
+  ringBuffer = new cRingBufferLinearSPSC(Size, TS_SIZE * 2, true, Description);
+  ringBuffer->SetTimeouts(0, 100);
+  keep = Size / 2 / TS_SIZE * TS_SIZE;
+}
+//--------------------------------------------------------------------------
+cRemuxFeeder::~cRemuxFeeder()
+{
+  Cancel(3);
+  delete ringBuffer;
+}
+//--------------------------------------------------------------------------
+void cRemuxFeeder::Activate(bool On)
+{
+  if (On)
+     Start();
+  else
+     Cancel(-1);
+}
+//--------------------------------------------------------------------------
+void cRemuxFeeder::Put(const uchar *Data, int Count)
+{
+  // Only whole packets go into the buffer, so that the remuxer never gets out of sync:
+  int n = min(Count, ringBuffer->Free() / TS_SIZE * TS_SIZE);
+  if (n > 0)
+     n = ringBuffer->Put(Data, n);
+  if (n < Count)
+     ringBuffer->ReportOverflow(Count - n);
+}
+//--------------------------------------------------------------------------
+void cRemuxFeeder::Action(void)
+{
+  SetThreadClass(tcRemux);
+  bool Passive = false;
+  while (Running()) {
+        int r;
+        uchar *b = ringBuffer->Get(r);
+        if (b) {
+           if (!remux->Feeding()) {
+              // Another remuxer is feeding the shared repackers, so we only
+              // keep the most recent data in case we have to take over:
+              Passive = true;
+              int Excess = min(r, ringBuffer->Available() - keep) / TS_SIZE * TS_SIZE;
+              if (Excess > 0)
+                 ringBuffer->Del(Excess);
+              else
+                 cCondWait::SleepMs(10);
+              continue;
+              }
+           if (Passive) {
+              // Continue right behind what the previous feeder has put:
+              int Fed = remux->Fed(b, r);
+              if (Fed)
+                 ringBuffer->Del(Fed);
+              else
+                 dsyslog("remuxer taken over without overlap");
+              Passive = false;
+              continue;
+              }
+           int Count = remux->Put(b, r);
+           if (Count)
+              ringBuffer->Del(Count);
+           else
+              cCondWait::SleepMs(10); // less than one packet available
+           }
+        }
+}
+//--------------------------------------------------------------------------
@@ -11,8 +11,10 @@
 
 #include <time.h>
 #include <linux/dvb/dmx.h>
+#include "channels.h"
 #include "ringbuffer.h"
 //#include "tools.h"
+#include "tsscan.h"
 
 enum ePesHeader {
   phNeedMoreData = -1,
@@ -28,8 +30,7 @@ enum eRemuxMode {
   rPES,  // Force PES
   rTS    // Force TS
 };
-#define TS_SIZE 188
-  
+
 // Picture types:
 #define NO_PICTURE 0
 #define I_FRAME    1
@@ -41,41 +42,79 @@ enum eRemuxMode {
 
 #define MAXTRACKS 64
 
+// The maximum number of cRemux objects that can read from the same repackers:
+#define MAXREMUXREADERS 4
+
 class cRepacker;
+class cRemux;
+
+// cRemuxCore holds the repackers and the stream format detection state of a
+// remuxer. Every cRemux reads from a core with its own cursor into the packet
+// buffers, so several consumers of the same channel and PID set (see
+// cRemux::Acquire()) share the work of repacking the data.
+
+class cRemuxCore : public cListObject {
+  friend class cRemux;
+private:
+  static cMutex mutex;
+  static cList<cRemuxCore> cores;
+  tChannelID channelID;
+  int keyVPid;
+  int keyAPids[MAXAPIDS + 1];
+  int keyDPids[MAXDPIDS + 1];
+  int keySPids[MAXSPIDS + 1];
+  cRemux *reader[MAXREMUXREADERS];
+  cRemux *feeder;
+  int putTimeout;
+  uchar lastPacket[TS_SIZE]; // the last TS packet the feeder has put into the repackers
+  bool lastPacketValid;
+  bool isRadio;
+  cRepacker *repacker[MAXTRACKS];
+  int numTracks;
+  uint64 timestamp;
+  enum eRemuxMode rmode;
+  int tsmode;
+  int tsmode_valid;
+  int sfmode;
+  int vpid;
+  int apids[16];
+  int dpids[16];
+  cRemuxCore(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids, enum eRemuxMode Rmode);
+  ~cRemuxCore();
+  bool Matches(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids);
+  int AddReader(cRemux *Remux);
+  bool DelReader(cRemux *Remux);
+  int Put(const uchar *Data, int Count, int PutTimeout);
+  void Clear(void);
+  };
 
 class cRemux {
+  friend class cRemuxCore;
 private:
+  cRemuxCore *core;
+  int reader;
   bool exitOnFailure;
-  bool isRadio;
   int numUPTerrors;
   bool synced;
   bool syncEarly;
-  int skipped;
+  int skipped; // bytes lost because this reader fell behind the others
+  int putTimeout;
   int getTimeout;
   int lastGet;
-  cRepacker *repacker[MAXTRACKS];
   uchar *rp_data[MAXTRACKS];
   int rp_count[MAXTRACKS];
   int rp_flags[MAXTRACKS];
   uint64 rp_ts[MAXTRACKS];
-  uint64 timestamp;
-  int numTracks;
   int resultSkipped;
   inline int GetPid(const uchar *Data) 
 	  {return ((Data[0] & 0xf) << 8) | (Data[1] & 0xff);};
 	  
   // RMM extensions
-  enum eRemuxMode rmode;
-  int tsmode;
-  int tsmode_valid;
-  int sfmode;
-  
   uchar patpmt[2*TS_SIZE];
   int patpmt_valid;
   int tsindex;
-  int vpid;
-  int apids[16];
-  int dpids[16];
+  cRemux(cRemuxCore *Core, bool ExitOnFailure, bool SyncEarly);
+  void Attach(cRemuxCore *Core, bool ExitOnFailure, bool SyncEarly);
   
 public:
   cRemux(int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure = false, 
@@ -86,7 +125,26 @@ public:
        ///< PID). If ExitOnFailure is true, the remuxer will initiate an "emergency
        ///< exit" in case of problems with the data stream. SyncEarly causes cRemux
        ///< to sync as soon as a video or audio frame is seen.
+  static cRemux *Acquire(tChannelID ChannelID, int VPid, const int *APids, const int *DPids, const int *SPids, bool ExitOnFailure = false);
+       ///< Returns a remuxer for the given PIDs of the channel with ChannelID.
+       ///< If there already is a remuxer for exactly this channel and PID set,
+       ///< the new one reads from the same repackers with its own read position
+       ///< and sync state, so the data is repacked only once for all of them.
+       ///< Only one of them (the first one, as long as it exists) actually puts
+       ///< data into the repackers, Put() calls to the others are ignored.
+       ///< A reader that falls behind by more than half of the buffered data
+       ///< while another one keeps up loses what it hasn't read yet and syncs
+       ///< again, so that it doesn't hold up the others.
+       ///< The result is deleted by the caller, as with any other cRemux.
   ~cRemux();
+  bool Feeding(void) { return core->feeder == this; }
+       ///< Returns true if data given to Put() is actually used (see Acquire()).
+  int Fed(const uchar *Data, int Count);
+       ///< Returns the number of bytes at the beginning of the Count bytes of TS
+       ///< Data that have already been put into the shared repackers by the
+       ///< remuxer that was feeding them before this one took over. Data is
+       ///< expected to be the same stream as the other remuxer got. If the last
+       ///< packet the other remuxer has put is not in Data, the result is 0.
   void SetTimeouts(int PutTimeout, int GetTimeout);
        ///< By default cRemux assumes that Put() and Get() are called from different
        ///< threads, and uses a timeout in the Get() function in case there is no
@@ -109,20 +167,49 @@ public:
        ///< values must be exactly what the previous Get() has returned.
   void Clear(void);
        ///< Clears the remuxer of all data it might still contain, keeping the PID
-       ///< settings as they are.
+       ///< settings as they are. Other remuxers sharing the same repackers are
+       ///< not affected.
   static void SetBrokenLink(uchar *Data, int Length);
   static int GetPacketLength(const uchar *Data, int Count, int Offset);
   static int ScanVideoPacket(const uchar *Data, int Count, int Offset, uchar &PictureType, int &StreamFormat);
   static int ScanVideoPacketTS(const uchar *Data, int Count, uchar &PictureType, int &StreamFormat);
 
   // RMM extension: Mixed TS/PES handling
-  int TSmode(void) { return tsmode;}
-  int SFmode(void) { return sfmode;}
+  int TSmode(void) { return core->tsmode;}
+  int SFmode(void) { return core->sfmode;}
   int makeStreamType(uchar *data, int type, int pid);
   int GetPATPMT(uchar *data, int maxlen);
 
   };
 
+// cRemuxFeeder decouples a receiver from its remuxer: the receiver's Receive()
+// function just copies the TS packets into a lock-free ring buffer, and the
+// remuxing is done in a separate thread, so that a slow remuxer doesn't hold
+// up the device's receive loop (and thus all other receivers on that device).
+// While another remuxer is feeding the shared repackers (see cRemux::Acquire()),
+// the feeder keeps the most recent data it has received, so that it can take
+// over right behind the last packet the other one has put when that goes away.
+
+class cRemuxFeeder : public cThread {
+private:
+  cRemux *remux;
+  cRingBufferLinearSPSC *ringBuffer;
+  int keep;
+protected:
+  virtual void Action(void);
+public:
+  cRemuxFeeder(cRemux *Remux, int Size, const char *Description);
+       ///< Creates a feeder that puts the data given to Put() into Remux,
+       ///< buffering up to Size bytes in between.
+  virtual ~cRemuxFeeder();
+  void Activate(bool On);
+       ///< Starts or stops the remuxing thread.
+  void Put(const uchar *Data, int Count);
+       ///< Puts Count bytes of TS Data into the buffer. Must always be called
+       ///< from the same thread. Whatever doesn't fit into the buffer is dropped
+       ///< (in units of whole TS packets) and reported as an overflow.
+  };
+
 // Start codes:
 #define SC_SEQUENCE 0xB3  // "sequence header code"
 #define SC_GROUP    0xB8  // "group start code"
@@ -11,7 +11,10 @@
  */
 
 #include "ringbuffer.h"
+#include <linux/futex.h>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include "tools.h"
 
@@ -329,42 +332,357 @@ void cRingBufferLinear::Del(int Count)
 #endif
 }
 
+// --- cRingBufferLinearSPSC -------------------------------------------------
+
+#if __GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 7
+static inline int LoadAcquire(volatile int *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void StoreRelease(volatile int *p, int v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline void FullBarrier(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#else
+static inline int LoadAcquire(volatile int *p) { int v = *p; __sync_synchronize(); return v; }
+static inline void StoreRelease(volatile int *p, int v) { __sync_synchronize(); *p = v; }
+static inline void FullBarrier(void) { __sync_synchronize(); }
+#endif
+
+#ifndef FUTEX_WAIT_PRIVATE
+#define FUTEX_WAIT_PRIVATE FUTEX_WAIT
+#define FUTEX_WAKE_PRIVATE FUTEX_WAKE
+#endif
+
+cRingBufferLinearSPSC::cRingBufferLinearSPSC(int Size, int Margin, bool Statistics, const char *Description)
+:cRingBuffer(Size, Statistics)
+{
+  description = Description ? strdup(Description) : NULL;
+  tail = head = margin = Margin;
+  putWaiting = getWaiting = 0;
+  gotten = 0;
+  buffer = NULL;
+  if (Size > 1) { // 'Size - 1' must not be 0!
+     if (Margin <= Size / 2) {
+        buffer = MALLOC(uchar, Size);
+        if (!buffer)
+           esyslog("ERROR: can't allocate ring buffer (size=%d)", Size);
+        }
+     else
+        esyslog("ERROR: invalid margin for ring buffer (%d > %d)", Margin, Size / 2);
+     }
+  else
+     esyslog("ERROR: invalid size for ring buffer (%d)", Size);
+}
+
+cRingBufferLinearSPSC::~cRingBufferLinearSPSC()
+{
+  free(buffer);
+  free(description);
+}
+
+void cRingBufferLinearSPSC::Sleep(volatile int *Waiting, volatile int *Index, int Seen, int TimeoutMs)
+{
+  // Announce that we are about to sleep, and then check again whether the
+  // other side has moved its index in the meantime. Wake() does the same in
+  // reverse order, so at least one of us sees the other one's change:
+  if (TimeoutMs) {
+     *Waiting = 1;
+     FullBarrier();
+     if (LoadAcquire(Index) == Seen) {
+        struct timespec Timeout = { TimeoutMs / 1000, (TimeoutMs % 1000) * 1000000 };
+        syscall(SYS_futex, Waiting, FUTEX_WAIT_PRIVATE, 1, &Timeout, NULL, 0);
+        }
+     *Waiting = 0;
+     }
+}
+
+void cRingBufferLinearSPSC::Wake(volatile int *Waiting)
+{
+  FullBarrier();
+  if (*Waiting && __sync_bool_compare_and_swap(Waiting, 1, 0))
+     syscall(SYS_futex, Waiting, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+int cRingBufferLinearSPSC::Available(void)
+{
+  int diff = LoadAcquire(&head) - LoadAcquire(&tail);
+  return (diff >= 0) ? diff : Size() + diff - margin;
+}
+
+void cRingBufferLinearSPSC::Clear(void)
+{
+  StoreRelease(&tail, LoadAcquire(&head));
+  gotten = 0;
+  maxFill = 0;
+  Wake(&putWaiting);
+}
+
+int cRingBufferLinearSPSC::Read(int FileHandle, int Max)
+{
+  int Head = head;
+  int Tail = LoadAcquire(&tail);
+  int diff = Tail - Head;
+  int free = (diff > 0) ? diff - 1 : Size() - Head;
+  if (Tail <= margin)
+     free--;
+  int Count = 0;
+  if (free > 0) {
+     if (0 < Max && Max < free)
+        free = Max;
+     Count = safe_read(FileHandle, buffer + Head, free);
+     if (Count > 0) {
+        Head += Count;
+        if (Head >= Size())
+           Head = margin;
+        StoreRelease(&head, Head);
+        Wake(&getWaiting);
+        if (statistics) {
+           int fill = Head - Tail;
+           if (fill < 0)
+              fill = Size() + fill;
+           if (fill > maxFill)
+              maxFill = fill;
+           }
+        }
+     }
+  else
+     Sleep(&putWaiting, &tail, Tail, putTimeout);
+  return Count;
+}
+
+int cRingBufferLinearSPSC::Put(const uchar *Data, int Count)
+{
+  if (Count > 0) {
+     int Head = head;
+     int Tail = LoadAcquire(&tail);
+     int rest = Size() - Head;
+     int diff = Tail - Head;
+     int free = ((Tail < margin) ? rest : (diff > 0) ? diff : Size() + diff - margin) - 1;
+     if (free > 0) {
+        if (free < Count)
+           Count = free;
+        if (Count >= rest) {
+           memcpy(buffer + Head, Data, rest);
+           if (Count - rest)
+              memcpy(buffer + margin, Data + rest, Count - rest);
+           Head = margin + Count - rest;
+           }
+        else {
+           memcpy(buffer + Head, Data, Count);
+           Head += Count;
+           }
+        StoreRelease(&head, Head);
+        Wake(&getWaiting);
+        if (statistics) {
+           int fill = Size() - free - 1 + Count;
+           if (fill > maxFill)
+              maxFill = fill;
+           }
+        }
+     else {
+        Count = 0;
+        Sleep(&putWaiting, &tail, Tail, putTimeout);
+        }
+     }
+  return Count;
+}
+
+uchar *cRingBufferLinearSPSC::Get(int &Count)
+{
+  uchar *p = NULL;
+  int Head = LoadAcquire(&head);
+  int Tail = tail;
+  if (getThreadTid <= 0)
+     getThreadTid = cThread::ThreadId();
+  int rest = Size() - Tail;
+  if (rest < margin && Head < Tail) {
+     // The producer never writes below 'margin', so we can safely move the
+     // rest of the data in front of it to get one consecutive block:
+     int t = margin - rest;
+     memcpy(buffer + t, buffer + Tail, rest);
+     Tail = t;
+     StoreRelease(&tail, Tail);
+     rest = Head - Tail;
+     }
+  int diff = Head - Tail;
+  int cont = (diff >= 0) ? diff : Size() + diff - margin;
+  if (cont > rest)
+     cont = rest;
+  if (cont >= margin) {
+     p = buffer + Tail;
+     Count = gotten = cont;
+     }
+  else
+     Sleep(&getWaiting, &head, Head, getTimeout);
+  return p;
+}
+
+void cRingBufferLinearSPSC::Del(int Count)
+{
+  if (Count > gotten) {
+     esyslog("ERROR: invalid Count in cRingBufferLinearSPSC::Del: %d (limited to %d)", Count, gotten);
+     Count = gotten;
+     }
+  if (Count > 0) {
+     int Tail = tail + Count;
+     gotten -= Count;
+     if (Tail >= Size())
+        Tail = margin;
+     StoreRelease(&tail, Tail);
+     Wake(&putWaiting);
+     }
+}
+
 // --- cFrame ----------------------------------------------------------------
 
-cFrame::cFrame(const uchar *Data, int Count, eFrameType Type, int Index)
+cFrame::cFrame(const uchar *Data, int Count, eFrameType Type, int Index, cRingBufferFrame *Pool)
 {
+  pool = Pool;
   count = abs(Count);
   type = Type;
   index = Index;
   if (Count < 0)
      data = (uchar *)Data;
   else {
-     data = MALLOC(uchar, count);
+     data = pool ? pool->Alloc(count) : MALLOC(uchar, count);
      if (data)
         memcpy(data, Data, count);
      else
         esyslog("ERROR: can't allocate frame buffer (count=%d)", count);
      }
-  next = NULL;
 }
 
 cFrame::~cFrame()
 {
-  free(data);
+  if (pool)
+     pool->Release(data);
+  else
+     free(data);
 }
 
 // --- cRingBufferFrame ------------------------------------------------------
 
-cRingBufferFrame::cRingBufferFrame(int Size, bool Statistics)
+#define FRAMESLOTS 256 // initial number of slots in the index ring
+
+// Every block in the frame pool starts with this header:
+
+struct tFrameBlock {
+  int size; // including this header
+  int used;
+  int pad[2]; // keeps the data aligned
+  };
+
+#define FRAMEBLOCKSIZE(Count) ((sizeof(tFrameBlock) + (Count) + sizeof(tFrameBlock) - 1) / sizeof(tFrameBlock) * sizeof(tFrameBlock))
+
+cRingBufferFrame::cRingBufferFrame(int Size, bool Statistics, int MaxFrameSize)
 :cRingBuffer(Size, Statistics)
 {
-  head = NULL;
+  maxFrames = FRAMESLOTS;
+  frames = MALLOC(cFrame *, maxFrames);
+  getIndex = numFrames = 0;
   currentFill = 0;
+  // The pool holds everything that fits into the ring buffer, plus one frame
+  // that is currently being read while the ring buffer is full:
+  poolSize = FRAMEBLOCKSIZE(Size + MaxFrameSize);
+  pool = MALLOC(uchar, poolSize);
+  if (!pool)
+     esyslog("ERROR: can't allocate frame pool (size=%d)", poolSize);
+  poolHead = poolTail = 0;
+  poolWrapped = false;
+  poolUsed = maxPoolUsed = 0;
+  poolAllocs = heapAllocs = 0;
 }
 
 cRingBufferFrame::~cRingBufferFrame()
 {
   Clear();
+  if (statistics) {
+     struct rusage ru;
+     getrusage(RUSAGE_SELF, &ru);
+     dsyslog("frame buffer stats: %d frames from pool (%d of %d bytes used at most), %d from heap, peak RSS %ld KB", poolAllocs, maxPoolUsed, poolSize, heapAllocs, ru.ru_maxrss);
+     }
+  free(frames);
+  free(pool);
+}
+
+uchar *cRingBufferFrame::Alloc(int Count)
+{
+  if (pool && Count > 0) {
+     int Need = FRAMEBLOCKSIZE(Count);
+     int Offset = -1;
+     Lock();
+     if (!poolWrapped) {
+        if (poolSize - poolHead >= Need)
+           Offset = poolHead;
+        else if (poolTail >= Need) {
+           if (poolHead < poolSize) {
+              // skip the rest at the end of the pool:
+              tFrameBlock *b = (tFrameBlock *)(pool + poolHead);
+              b->size = poolSize - poolHead;
+              b->used = false;
+              }
+           poolWrapped = true;
+           Offset = 0;
+           }
+        }
+     else if (poolTail - poolHead >= Need)
+        Offset = poolHead;
+     if (Offset >= 0) {
+        tFrameBlock *b = (tFrameBlock *)(pool + Offset);
+        b->size = Need;
+        b->used = true;
+        poolHead = Offset + Need;
+        poolUsed += Need;
+        if (poolUsed > maxPoolUsed)
+           maxPoolUsed = poolUsed;
+        poolAllocs++;
+        Unlock();
+        return (uchar *)(b + 1);
+        }
+     heapAllocs++;
+     Unlock();
+     }
+  return MALLOC(uchar, Count);
+}
+
+void cRingBufferFrame::Release(uchar *Data)
+{
+  if (pool && Data >= pool && Data < pool + poolSize) {
+     Lock();
+     tFrameBlock *b = (tFrameBlock *)Data - 1;
+     b->used = false;
+     poolUsed -= b->size;
+     // Blocks may be given back in any order, but the pool can only be
+     // reclaimed from its tail:
+     for (;;) {
+         if (poolWrapped && poolTail == poolSize) {
+            poolTail = 0;
+            poolWrapped = false;
+            }
+         if (!poolWrapped && poolTail == poolHead) {
+            poolTail = poolHead = 0;
+            break;
+            }
+         b = (tFrameBlock *)(pool + poolTail);
+         if (b->used)
+            break;
+         poolTail += b->size;
+         }
+     Unlock();
+     }
+  else
+     free(Data);
+}
+
+void cRingBufferFrame::Trim(cFrame *Frame)
+{
+  uchar *Data = Frame->data;
+  if (Frame->pool == this && pool && Data >= pool && Data < pool + poolSize) {
+     tFrameBlock *b = (tFrameBlock *)Data - 1;
+     int Need = FRAMEBLOCKSIZE(Frame->count);
+     if ((uchar *)b + b->size == pool + poolHead && Need < b->size) {
+        // this is the most recent block, so we can give back what it doesn't use:
+        poolHead -= b->size - Need;
+        poolUsed -= b->size - Need;
+        b->size = Need;
+        }
+     }
 }
 
 void cRingBufferFrame::Clear(void)
@@ -382,15 +700,25 @@ bool cRingBufferFrame::Put(cFrame *Frame)
 {
   if (Frame->Count() <= Free()) {
      Lock();
-     if (head) {
-        Frame->next = head->next;
-        head->next = Frame;
-        head = Frame;
-        }
-     else {
-        head = Frame->next = Frame;
+     if (numFrames == maxFrames) {
+        cFrame **f = MALLOC(cFrame *, 2 * maxFrames);
+        if (!f) {
+           Unlock();
+           return false;
+           }
+        for (int i = 0; i < numFrames; i++)
+            f[i] = frames[(getIndex + i) % maxFrames];
+        free(frames);
+        frames = f;
+        maxFrames *= 2;
+        getIndex = 0;
         }
+     frames[(getIndex + numFrames) % maxFrames] = Frame;
+     numFrames++;
+     Trim(Frame);
      currentFill += Frame->Count();
+     if (currentFill > maxFill)
+        maxFill = currentFill;
      Unlock();
      EnableGet();
      return true;
@@ -401,7 +729,7 @@ bool cRingBufferFrame::Put(cFrame *Frame)
 cFrame *cRingBufferFrame::Get(void)
 {
   Lock();
-  cFrame *p = head ? head->next : NULL;
+  cFrame *p = numFrames ? frames[getIndex] : NULL;
   Unlock();
   return p;
 }
@@ -415,16 +743,11 @@ void cRingBufferFrame::Delete(cFrame *Frame)
 void cRingBufferFrame::Drop(cFrame *Frame)
 {
   Lock();
-  if (head) {
-     if (Frame == head->next) {
-        if (head->next != head) {
-           head->next = Frame->next;
-           Delete(Frame);
-           }
-        else {
-           Delete(head);
-           head = NULL;
-           }
+  if (numFrames) {
+     if (Frame == frames[getIndex]) {
+        getIndex = (getIndex + 1) % maxFrames;
+        numFrames--;
+        Delete(Frame);
         }
      else
         esyslog("ERROR: attempt to drop wrong frame from ring buffer!");
@@ -16,13 +16,13 @@
 class cRingBuffer {
 private:
   cCondWait readyForPut, readyForGet;
-  int putTimeout;
-  int getTimeout;
   int size;
   time_t lastOverflowReport;
   int overflowCount;
   int overflowBytes;
 protected:
+  int putTimeout;
+  int getTimeout;
   tThreadId getThreadTid;
   int maxFill;//XXX
   int lastPercent;
@@ -91,21 +91,66 @@ public:
     ///< call to Get().
   };
 
+#define RB_CACHELINE 64 // used to keep the indexes of producer and consumer apart
+
+class cRingBufferLinearSPSC : public cRingBuffer {
+private:
+  int margin;
+  uchar *buffer;
+  char *description;
+  char pad0[RB_CACHELINE];
+  // Written by the producer (Put(), Read()):
+  volatile int head;
+  volatile int putWaiting;
+  char pad1[RB_CACHELINE];
+  // Written by the consumer (Get(), Del(), Clear()):
+  volatile int tail;
+  volatile int getWaiting;
+  int gotten;
+  char pad2[RB_CACHELINE];
+  void Sleep(volatile int *Waiting, volatile int *Index, int Seen, int TimeoutMs);
+  void Wake(volatile int *Waiting);
+public:
+  cRingBufferLinearSPSC(int Size, int Margin = 0, bool Statistics = false, const char *Description = NULL);
+    ///< Creates a linear ring buffer for exactly one producer thread (calling
+    ///< Put() or Read()) and one consumer thread (calling Get(), Del() and Clear()).
+    ///< It has the same interface and semantics as cRingBufferLinear, but
+    ///< doesn't take any locks. The indexes are exchanged with acquire/release
+    ///< semantics, and a thread that has to wait because the buffer is full
+    ///< (or empty) sleeps on a futex that the other side only wakes up if
+    ///< there actually is a sleeper.
+  virtual ~cRingBufferLinearSPSC();
+  virtual int Available(void);
+  virtual int Free(void) { return Size() - Available() - 1 - margin; }
+  virtual void Clear(void);
+    ///< Immediately clears the ring buffer. Must only be called by the consumer.
+  int Read(int FileHandle, int Max = 0);
+  int Put(const uchar *Data, int Count);
+  uchar *Get(int &Count);
+  void Del(int Count);
+    ///< See cRingBufferLinear.
+  };
+
 enum eFrameType { ftUnknown, ftVideo, ftAudio, ftDolby };
 
+class cRingBufferFrame;
+
 class cFrame {
   friend class cRingBufferFrame;
 private:
-  cFrame *next;
+  cRingBufferFrame *pool;
   uchar *data;
   int count;
   eFrameType type;
   int index;
 public:
-  cFrame(const uchar *Data, int Count, eFrameType = ftUnknown, int Index = -1);
+  cFrame(const uchar *Data, int Count, eFrameType = ftUnknown, int Index = -1, cRingBufferFrame *Pool = NULL);
     ///< Creates a new cFrame object.
     ///< If Count is negative, the cFrame object will take ownership of the given
     ///< Data. Otherwise it will allocate Count bytes of memory and copy Data.
+    ///< If Pool is given, the memory is allocated with (or, if Count is negative,
+    ///< must have been allocated with) Pool->Alloc(), and is given back to Pool
+    ///< when the cFrame is deleted.
   ~cFrame();
   uchar *Data(void) const { return data; }
   int Count(void) const { return count; }
@@ -116,13 +161,25 @@ public:
 class cRingBufferFrame : public cRingBuffer {
 private:
   cMutex mutex;
-  cFrame *head;
+  cFrame **frames;
+  int maxFrames;
+  int getIndex, numFrames;
   int currentFill;
+  uchar *pool;
+  int poolSize, poolHead, poolTail;
+  bool poolWrapped;
+  int poolUsed, maxPoolUsed;
+  int poolAllocs, heapAllocs;
+  void Trim(cFrame *Frame);
   void Delete(cFrame *Frame);
   void Lock(void) { mutex.Lock(); }
   void Unlock(void) { mutex.Unlock(); }
 public:
-  cRingBufferFrame(int Size, bool Statistics = false);
+  cRingBufferFrame(int Size, bool Statistics = false, int MaxFrameSize = 0);
+    // Creates a frame ring buffer that holds at most Size bytes of frame data.
+    // The frames are kept in an index ring, and their data can be taken from
+    // a pool owned by the ring buffer (see Alloc()), which is large enough for
+    // Size bytes plus one additional frame of MaxFrameSize bytes.
   virtual ~cRingBufferFrame();
   virtual int Available(void);
   virtual void Clear(void);
@@ -135,6 +192,13 @@ public:
     // The actual data still remains in the buffer until Drop() is called.
   void Drop(cFrame *Frame);
     // Drops the Frame that has just been fetched with Get().
+  uchar *Alloc(int Count);
+    // Allocates Count bytes for frame data from the pool of this ring buffer.
+    // Falls back to the heap if the pool is currently exhausted.
+    // The data must either be handed over to a cFrame with this ring buffer
+    // as its Pool, or be given back with Release().
+  void Release(uchar *Data);
+    // Gives back Data that has been allocated with Alloc().
   };
 
 #endif // __RINGBUFFER_H
@@ -164,7 +164,7 @@ void cSectionHandler::SetStatus(bool On)
 
 void cSectionHandler::Action(void)
 {
-  SetPriority(19);
+  SetThreadClass(tcSection);
   while (Running()) {
 
         Lock();
@@ -197,10 +197,12 @@ const char *HelpPages[] = {
   "    RECORDING - BE SURE YOU KNOW WHAT YOU ARE DOING!",
   "DELT <number>\n"
   "    Delete timer.",
-  "EDIT <number>\n"
+  "EDIT [ <number> ]\n"
   "    Edit the recording with the given number. Before a recording can be\n"
   "    edited, an LSTR command must have been executed in order to retrieve\n"
-  "    the recording numbers.",
+  "    the recording numbers. Several recordings can be edited at the same\n"
+  "    time. Without option, the progress and estimated remaining time of\n"
+  "    all recordings that are being edited is listed.",
   "GRAB <filename> [ <quality> [ <sizex> <sizey> ] ]\n"
   "    Grab the current frame and save it to the given file. Images can\n"
   "    be stored as JPEG or PNM, depending on the given file name extension.\n"
@@ -649,7 +651,7 @@ void cSVDRP::CmdEDIT(const char *Option)
         if (recording) {
            cMarks Marks;
            if (Marks.Load(recording->FileName()) && Marks.Count()) {
-              if (!cCutter::Active()) {
+              if (!cCutter::Active(recording->FileName())) {
                  if (cCutter::Start(recording->FileName()))
                     Reply(250, "Editing recording \"%s\" [%s]", Option, recording->Title());
                  else
@@ -667,8 +669,21 @@ void cSVDRP::CmdEDIT(const char *Option)
      else
         Reply(501, "Error in recording number \"%s\"", Option);
      }
-  else
-     Reply(501, "Missing recording number");
+  else {
+     const char *FileName;
+     int Percent, Eta;
+     if (cCutter::Progress(0, &FileName, &Percent, &Eta)) {
+        for (int i = 0; cCutter::Progress(i, &FileName, &Percent, &Eta); i++) {
+            cRecording *recording = Recordings.GetByName(FileName);
+            char Time[16] = "-";
+            if (Eta >= 0)
+               snprintf(Time, sizeof(Time), "%d:%02d:%02d", Eta / 3600, Eta / 60 % 60, Eta % 60);
+            Reply(cCutter::Progress(i + 1, NULL, NULL, NULL) ? -250 : 250, "%d%% %s %s", Percent, Time, recording ? recording->Title() : FileName);
+            }
+        }
+     else
+        Reply(550, "No editing process active");
+     }
 }
 
 void cSVDRP::CmdGRAB(const char *Option)
@@ -11,7 +11,9 @@
 #include <errno.h>
 #include <linux/unistd.h>
 #include <malloc.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
@@ -294,6 +296,51 @@ void cFairMutex::Unlock()
 
 tThreadId cThread::mainThreadId = 0;
 bool cThread::emergencyExitRequested = false;
+bool cThread::threadPoliciesSet = false;
+
+#ifndef SCHED_BATCH
+#define SCHED_BATCH 3
+#endif
+#ifndef SCHED_IDLE
+#define SCHED_IDLE  5
+#endif
+
+#define SCHED_KEEP  (-1) // leave the scheduling policy and priority alone
+
+struct tThreadPolicy {
+  const char *name;
+  bool affinity;
+  cpu_set_t cpus; // an empty set stands for all CPUs
+  int scheduler;
+  int priority;
+  char *setting;
+  };
+
+// The defaults reproduce what the individual threads used to do themselves.
+// 'Default' also allows all CPUs, so that a new thread doesn't keep the
+// affinity of the thread that created it:
+
+static tThreadPolicy ThreadPolicies[MAXTHREADCLASSES] = {
+  { "Default",    true,  {}, SCHED_OTHER,  0, NULL },
+  { "Receive",    false, {}, SCHED_OTHER, -5, NULL },
+  { "Remux",      false, {}, SCHED_KEEP,   0, NULL },
+  { "FileWriter", false, {}, SCHED_KEEP,   0, NULL },
+  { "Section",    false, {}, SCHED_OTHER, 19, NULL },
+  { "Ui",         false, {}, SCHED_KEEP,   0, NULL },
+  { "Background", false, {}, SCHED_OTHER, 18, NULL },
+  };
+
+static struct {
+  const char *name;
+  int scheduler;
+  } Schedulers[] = {
+  { "other", SCHED_OTHER },
+  { "batch", SCHED_BATCH },
+  { "idle",  SCHED_IDLE  },
+  { "fifo",  SCHED_FIFO  },
+  { "rr",    SCHED_RR    },
+  { NULL,    0           }
+  };
 
 cThread::cThread(const char *Description)
 {
@@ -332,6 +379,8 @@ void cThread::SetDescription(const char *Description, ...)
 void *cThread::StartThread(cThread *Thread)
 {
   Thread->childThreadId = ThreadId();
+  if (threadPoliciesSet)
+     SetThreadClass(tcDefault); // don't inherit the creator's policy
   if (Thread->description)
      dsyslog("%s thread started (pid=%d, tid=%d)", Thread->description, getpid(), Thread->childThreadId);
   Thread->Action();
@@ -422,6 +471,106 @@ void cThread::SetMainThreadId(void)
      esyslog("ERROR: attempt to set main thread id to %d while it already is %d", ThreadId(), mainThreadId);
 }
 
+static void AllCpus(cpu_set_t *Set)
+{
+  CPU_ZERO(Set);
+  for (int i = min(int(sysconf(_SC_NPROCESSORS_CONF)), CPU_SETSIZE); i-- > 0; )
+      CPU_SET(i, Set);
+}
+
+void cThread::SetThreadClass(eThreadClass Class)
+{
+  const tThreadPolicy *p = &ThreadPolicies[Class];
+  if (p->affinity) {
+     cpu_set_t Cpus = p->cpus;
+     if (!CPU_COUNT(&Cpus))
+        AllCpus(&Cpus);
+     if (sched_setaffinity(0, sizeof(Cpus), &Cpus) < 0)
+        LOG_ERROR;
+     }
+  if (p->scheduler != SCHED_KEEP) {
+     bool RealTime = p->scheduler == SCHED_FIFO || p->scheduler == SCHED_RR;
+     struct sched_param Param;
+     Param.sched_priority = RealTime ? p->priority : 0;
+     int err = pthread_setschedparam(pthread_self(), p->scheduler, &Param);
+     if (err)
+        esyslog("ERROR: can't set scheduling policy of thread class '%s': %s", p->name, strerror(err));
+     if (!RealTime && setpriority(PRIO_PROCESS, 0, p->priority) < 0)
+        LOG_ERROR;
+     }
+}
+
+const char *cThread::ThreadClassName(eThreadClass Class)
+{
+  return ThreadPolicies[Class].name;
+}
+
+bool cThread::SetThreadPolicy(const char *ClassName, const char *Policy)
+{
+  tThreadPolicy *p = NULL;
+  for (int i = 0; i < MAXTHREADCLASSES; i++) {
+      if (strcasecmp(ThreadPolicies[i].name, ClassName) == 0) {
+         p = &ThreadPolicies[i];
+         break;
+         }
+      }
+  if (!p)
+     return false;
+  char Cpus[64], Scheduler[16];
+  int Priority;
+  if (sscanf(Policy, "%63s %15s %d", Cpus, Scheduler, &Priority) != 3)
+     return false;
+  cpu_set_t Set;
+  CPU_ZERO(&Set);
+  if (strcmp(Cpus, "*") == 0)
+     AllCpus(&Set);
+  else {
+     for (char *s = Cpus; *s; ) {
+         char *t;
+         int First = strtol(s, &t, 10);
+         int Last = First;
+         if (t == s)
+            return false;
+         if (*t == '-') {
+            s = t + 1;
+            Last = strtol(s, &t, 10);
+            if (t == s)
+               return false;
+            }
+         if (First < 0 || Last < First || Last >= CPU_SETSIZE)
+            return false;
+         for (int i = First; i <= Last; i++)
+             CPU_SET(i, &Set);
+         s = t;
+         if (*s == ',')
+            s++;
+         else if (*s)
+            return false;
+         }
+     }
+  int i = 0;
+  while (Schedulers[i].name && strcasecmp(Schedulers[i].name, Scheduler) != 0)
+        i++;
+  if (!Schedulers[i].name)
+     return false;
+  bool RealTime = Schedulers[i].scheduler == SCHED_FIFO || Schedulers[i].scheduler == SCHED_RR;
+  if (RealTime ? Priority < sched_get_priority_min(Schedulers[i].scheduler) || Priority > sched_get_priority_max(Schedulers[i].scheduler) : Priority < -20 || Priority > 19)
+     return false;
+  p->affinity = true;
+  p->cpus = Set;
+  p->scheduler = Schedulers[i].scheduler;
+  p->priority = Priority;
+  free(p->setting);
+  p->setting = strdup(Policy);
+  threadPoliciesSet = true;
+  return true;
+}
+
+const char *cThread::ThreadPolicy(eThreadClass Class)
+{
+  return ThreadPolicies[Class].setting;
+}
+
 // --- cMutexLock ------------------------------------------------------------
 
 cMutexLock::cMutexLock(cMutex *Mutex)
@@ -474,6 +623,289 @@ bool cThreadLock::Lock(cThread *Thread)
   return false;
 }
 
+// --- cAsyncReader ----------------------------------------------------------
+
+// There is one reader thread per device, so that a slow disk only delays the
+// requests that read from it. The data is read into the reader's own buffer
+// and copied into the request's buffer afterwards, so that a request can be
+// cancelled while it's being read without waiting for the disk.
+
+enum eReadState { rsIdle, rsQueued, rsBusy, rsDone };
+
+class cAsyncReader : public cThread {
+private:
+  static cAsyncReader *readers;
+  cAsyncReader *next;
+  dev_t device;
+  cReadRequest *queue;
+  unsigned char *data;
+  int size;
+  cAsyncReader(dev_t Device);
+  virtual ~cAsyncReader();
+  cReadRequest *Next(void);
+protected:
+  virtual void Action(void);
+public:
+  static cMutex mutex;
+  static cCondVar queued;
+  static cCondVar completed;
+  static void Enqueue(cReadRequest *Request);
+  static void Dequeue(cReadRequest *Request);
+  static void Shutdown(void);
+  };
+
+cAsyncReader *cAsyncReader::readers = NULL;
+cMutex cAsyncReader::mutex;
+cCondVar cAsyncReader::queued;
+cCondVar cAsyncReader::completed;
+
+cAsyncReader::cAsyncReader(dev_t Device)
+:cThread("async reader")
+{
+  next = NULL;
+  device = Device;
+  queue = NULL;
+  data = NULL;
+  size = 0;
+}
+
+cAsyncReader::~cAsyncReader()
+{
+  free(data);
+}
+
+void cAsyncReader::Enqueue(cReadRequest *Request)
+{
+  // must be called with mutex locked!
+  cAsyncReader *Reader = readers;
+  while (Reader && Reader->device != Request->device)
+        Reader = Reader->next;
+  if (!Reader) {
+     Reader = new cAsyncReader(Request->device);
+     Reader->next = readers;
+     readers = Reader;
+     Reader->Start();
+     }
+  // requests of the same priority are served in the order they came in:
+  cReadRequest **p = &Reader->queue;
+  while (*p && (*p)->priority <= Request->priority)
+        p = &(*p)->next;
+  Request->next = *p;
+  *p = Request;
+  Request->state = rsQueued;
+  queued.Broadcast();
+}
+
+void cAsyncReader::Dequeue(cReadRequest *Request)
+{
+  // must be called with mutex locked!
+  for (cAsyncReader *Reader = readers; Reader; Reader = Reader->next) {
+      if (Reader->device == Request->device) {
+         for (cReadRequest **p = &Reader->queue; *p; p = &(*p)->next) {
+             if (*p == Request) {
+                *p = Request->next;
+                Request->next = NULL;
+                break;
+                }
+             }
+         break;
+         }
+      }
+}
+
+cReadRequest *cAsyncReader::Next(void)
+{
+  // must be called with mutex locked!
+  // A request that has been cancelled while being read by the reader of some
+  // other device and then submitted again has to wait for that read to end:
+  for (cReadRequest **p = &queue; *p; p = &(*p)->next) {
+      cReadRequest *r = *p;
+      if (!r->reading) {
+         *p = r->next;
+         r->next = NULL;
+         return r;
+         }
+      }
+  return NULL;
+}
+
+void cAsyncReader::Shutdown(void)
+{
+  mutex.Lock();
+  cAsyncReader *Readers = readers;
+  for (cAsyncReader *Reader = Readers; Reader; Reader = Reader->next)
+      Reader->Cancel(-1);
+  queued.Broadcast();
+  mutex.Unlock();
+  for (cAsyncReader *Reader = Readers; Reader; Reader = Reader->next)
+      Reader->Cancel(3);
+  mutex.Lock();
+  // whoever still waits for a request gets an error:
+  for (cAsyncReader *Reader = Readers; Reader; Reader = Reader->next) {
+      while (cReadRequest *r = Reader->queue) {
+            Reader->queue = r->next;
+            r->next = NULL;
+            r->error = ECANCELED;
+            r->state = rsDone;
+            }
+      }
+  readers = NULL;
+  completed.Broadcast();
+  mutex.Unlock();
+  while (cAsyncReader *Reader = Readers) {
+        Readers = Reader->next;
+        delete Reader;
+        }
+}
+
+void cAsyncReader::Action(void)
+{
+  SetThreadClass(tcRemux);
+  cMutexLock MutexLock(&mutex);
+  while (Running()) {
+        cReadRequest *r = Next();
+        if (!r) {
+           queued.TimedWait(mutex, 1000);
+           continue;
+           }
+        r->state = rsBusy;
+        r->reading = true;
+        int Wanted = r->wanted;
+        int Length = 0;
+        int Error = 0;
+        if (Wanted > size) {
+           unsigned char *p = (unsigned char *)realloc(data, Wanted);
+           if (p) {
+              data = p;
+              size = Wanted;
+              }
+           else
+              Error = ENOMEM;
+           }
+        mutex.Unlock();
+        while (!Error && Length < Wanted) {
+              int n = r->DoRead(data + Length, Wanted - Length);
+              if (n > 0)
+                 Length += n;
+              else if (n < 0 && errno == EINTR)
+                 continue;
+              else {
+                 if (n < 0 && Length == 0)
+                    Error = errno ? errno : EIO;
+                 break; // n == 0 means EOF
+                 }
+              }
+        mutex.Lock();
+        r->reading = false;
+        if (r->state == rsBusy) {
+           memcpy(r->buffer, data, Length);
+           r->length = Length;
+           r->error = Error;
+           r->state = rsDone;
+           }
+        else if (r->state == rsQueued)
+           queued.Broadcast(); // it has been cancelled and submitted again
+        completed.Broadcast();
+        }
+}
+
+// --- cReadRequest ----------------------------------------------------------
+
+cReadRequest::cReadRequest(void)
+{
+  next = NULL;
+  priority = rpFrame;
+  device = 0;
+  buffer = NULL;
+  wanted = length = 0;
+  error = 0;
+  state = rsIdle;
+  reading = false;
+}
+
+cReadRequest::~cReadRequest()
+{
+  Cancel();
+  WaitIdle();
+}
+
+bool cReadRequest::Submit(unsigned char *Buffer, int Size, eReadPriority Priority)
+{
+  dev_t Dev = Device();
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  if (state != rsIdle)
+     return false;
+  buffer = Buffer;
+  wanted = Size;
+  length = 0;
+  error = 0;
+  priority = Priority;
+  device = Dev;
+  cAsyncReader::Enqueue(this);
+  return true;
+}
+
+bool cReadRequest::Pending(void)
+{
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  return state != rsIdle;
+}
+
+bool cReadRequest::Done(void)
+{
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  return state == rsDone;
+}
+
+int cReadRequest::Result(void)
+{
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  if (state != rsDone) {
+     errno = EAGAIN;
+     return -1;
+     }
+  state = rsIdle;
+  if (error) {
+     errno = error;
+     return -1;
+     }
+  return length;
+}
+
+bool cReadRequest::Wait(int TimeoutMs)
+{
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  uint64_t Timeout = cTimeMs::Now() + TimeoutMs;
+  while (state != rsDone) {
+        uint64_t Now = cTimeMs::Now();
+        if (Now >= Timeout)
+           break;
+        cAsyncReader::completed.TimedWait(cAsyncReader::mutex, int(Timeout - Now));
+        }
+  return state == rsDone;
+}
+
+void cReadRequest::Shutdown(void)
+{
+  cAsyncReader::Shutdown();
+}
+
+void cReadRequest::Cancel(void)
+{
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  if (state == rsQueued)
+     cAsyncReader::Dequeue(this);
+  state = rsIdle;
+  cAsyncReader::completed.Broadcast();
+}
+
+void cReadRequest::WaitIdle(void)
+{
+  cMutexLock MutexLock(&cAsyncReader::mutex);
+  while (reading)
+        cAsyncReader::completed.Wait(cAsyncReader::mutex);
+}
+
 // --- cPipe -----------------------------------------------------------------
 
 // cPipe::Open() and cPipe::Close() are based on code originally received from
@@ -108,6 +108,10 @@ private:
 
 typedef pid_t tThreadId;
 
+enum eThreadClass { tcDefault, tcReceive, tcRemux, tcFileWriter, tcSection, tcUi, tcBackground };
+
+#define MAXTHREADCLASSES (tcBackground + 1)
+
 class cThread {
   friend class cThreadLock;
 private:
@@ -120,6 +124,7 @@ private:
   static tThreadId mainThreadId;
   static bool emergencyExitRequested;
   static void *StartThread(cThread *Thread);
+  static bool threadPoliciesSet;
 protected:
   void SetPriority(int Priority);
   virtual void Lock(void) { mutex.Lock(); }
@@ -155,6 +160,21 @@ public:
   static tThreadId ThreadId(void);
   static tThreadId IsMainThread(void) { return ThreadId() == mainThreadId; }
   static void SetMainThreadId(void);
+  static void SetThreadClass(eThreadClass Class);
+       ///< Applies the CPU affinity, scheduling policy and priority of the
+       ///< given thread Class to the calling thread.
+  static const char *ThreadClassName(eThreadClass Class);
+  static bool SetThreadPolicy(const char *ClassName, const char *Policy);
+       ///< Sets the policy of the thread class with the given ClassName.
+       ///< Policy is of the form "<cpus> <scheduler> <priority>", where <cpus>
+       ///< is a list of CPU numbers and ranges (like "0,2-3") or "*" for all
+       ///< CPUs, <scheduler> is one of "other", "batch", "idle", "fifo" or "rr",
+       ///< and <priority> is the nice value for the first three and the
+       ///< real-time priority for "fifo" and "rr". Returns false if ClassName
+       ///< or Policy is invalid.
+  static const char *ThreadPolicy(eThreadClass Class);
+       ///< Returns the policy of the given thread Class as it was set with
+       ///< SetThreadPolicy(), or NULL if it hasn't been set.
   };
 
 #ifdef USE_FAIR_MUTEX
@@ -211,6 +231,66 @@ public:
 
 #define LOCK_THREAD cThreadLock ThreadLock(this)
 
+// cReadRequest is a read operation that is carried out in the background by
+// a reader thread, of which there is one for each disk. The caller can do
+// other things in the meantime and gets woken up as soon as the data has
+// arrived. Any number of requests may be outstanding at the same time; those
+// with the higher priority are served first.
+
+enum eReadPriority { rpFrame, rpPrefetch };
+
+class cReadRequest {
+  friend class cAsyncReader;
+private:
+  cReadRequest *next;
+  eReadPriority priority;
+  dev_t device;
+  unsigned char *buffer;
+  int wanted;
+  int length;
+  int error;
+  int state;
+  bool reading;
+protected:
+  virtual int DoRead(unsigned char *Data, int Size) = 0;
+       ///< Reads up to Size bytes into Data and returns the number of bytes
+       ///< read, 0 at the end of the file, or -1 in case of an error (with
+       ///< errno set). This is called from a reader thread. A derived class
+       ///< must call Cancel() and WaitIdle() in its destructor.
+  virtual dev_t Device(void) { return 0; }
+       ///< Returns the device the data is read from. Requests for different
+       ///< devices are read in parallel. Called from Submit().
+public:
+  cReadRequest(void);
+  virtual ~cReadRequest();
+  bool Submit(unsigned char *Buffer, int Size, eReadPriority Priority = rpFrame);
+       ///< Queues reading Size bytes into Buffer. Returns false if this request
+       ///< has already been submitted and its result hasn't been fetched yet.
+  bool Pending(void);
+       ///< Returns true if the request has been submitted and not yet fetched
+       ///< with Result() or withdrawn with Cancel().
+  bool Done(void);
+       ///< Returns true if the data has been read.
+  int Result(void);
+       ///< Returns the number of bytes that have been read, which is less than
+       ///< the requested size only at the end of the file, or -1 in case of an
+       ///< error (with errno set). Afterwards the request can be submitted again.
+  bool Wait(int TimeoutMs);
+       ///< Waits until the data has been read, or TimeoutMs have passed.
+       ///< Returns true if the data has been read.
+  void Cancel(void);
+       ///< Withdraws the request without waiting. If it is being read right
+       ///< now, the data is discarded, and the buffer can be reused at once.
+  void WaitIdle(void);
+       ///< Waits until a read that has been cancelled while in progress has
+       ///< actually finished. Must be called before the file DoRead() reads
+       ///< from is moved or closed.
+  static void Shutdown(void);
+       ///< Stops the reader threads. Requests that are still queued are
+       ///< completed with an error. Must be called at program exit, once no
+       ///< more requests are being submitted.
+  };
+
 // cPipe implements a pipe that closes all unnecessary file descriptors in
 // the child process.
 
@@ -23,6 +23,8 @@
 
 // -- cTimer -----------------------------------------------------------------
 
+int cTimer::changes = 0;
+
 cTimer::cTimer(bool Instant, bool Pause, cChannel *Channel)
 {
   startTime = stopTime = 0;
@@ -123,6 +125,7 @@ cTimer& cTimer::operator= (const cTimer &Timer)
      free(aux);
      aux = Timer.aux ? strdup(Timer.aux) : NULL;
      event = NULL;
+     Changed();
      }
   return *this;
 }
@@ -311,6 +314,7 @@ bool cTimer::Parse(const char *s)
         }
      }
   fskProtection = aux && strstr(aux, "<pin-plugin><protected>yes</protected></pin-plugin>");  // PIN PATCH
+  Changed();
   free(channelbuffer);
   free(daybuffer);
   free(filebuffer);
@@ -407,8 +411,10 @@ bool cTimer::Matches(time_t t, bool Directly, int Margin) const
          }
      if (!startTime)
         startTime = IncDay(t, 7); // just to have something that's more than a week in the future
-     else if (!Directly && (t > startTime || t > day + SECSINDAY + 3600)) // +3600 in case of DST change
+     else if (!Directly && day && (t > startTime || t > day + SECSINDAY + 3600)) { // +3600 in case of DST change
         day = 0;
+        Changed();
+        }
      }
 
   if (HasFlags(tfActive)) {
@@ -581,16 +587,19 @@ void cTimer::SetPriority(int Priority)
 void cTimer::SetFlags(uint Flags)
 {
   flags |= Flags;
+  Changed();
 }
 
 void cTimer::ClrFlags(uint Flags)
 {
   flags &= ~Flags;
+  Changed();
 }
 
 void cTimer::InvFlags(uint Flags)
 {
   flags ^= Flags;
+  Changed();
 }
 
 bool cTimer::HasFlags(uint Flags) const
@@ -602,6 +611,7 @@ void cTimer::Skip(void)
 {
   day = IncDay(SetTime(StartTime(), 0), 1);
   startTime = 0;
+  Changed();
   SetEvent(NULL);
 }
 
@@ -621,6 +631,205 @@ void cTimer::OnOff(void)
   Matches(); // refresh start and end time
 }
 
+// -- cTimerMatchIndex -------------------------------------------------------
+
+#define MATCHINDEXDAYS     8    // occurrences of repeating timers are indexed this many days ahead
+#define MATCHINDEXREFRESH  3600 // seconds after which the index is rebuilt to move its time window along
+#define MAXMATCHCANDIDATES 64
+
+struct tTimerOccurrence {
+  time_t start, stop;
+  unsigned int channelHash;
+  cTimer *timer;
+  int position; // of the timer in the list
+  };
+
+static int CompareOccurrences(const void *a, const void *b)
+{
+  const tTimerOccurrence *oa = (const tTimerOccurrence *)a;
+  const tTimerOccurrence *ob = (const tTimerOccurrence *)b;
+  if (oa->channelHash != ob->channelHash)
+     return oa->channelHash < ob->channelHash ? -1 : 1;
+  return oa->start < ob->start ? -1 : oa->start > ob->start ? 1 : 0;
+}
+
+static int CompareCandidates(const void *a, const void *b)
+{
+  return (*(const tTimerOccurrence **)a)->position - (*(const tTimerOccurrence **)b)->position;
+}
+
+class cTimerMatchIndex {
+private:
+  time_t built;
+  time_t windowStart, windowEnd;
+  int listState, timersState, timerChanges;
+  tTimerOccurrence *occurrences; // sorted by channel and start time
+  int numOccurrences;
+  time_t *byTimer;               // start/stop pairs of all occurrences, in list order
+  int *first;                    // per timer: index of its first pair in byTimer
+  int numTimers;
+  const cChannel **channels;     // the channels of the active timers...
+  unsigned int *channelHashes;   // ...and the hashes of their ids at the time the index was built
+  int numChannels;
+  bool Inside(time_t From, time_t To) const { return windowStart + SECSINDAY <= From && To + SECSINDAY <= windowEnd; }
+public:
+  cTimerMatchIndex(cTimers *Timers, int TimersState);
+  ~cTimerMatchIndex();
+  bool Valid(cTimers *Timers, int TimersState) const;
+  bool Covers(int Position, time_t t) const;
+       ///< Returns false if the timer at the given Position doesn't hit at time t,
+       ///< which is the case if cTimer::Matches(t) would return false (unless the
+       ///< timer uses VPS, which has to be checked separately). Returns true if it
+       ///< hits, or if t is outside of the time window covered by the index.
+  int Candidates(const cEvent *Event, cTimer **Timers, int Max) const;
+       ///< Stores the timers that may match the given Event in Timers, in list
+       ///< order, and returns their number. Returns -1 if the index can't tell.
+  };
+
+cTimerMatchIndex::cTimerMatchIndex(cTimers *Timers, int TimersState)
+{
+  built = time(NULL);
+  listState = Timers->ListState();
+  timersState = TimersState;
+  timerChanges = cTimer::Changes();
+  numTimers = Timers->Count();
+  windowStart = cTimer::SetTime(cTimer::IncDay(built, -1), 0);
+  windowEnd = cTimer::SetTime(cTimer::IncDay(built, MATCHINDEXDAYS + 1), 0);
+  int Size = 16;
+  occurrences = MALLOC(tTimerOccurrence, Size);
+  numOccurrences = 0;
+  first = MALLOC(int, numTimers + 1);
+  channels = NULL;
+  channelHashes = NULL;
+  numChannels = 0;
+  int Position = 0;
+  for (cTimer *ti = Timers->First(); ti; ti = Timers->Next(ti), Position++) {
+      first[Position] = numOccurrences;
+      if (!ti->HasFlags(tfActive) || !ti->Channel())
+         continue; // inactive timers never match
+      unsigned int ChannelHash = ti->Channel()->GetChannelID().Hash();
+      if (!numChannels || channels[numChannels - 1] != ti->Channel()) {
+         channels = (const cChannel **)realloc(channels, (numChannels + 1) * sizeof(const cChannel *));
+         channelHashes = (unsigned int *)realloc(channelHashes, (numChannels + 1) * sizeof(unsigned int));
+         channels[numChannels] = ti->Channel();
+         channelHashes[numChannels++] = ChannelHash;
+         }
+      // this must produce the same times as cTimer::Matches():
+      int begin  = cTimer::TimeToInt(ti->Start());
+      int length = cTimer::TimeToInt(ti->Stop()) - begin;
+      if (length < 0)
+         length += SECSINDAY;
+      for (int i = -1; i <= MATCHINDEXDAYS; i++) {
+          time_t a;
+          if (ti->IsSingleEvent()) {
+             if (i >= 0)
+                break;
+             a = cTimer::SetTime(ti->Day(), begin);
+             }
+          else {
+             time_t t0 = cTimer::IncDay(built, i);
+             if (!ti->DayMatches(t0))
+                continue;
+             a = cTimer::SetTime(t0, begin);
+             if (ti->Day() && a < ti->Day())
+                continue;
+             }
+          if (numOccurrences >= Size) {
+             Size *= 2;
+             occurrences = (tTimerOccurrence *)realloc(occurrences, Size * sizeof(tTimerOccurrence));
+             }
+          tTimerOccurrence *o = &occurrences[numOccurrences++];
+          o->start = a;
+          o->stop = a + length;
+          o->channelHash = ChannelHash;
+          o->timer = ti;
+          o->position = Position;
+          }
+      }
+  first[Position] = numOccurrences;
+  byTimer = MALLOC(time_t, 2 * max(numOccurrences, 1));
+  for (int i = 0; i < numOccurrences; i++) {
+      byTimer[2 * i] = occurrences[i].start;
+      byTimer[2 * i + 1] = occurrences[i].stop;
+      }
+  qsort(occurrences, numOccurrences, sizeof(tTimerOccurrence), CompareOccurrences);
+}
+
+cTimerMatchIndex::~cTimerMatchIndex()
+{
+  free(occurrences);
+  free(byTimer);
+  free(first);
+  free(channels);
+  free(channelHashes);
+}
+
+bool cTimerMatchIndex::Valid(cTimers *Timers, int TimersState) const
+{
+  if (listState != Timers->ListState() || timersState != TimersState || timerChanges != cTimer::Changes() || time(NULL) - built >= MATCHINDEXREFRESH)
+     return false;
+  // the id of a channel may change without any of the timers being touched:
+  for (int i = 0; i < numChannels; i++) {
+      if (channels[i]->GetChannelID().Hash() != channelHashes[i])
+         return false;
+      }
+  return true;
+}
+
+bool cTimerMatchIndex::Covers(int Position, time_t t) const
+{
+  if (Position >= numTimers || !Inside(t, t))
+     return true;
+  for (int i = first[Position]; i < first[Position + 1]; i++) {
+      if (byTimer[2 * i] <= t && t < byTimer[2 * i + 1])
+         return true;
+      }
+  return false;
+}
+
+int cTimerMatchIndex::Candidates(const cEvent *Event, cTimer **Timers, int Max) const
+{
+  time_t From = Event->StartTime();
+  time_t To = Event->EndTime();
+  time_t Vps = Event->Vps();
+  if (Vps) {
+     From = min(From, Vps);
+     To = max(To, Vps);
+     }
+  if (!Inside(From, To))
+     return -1;
+  // find the first occurrence on this channel that might reach into the event
+  // (a timer is never longer than a day):
+  tTimerOccurrence Key;
+  Key.channelHash = Event->ChannelID().Hash();
+  Key.start = From - SECSINDAY;
+  int lo = 0, hi = numOccurrences;
+  while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (CompareOccurrences(&occurrences[mid], &Key) < 0)
+           lo = mid + 1;
+        else
+           hi = mid;
+        }
+  const tTimerOccurrence *Found[MAXMATCHCANDIDATES];
+  int n = 0;
+  for (int i = lo; i < numOccurrences && occurrences[i].channelHash == Key.channelHash && occurrences[i].start <= To; i++) {
+      const tTimerOccurrence *o = &occurrences[i];
+      if ((o->stop >= Event->StartTime() && o->start <= Event->EndTime()) || o->start == Vps) {
+         if (n >= MAXMATCHCANDIDATES)
+            return -1;
+         Found[n++] = o;
+         }
+      }
+  qsort(Found, n, sizeof(tTimerOccurrence *), CompareCandidates);
+  int Count = 0;
+  for (int i = 0; i < n && Count < Max; i++) {
+      if (!Count || Timers[Count - 1] != Found[i]->timer)
+         Timers[Count++] = Found[i]->timer;
+      }
+  return Count;
+}
+
 // -- cTimers ----------------------------------------------------------------
 
 cTimers Timers;
@@ -631,6 +840,21 @@ cTimers::cTimers(void)
   beingEdited = 0;;
   lastSetEvents = 0;
   lastDeleteExpired = 0;
+  matchIndex = NULL;
+}
+
+cTimers::~cTimers()
+{
+  delete matchIndex;
+}
+
+cTimerMatchIndex *cTimers::MatchIndex(void)
+{
+  if (!matchIndex || !matchIndex->Valid(this, state)) {
+     delete matchIndex;
+     matchIndex = new cTimerMatchIndex(this, state);
+     }
+  return matchIndex;
 }
 
 cTimer *cTimers::GetTimer(cTimer *Timer)
@@ -649,11 +873,27 @@ cTimer *cTimers::GetMatch(time_t t)
 {
   static int LastPending = -1;
   cTimer *t0 = NULL;
-  for (cTimer *ti = First(); ti; ti = Next(ti)) {
-      if (!ti->Recording() && (ti->Matches(t) || cLiveBufferManager::InLiveBuffer(ti))) {
+  if (t == 0)
+     t = time(NULL);
+  cMutexLock MutexLock(&matchIndexMutex);
+  cTimerMatchIndex *Index = MatchIndex();
+  int i = 0;
+  for (cTimer *ti = First(); ti; ti = Next(ti), i++) {
+      if (ti->Recording())
+         continue;
+      bool Match;
+      if ((ti->IsSingleEvent() || !ti->Day()) && !(ti->HasFlags(tfVps) && ti->Event() && ti->Event()->Vps()) && !Index->Covers(i, t)) {
+         // Matches(t) would have computed the times of the next occurrence,
+         // which StartTime() and StopTime() now do when they are needed:
+         ti->startTime = ti->stopTime = 0;
+         Match = false;
+         }
+      else
+         Match = ti->Matches(t);
+      if (Match || cLiveBufferManager::InLiveBuffer(ti)) {
          if (ti->Pending()) {
-            if (ti->Index() > LastPending)
-               LastPending = ti->Index();
+            if (i > LastPending)
+               LastPending = i;
             else
                continue;
             }
@@ -678,15 +918,34 @@ cTimer *cTimers::GetMatch(const cEvent *Event, int *Match)
   }
 
   cTimer *t = NULL;
-  for (cTimer *ti = First(); ti; ti = Next(ti)) {
-      int tm = ti->Matches(Event);
-      if (tm > m) {
-         t = ti;
-         m = tm;
-         if (m == tmFull)
-            break;
+  cTimer *Candidates[MAXMATCHCANDIDATES];
+  int n;
+  {
+    cMutexLock MutexLock(&matchIndexMutex);
+    n = MatchIndex()->Candidates(Event, Candidates, MAXMATCHCANDIDATES);
+  }
+  if (n >= 0) {
+     for (int i = 0; i < n; i++) {
+         int tm = Candidates[i]->Matches(Event);
+         if (tm > m) {
+            t = Candidates[i];
+            m = tm;
+            if (m == tmFull)
+               break;
+            }
          }
-      }
+     }
+  else {
+     for (cTimer *ti = First(); ti; ti = Next(ti)) {
+         int tm = ti->Matches(Event);
+         if (tm > m) {
+            t = ti;
+            m = tm;
+            if (m == tmFull)
+               break;
+            }
+         }
+     }
   if (Match)
      *Match = m;
   return t;
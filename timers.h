@@ -28,7 +28,14 @@ enum eTimerMatch { tmNone, tmPartial, tmFull };
 class cTimer : public cListObject {
   friend class cMenuEditTimer;
   friend class cLiveBufferManager;
+  friend class cTimers;
+  friend class cTimerMatchIndex;
 private:
+  static int changes; ///< incremented whenever the times or flags of any timer are changed
+  static void Changed(void) { __sync_fetch_and_add(&changes, 1); }
+       ///< Matches() may change a timer in any thread, so 'changes' is only
+       ///< modified through this function.
+  static int Changes(void) { return __sync_fetch_and_add(&changes, 0); }
   mutable time_t startTime, stopTime;
   time_t lastSetEvent;
   bool recording, pending, inVpsMargin;
@@ -102,14 +109,24 @@ public:
   static cString PrintDay(time_t Day, int WeekDays);
   };
 
+class cTimerMatchIndex;
+
 class cTimers : public cConfig<cTimer> {
 private:
   int state;
   int beingEdited;
   time_t lastSetEvents;
   time_t lastDeleteExpired;
+  cMutex matchIndexMutex;
+  cTimerMatchIndex *matchIndex;
+  cTimerMatchIndex *MatchIndex(void);
+       ///< Returns the index of the times at which the timers hit, rebuilding
+       ///< it if the timers have changed since it was built. The caller must
+       ///< hold matchIndexMutex for as long as it uses the index, because the
+       ///< next call may delete it.
 public:
   cTimers(void);
+  virtual ~cTimers();
   cTimers& operator=(const cTimers &t);
   cTimer *GetTimer(cTimer *Timer);
   cTimer *GetMatch(time_t t);
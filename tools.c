@@ -20,6 +20,7 @@ extern "C" {
 }
 #include <stdarg.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/vfs.h>
 #include <time.h>
@@ -27,6 +28,7 @@ extern "C" {
 #include <utime.h>
 #include "i18n.h"
 #include "thread.h"
+#include "tsscan.h"
 
 int SysLogLevel = 3;
 
@@ -1069,6 +1071,180 @@ bool cSafeFile::Close(void)
   return result;
 }
 
+// --- cDirectWriter ---------------------------------------------------------
+
+#define DIRECTALIGN      4096 // alignment of buffers, file positions and sizes for O_DIRECT
+#define DIRECTCHUNK      MEGABYTE(1)
+#define MAXDIRECTBUFFERS 8    // buffers kept in the pool when they're not in use
+
+class cDirectBufferPool {
+private:
+  cMutex mutex;
+  uchar *buffers[MAXDIRECTBUFFERS];
+  int count;
+public:
+  cDirectBufferPool(void) { count = 0; }
+  ~cDirectBufferPool();
+  uchar *Get(void);
+  void Release(uchar *Buffer);
+  };
+
+static cDirectBufferPool DirectBufferPool;
+
+cDirectBufferPool::~cDirectBufferPool()
+{
+  while (count > 0)
+        free(buffers[--count]);
+}
+
+uchar *cDirectBufferPool::Get(void)
+{
+  cMutexLock MutexLock(&mutex);
+  if (count > 0)
+     return buffers[--count];
+  void *p;
+  if (posix_memalign(&p, DIRECTALIGN, DIRECTCHUNK) == 0)
+     return (uchar *)p;
+  esyslog("ERROR: can't allocate direct I/O buffer");
+  return NULL;
+}
+
+void cDirectBufferPool::Release(uchar *Buffer)
+{
+  cMutexLock MutexLock(&mutex);
+  if (count < MAXDIRECTBUFFERS)
+     buffers[count++] = Buffer;
+  else
+     free(Buffer);
+}
+
+bool cDirectWriter::enabled = false;
+
+cDirectWriter::cDirectWriter(void)
+{
+  fd = -1;
+  tail = NULL;
+  tailPos = -1;
+  tailLen = 0;
+  pending = false;
+}
+
+cDirectWriter::~cDirectWriter()
+{
+  Close();
+  free(tail);
+}
+
+bool cDirectWriter::Open(const char *FileName)
+{
+  Close();
+  if (!tail) {
+     void *p;
+     if (posix_memalign(&p, DIRECTALIGN, DIRECTALIGN))
+        return false;
+     tail = (uchar *)p;
+     }
+  fd = open64(FileName, O_WRONLY | O_DIRECT);
+  if (fd < 0) {
+     dsyslog("no direct I/O for '%s' (%s)", FileName, strerror(errno));
+     return false;
+     }
+  return true;
+}
+
+void cDirectWriter::Close(void)
+{
+  if (fd >= 0) {
+     Flush();
+     close(fd);
+     fd = -1;
+     }
+  tailPos = -1;
+  tailLen = 0;
+  pending = false;
+}
+
+bool cDirectWriter::Flush(void)
+{
+  if (!pending)
+     return true;
+  pending = false;
+  // The partial page can't be written with O_DIRECT, so it's the one write
+  // that goes through the page cache. The page stays in 'tail' and is
+  // written directly once a later Write() has completed it.
+  int Flags = fcntl(fd, F_GETFL);
+  if (Flags < 0 || fcntl(fd, F_SETFL, Flags & ~O_DIRECT) < 0) {
+     LOG_ERROR;
+     return false;
+     }
+  bool Result = pwrite64(fd, tail, tailLen, tailPos) == tailLen;
+  if (!Result)
+     LOG_ERROR;
+  if (fcntl(fd, F_SETFL, Flags) < 0)
+     LOG_ERROR;
+  return Result;
+}
+
+ssize_t cDirectWriter::Write(int Fd, off64_t Pos, const void *Data, size_t Size)
+{
+  uchar *Buffer = DirectBufferPool.Get();
+  if (fd < 0 || !Buffer) {
+     if (Buffer)
+        DirectBufferPool.Release(Buffer);
+     return pwrite64(Fd, Data, Size, Pos);
+     }
+  // A pending partial page that isn't continued here must go to the file first:
+  if (pending && Pos != tailPos + tailLen && !Flush()) {
+     DirectBufferPool.Release(Buffer);
+     return -1;
+     }
+  // Direct writes start at a page boundary, so the bytes in front of Pos
+  // within its page are written again:
+  int Fill = Pos % DIRECTALIGN;
+  off64_t Start = Pos - Fill;
+  if (Fill) {
+     if (tailPos == Start && tailLen >= Fill)
+        memcpy(Buffer, tail, Fill);
+     else {
+        int r = pread64(Fd, Buffer, Fill, Start);
+        if (r < Fill)
+           memset(Buffer + max(r, 0), 0, Fill - max(r, 0));
+        }
+     }
+  const uchar *p = (const uchar *)Data;
+  size_t Done = 0;
+  while (Done < Size) {
+        int n = min(Size - Done, size_t(DIRECTCHUNK - Fill));
+        memcpy(Buffer + Fill, p + Done, n);
+        Fill += n;
+        Done += n;
+        int Full = Fill - Fill % DIRECTALIGN;
+        if (Full) {
+           if (pwrite64(fd, Buffer, Full, Start) != Full) {
+              LOG_ERROR;
+              DirectBufferPool.Release(Buffer);
+              tailPos = -1;
+              pending = false;
+              return -1;
+              }
+           Start += Full;
+           Fill -= Full;
+           memmove(Buffer, Buffer + Full, Fill);
+           }
+        }
+  // The final partial page is kept until it is completed or flushed:
+  tailPos = -1;
+  pending = false;
+  if (Fill) {
+     memcpy(tail, Buffer, Fill);
+     tailPos = Start;
+     tailLen = Fill;
+     pending = true;
+     }
+  DirectBufferPool.Release(Buffer);
+  return Size;
+}
+
 // --- cUnbufferedFile -------------------------------------------------------
 
 #define USE_FADVISE
@@ -1078,6 +1254,8 @@ bool cSafeFile::Close(void)
 cUnbufferedFile::cUnbufferedFile(void)
 {
   fd = -1;
+  device = 0;
+  direct = NULL;
 }
 
 cUnbufferedFile::~cUnbufferedFile()
@@ -1090,6 +1268,15 @@ int cUnbufferedFile::Open(const char *FileName, int Flags, mode_t Mode)
   Close();
   fd = open(FileName, Flags, Mode);
   curpos = 0;
+  struct stat st;
+  device = fd >= 0 && fstat(fd, &st) == 0 ? st.st_dev : 0;
+  if (fd >= 0 && (Flags & O_CREAT) && cDirectWriter::Enabled()) {
+     direct = new cDirectWriter;
+     if (!direct->Open(FileName)) {
+        delete direct;
+        direct = NULL;
+        }
+     }
 #ifdef USE_FADVISE
   begin = lastpos = ahead = 0;
   cachedstart = 0;
@@ -1105,6 +1292,8 @@ int cUnbufferedFile::Open(const char *FileName, int Flags, mode_t Mode)
 
 int cUnbufferedFile::Close(void)
 {
+  delete direct;
+  direct = NULL;
 #ifdef USE_FADVISE
   if (fd >= 0) {
      if (totwritten)    // if we wrote anything make sure the data has hit the disk before
@@ -1147,6 +1336,7 @@ off_t cUnbufferedFile::Seek(off_t Offset, int Whence)
 ssize_t cUnbufferedFile::Read(void *Data, size_t Size)
 {
   if (fd >= 0) {
+     Flush();
 #ifdef USE_FADVISE
      off_t jumped = curpos-lastpos; // nonzero means we're not at the last offset
      if ((cachedstart < cachedend) && (curpos < cachedstart || curpos > cachedend)) {
@@ -1201,8 +1391,42 @@ ssize_t cUnbufferedFile::Read(void *Data, size_t Size)
   return -1;
 }
 
+ssize_t cUnbufferedFile::ReadAt(void *Data, size_t Size, off_t Offset)
+{
+  if (fd >= 0) {
+     Flush();
+     ssize_t bytesRead = 0;
+     while (size_t(bytesRead) < Size) {
+           ssize_t r = pread(fd, (uchar *)Data + bytesRead, Size - bytesRead, Offset + bytesRead);
+           if (r < 0 && errno == EINTR)
+              continue;
+           if (r < 0)
+              return bytesRead ? bytesRead : -1;
+           if (r == 0)
+              break;
+           bytesRead += r;
+           }
+#ifdef USE_FADVISE
+     if (bytesRead > 0)
+        FadviseDrop(Offset, bytesRead);
+#endif
+     return bytesRead;
+     }
+  return -1;
+}
+
+void cUnbufferedFile::WillNeed(off_t Offset, size_t Size)
+{
+#ifdef USE_FADVISE
+  if (fd >= 0)
+     posix_fadvise(fd, Offset, Size, POSIX_FADV_WILLNEED);
+#endif
+}
+
 ssize_t cUnbufferedFile::Write(const void *Data, size_t Size)
 {
+  if (direct)
+     return WriteBlock(Data, Size); // nothing to drop from the cache except the partial pages
   if (fd >=0) {
      ssize_t bytesWritten = safe_write(fd, Data, Size);
 #ifdef USE_FADVISE
@@ -1252,6 +1476,115 @@ ssize_t cUnbufferedFile::Write(const void *Data, size_t Size)
   return -1;
 }
 
+ssize_t cUnbufferedFile::WriteBlock(const void *Data, size_t Size)
+{
+  if (fd >= 0 && direct) {
+     ssize_t bytesWritten = direct->Write(fd, curpos, Data, Size);
+     if (bytesWritten > 0) {
+        curpos += bytesWritten;
+        lseek(fd, curpos, SEEK_SET);
+        totwritten += bytesWritten;
+        }
+     return bytesWritten;
+     }
+  if (fd >= 0) {
+     ssize_t bytesWritten = safe_write(fd, Data, Size);
+#ifdef USE_FADVISE
+     if (bytesWritten > 0) {
+        // Writeback of the previous block (begin..lastpos) has been started
+        // when it was written, so waiting for it here rarely blocks:
+        if (lastpos > begin) {
+           sync_file_range(fd, begin, lastpos - begin, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+           FadviseDrop(begin, lastpos - begin);
+           }
+        sync_file_range(fd, curpos, bytesWritten, SYNC_FILE_RANGE_WRITE);
+        begin = curpos;
+        curpos += bytesWritten;
+        lastpos = curpos;
+        totwritten += bytesWritten;
+        }
+#endif
+     return bytesWritten;
+     }
+  return -1;
+}
+
+bool cUnbufferedFile::Flush(void)
+{
+  return !direct || direct->Flush();
+}
+
+static ssize_t CopyFileRange(int FdIn, loff_t *OffIn, int FdOut, size_t Len)
+{
+#ifdef __NR_copy_file_range
+  return syscall(__NR_copy_file_range, FdIn, OffIn, FdOut, NULL, Len, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+ssize_t cUnbufferedFile::CopyFrom(cUnbufferedFile *From, off_t Offset, size_t Size)
+{
+  if (fd < 0 || !From || From->fd < 0)
+     return -1;
+  off_t Pos = curpos;
+  ssize_t Copied = 0;
+  if (!direct) {
+     loff_t In = Offset;
+     while (size_t(Copied) < Size) {
+           ssize_t r = CopyFileRange(From->fd, &In, fd, Size - Copied);
+           if (r < 0 && errno == EINTR)
+              continue;
+           if (r <= 0) {
+              if (r < 0 && Copied == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+                 break; // not supported here, so let's do it the old way
+              if (r < 0)
+                 return Copied ? Copied : -1;
+              return Copied; // EOF
+              }
+           Copied += r;
+           }
+     if (Copied > 0) {
+        curpos += Copied;
+#ifdef USE_FADVISE
+        // Same as in WriteBlock(), the data has been produced faster than the disk
+        // can write it, so let's wait for the previous range and drop it:
+        if (lastpos > begin) {
+           sync_file_range(fd, begin, lastpos - begin, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+           FadviseDrop(begin, lastpos - begin);
+           }
+        sync_file_range(fd, Pos, Copied, SYNC_FILE_RANGE_WRITE);
+        begin = Pos;
+        lastpos = curpos;
+        written = 0;
+        From->FadviseDrop(Offset, Copied);
+#endif
+        return Copied;
+        }
+     }
+  uchar *Buffer = DirectBufferPool.Get();
+  if (!Buffer)
+     return -1;
+  while (size_t(Copied) < Size) {
+        ssize_t r = pread64(From->fd, Buffer, min(Size - Copied, size_t(DIRECTCHUNK)), Offset + Copied);
+        if (r < 0 && errno == EINTR)
+           continue;
+        if (r <= 0 || Write(Buffer, r) != r) {
+           if (r != 0 && !Copied)
+              Copied = -1;
+           break;
+           }
+        Copied += r;
+        }
+  DirectBufferPool.Release(Buffer);
+#ifdef USE_FADVISE
+  if (Copied > 0)
+     From->FadviseDrop(Offset, Copied);
+#endif
+  return Copied;
+}
+
 cUnbufferedFile *cUnbufferedFile::Create(const char *FileName, int Flags, mode_t Mode)
 {
   cUnbufferedFile *File = new cUnbufferedFile;
@@ -1331,6 +1664,7 @@ void cLockFile::Unlock(void)
 cListObject::cListObject(void)
 {
   prev = next = NULL;
+  index = -1;
 }
 
 cListObject::~cListObject()
@@ -1360,6 +1694,8 @@ void cListObject::Unlink(void)
 
 int cListObject::Index(void) const
 {
+  if (index >= 0)
+     return index;
   cListObject *p = prev;
   int i = 0;
 
@@ -1376,15 +1712,68 @@ cListBase::cListBase(void)
 {
   objects = lastObject = NULL;
   count = 0;
+  listState = 0;
+  vector = NULL;
+  vectorSize = 0;
 }
 
 cListBase::~cListBase()
 {
   Clear();
+  free(vector);
+}
+
+void cListBase::EnableVector(void)
+{
+  if (!vector) {
+     vectorSize = max(count, 16);
+     vector = MALLOC(cListObject *, vectorSize);
+     int i = 0;
+     for (cListObject *object = objects; object; object = object->Next()) {
+         object->index = i;
+         vector[i++] = object;
+         }
+     }
+}
+
+void cListBase::VectorInsert(cListObject *Object, int Index)
+{
+  // 'count' doesn't include Object yet
+  if (count >= vectorSize) {
+     cListObject **p = (cListObject **)realloc(vector, 2 * vectorSize * sizeof(cListObject *));
+     if (!p) {
+        // the list still works without the vector, only slower:
+        esyslog("ERROR: can't enlarge list vector");
+        for (cListObject *object = objects; object; object = object->Next())
+            object->index = -1;
+        free(vector);
+        vector = NULL;
+        vectorSize = 0;
+        return;
+        }
+     vector = p;
+     vectorSize *= 2;
+     }
+  memmove(vector + Index + 1, vector + Index, (count - Index) * sizeof(cListObject *));
+  vector[Index] = Object;
+  for (int i = Index; i <= count; i++)
+      vector[i]->index = i;
+}
+
+void cListBase::VectorRemove(cListObject *Object)
+{
+  // 'count' still includes Object
+  int Index = Object->index;
+  memmove(vector + Index, vector + Index + 1, (count - Index - 1) * sizeof(cListObject *));
+  for (int i = Index; i < count - 1; i++)
+      vector[i]->index = i;
+  Object->index = -1;
 }
 
 void cListBase::Add(cListObject *Object, cListObject *After)
 {
+  if (vector)
+     VectorInsert(Object, (After && After != lastObject) ? After->index + 1 : count);
   if (After && After != lastObject) {
      After->Next()->Insert(Object);
      After->Append(Object);
@@ -1397,10 +1786,13 @@ void cListBase::Add(cListObject *Object, cListObject *After)
      lastObject = Object;
      }
   count++;
+  listState++;
 }
 
 void cListBase::Ins(cListObject *Object, cListObject *Before)
 {
+  if (vector)
+     VectorInsert(Object, (Before && Before != objects) ? Before->index : 0);
   if (Before && Before != objects) {
      Before->Prev()->Append(Object);
      Before->Insert(Object);
@@ -1413,10 +1805,13 @@ void cListBase::Ins(cListObject *Object, cListObject *Before)
      objects = Object;
      }
   count++;
+  listState++;
 }
 
 void cListBase::Del(cListObject *Object, bool DeleteObject)
 {
+  if (vector)
+     VectorRemove(Object);
   if (Object == objects)
      objects = Object->Next();
   if (Object == lastObject)
@@ -1425,6 +1820,7 @@ void cListBase::Del(cListObject *Object, bool DeleteObject)
   if (DeleteObject)
      delete Object;
   count--;
+  listState++;
 }
 
 void cListBase::Move(int From, int To)
@@ -1437,6 +1833,10 @@ void cListBase::Move(cListObject *From, cListObject *To)
   if (From && To) {
      if (From->Index() < To->Index())
         To = To->Next();
+     if (vector) {
+        VectorRemove(From);
+        count--;
+        }
      if (From == objects)
         objects = From->Next();
      if (From == lastObject)
@@ -1453,6 +1853,11 @@ void cListBase::Move(cListObject *From, cListObject *To)
         }
      if (!From->Prev())
         objects = From;
+     if (vector) {
+        VectorInsert(From, From->Prev() ? From->Prev()->index + 1 : 0);
+        count++;
+        }
+     listState++;
      }
 }
 
@@ -1465,12 +1870,15 @@ void cListBase::Clear(void)
         }
   objects = lastObject = NULL;
   count = 0;
+  listState++;
 }
 
 cListObject *cListBase::Get(int Index) const
 {
   if (Index < 0)
      return NULL;
+  if (vector)
+     return Index < count ? vector[Index] : NULL;
   cListObject *object = objects;
   while (object && Index-- > 0)
         object = object->Next();
@@ -1487,7 +1895,13 @@ static int CompareListObjects(const void *a, const void *b)
 void cListBase::Sort(void)
 {
   int n = Count();
-  cListObject *a[n];
+  if (n < 2)
+     return;
+  // a list can be too long for a buffer on the stack, and with a vector
+  // we can sort that one directly:
+  cListObject **a = vector ? vector : MALLOC(cListObject *, n);
+  if (!a)
+     return;
   cListObject *object = objects;
   int i = 0;
   while (object && i < n) {
@@ -1495,12 +1909,22 @@ void cListBase::Sort(void)
         object = object->Next();
         }
   qsort(a, n, sizeof(cListObject *), CompareListObjects);
+  cListObject **v = vector;
+  vector = NULL; // the vector is already in order, so Add() must not touch it
   objects = lastObject = NULL;
   for (i = 0; i < n; i++) {
       a[i]->Unlink();
       count--;
-      Add(a[i]);
+      cListBase::Add(a[i]); // a derived Add() would see the objects as new
       }
+  vector = v;
+  if (vector) {
+     for (i = 0; i < n; i++)
+         vector[i]->index = i;
+     }
+  else
+     free(a);
+  listState++;
 }
 
 // --- cHashBase -------------------------------------------------------------
@@ -1570,42 +1994,13 @@ cList<cHashObject> *cHashBase::GetList(unsigned int Id) const
   s: start index
   l: total length
   returns: -1 (not found) or start position of signature relative to Data
-  Speedup: about 2.8 on AMD Geode 300MHz
+  The actual search is done by the vectorized FindStartCode() in tsscan.c.
 */
 
-#define CMP_CORE(offset) \
-        x=Data[i+1+offset]; \
-        if (x<2) { \
-                if (x==0) { \
-                        if ( Data[i+offset]==0 && Data[i+2+offset]==1) \
-                                return i+offset; \
-                        else if (Data[i+2+offset]==0 && Data[i+3+offset]==1) \
-                                return i+1+offset; \
-                } \
-                else if (x==1 && Data[i-1+offset]==0 && Data[i+offset]==0 && (i+offset)>0) \
-                         return i-1+offset; \
-         }
-
 int FindPacketHeader(const uchar *Data, int s, int l)
 {
-	int i;
-	uchar x;
-	
-	if (l>12) {
-		for(i=s;i<l-12;i+=12) { 
-			CMP_CORE(0);
-			CMP_CORE(3);
-			CMP_CORE(6);
-			CMP_CORE(9);
-		}
-		for(;i<l-3;i+=3) {
-			CMP_CORE(0);
-		}
-	}
-	else {
-		for(i=s; i<l-3; i+=3) {
-			CMP_CORE(0);
-		}
-	}
-	return -1;
+	if (s<0)
+		s=0;
+	int x=FindStartCode(Data+s, l-s);
+	return x<0 ? -1 : s+x;
 }
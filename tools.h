@@ -251,9 +251,49 @@ public:
 /// cUnbufferedFile is used for large files that are mainly written or read
 /// in a streaming manner, and thus should not be cached.
 
+// cDirectWriter writes a file with O_DIRECT, bypassing the page cache. The
+// data is copied into page aligned buffers taken from a common pool. Only
+// whole pages are written directly; the partial page at the end of each
+// Write() is kept in memory and completed by the next Write(). It is written
+// through the page cache only by Flush() (or Close()), so until then the last
+// Pending() bytes are not yet in the file.
+
+class cDirectWriter {
+private:
+  static bool enabled;
+  int fd;
+  uchar *tail;
+  off64_t tailPos;
+  int tailLen;
+  bool pending;
+public:
+  cDirectWriter(void);
+  ~cDirectWriter();
+  bool Open(const char *FileName);
+       ///< Opens FileName (which must already exist) for direct writing.
+       ///< Returns false if the file system doesn't support O_DIRECT.
+  void Close(void);
+       ///< Flushes the pending partial page and closes the file.
+  ssize_t Write(int Fd, off64_t Pos, const void *Data, size_t Size);
+       ///< Writes Size bytes of Data to the file at Pos. Fd is a normal file
+       ///< descriptor of the same file, used to read the beginning of a partial
+       ///< page that isn't in memory.
+  bool Flush(void);
+       ///< Writes the pending partial page (if any) to the file.
+  int Pending(void) { return pending ? tailLen : 0; }
+       ///< Returns the number of bytes in front of the last written position
+       ///< that haven't been written to the file yet.
+  static void SetEnabled(bool On) { enabled = On; }
+  static bool Enabled(void) { return enabled; }
+       ///< If enabled, cUnbufferedFile (and the live buffer's files) write newly
+       ///< created files with a cDirectWriter.
+  };
+
 class cUnbufferedFile {
 private:
   int fd;
+  dev_t device;
+  cDirectWriter *direct;
   off_t curpos;
   off_t cachedstart;
   off_t cachedend;
@@ -269,10 +309,37 @@ public:
   ~cUnbufferedFile();
   int Open(const char *FileName, int Flags, mode_t Mode = DEFFILEMODE);
   int Close(void);
+  dev_t Device(void) { return device; }
+       ///< Returns the device the file is on.
   void SetReadAhead(size_t ra);
   off_t Seek(off_t Offset, int Whence);
   ssize_t Read(void *Data, size_t Size);
+  ssize_t ReadAt(void *Data, size_t Size, off_t Offset);
+       ///< Reads Size bytes from the given Offset, without changing the file
+       ///< position or the readahead window of Read(). Returns the number of
+       ///< bytes read, which is less than Size only at the end of the file.
+  void WillNeed(off_t Offset, size_t Size);
+       ///< Lets the kernel start reading the given range in the background, so
+       ///< that a later ReadAt() of that range doesn't have to wait for the disk.
   ssize_t Write(const void *Data, size_t Size);
+  ssize_t WriteBlock(const void *Data, size_t Size);
+       ///< Writes a large block of Data (typically a few MB), starts writing it
+       ///< back to disk at once and drops the previous block from the cache as
+       ///< soon as it has hit the disk. This replaces the heuristics of Write()
+       ///< for writers that coalesce their data into large blocks. Write() and
+       ///< WriteBlock() should not be mixed on the same file.
+  bool Flush(void);
+       ///< Makes sure all data given to Write() or WriteBlock() is in the file,
+       ///< so that other readers can see it.
+  int Pending(void) { return direct ? direct->Pending() : 0; }
+       ///< Returns the number of bytes in front of the current position that
+       ///< have been written, but are not yet in the file (see Flush()).
+  ssize_t CopyFrom(cUnbufferedFile *From, off_t Offset, size_t Size);
+       ///< Appends Size bytes, taken from From at the given Offset, to this file
+       ///< at its current position. The data is moved by the kernel if possible
+       ///< (copy_file_range()), without passing through user space. From's file
+       ///< position is not changed. Returns the number of bytes copied, or -1 in
+       ///< case of an error.
   static cUnbufferedFile *Create(const char *FileName, int Flags, mode_t Mode = DEFFILEMODE);
   };
 
@@ -288,8 +355,10 @@ public:
   };
 
 class cListObject {
+  friend class cListBase;
 private:
   cListObject *prev, *next;
+  int index; // position in a list with a vector, -1 otherwise
 public:
   cListObject(void);
   virtual ~cListObject();
@@ -305,20 +374,33 @@ public:
   };
 
 class cListBase {
+private:
+  cListObject **vector;
+  int vectorSize;
+  void VectorInsert(cListObject *Object, int Index);
+  void VectorRemove(cListObject *Object);
 protected:
   cListObject *objects, *lastObject;
   cListBase(void);
   int count;
+  int listState;
+  void EnableVector(void);
+       ///< Additionally keeps all objects in a vector, so that Get() and
+       ///< cListObject::Index() take constant time. Inserting or deleting
+       ///< objects anywhere but at the end of the list becomes linear instead.
 public:
   virtual ~cListBase();
-  void Add(cListObject *Object, cListObject *After = NULL);
-  void Ins(cListObject *Object, cListObject *Before = NULL);
-  void Del(cListObject *Object, bool DeleteObject = true);
+  virtual void Add(cListObject *Object, cListObject *After = NULL);
+  virtual void Ins(cListObject *Object, cListObject *Before = NULL);
+  virtual void Del(cListObject *Object, bool DeleteObject = true);
   virtual void Move(int From, int To);
-  void Move(cListObject *From, cListObject *To);
+  virtual void Move(cListObject *From, cListObject *To);
   virtual void Clear(void);
   cListObject *Get(int Index) const;
   int Count(void) const { return count; }
+  int ListState(void) const { return listState; }
+       ///< Changes whenever objects are added to, removed from or moved within
+       ///< the list, so that anything derived from it can tell it's outdated.
   void Sort(void);
   };
 
@@ -331,6 +413,14 @@ public:
   T *Next(const T *object) const { return (T *)object->cListObject::Next(); } // avoid ambiguities in case of a "list of lists"
   };
 
+/// cVectorList is a cList with random access, meant for lists that are
+/// mostly read by index and seldom modified anywhere but at the end.
+
+template<class T> class cVectorList : public cList<T> {
+public:
+  cVectorList(void) { cListBase::EnableVector(); }
+  };
+
 class cHashObject : public cListObject {
   friend class cHashBase;
 private:
@@ -0,0 +1,193 @@
+/*
+ * tsscan.c: Fast scanning of blocks of TS packets and PES data
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#include "tsscan.h"
+#include <string.h>
+#if defined(__AVX2__) && !defined(SCALARTSSCAN)
+#include <immintrin.h>
+#elif defined(__SSE2__) && !defined(SCALARTSSCAN)
+#include <emmintrin.h>
+#endif
+
+// The vector versions look at the first four bytes of several packets at
+// once. On these (little endian) CPUs such a 32 bit word holds the sync
+// byte in its lowest byte, followed by the two bytes containing the PID.
+
+static inline uint32_t TsHeader(const uchar *Data)
+{
+  uint32_t h;
+  memcpy(&h, Data, sizeof(h));
+  return h;
+}
+
+#if defined(__AVX2__) && !defined(SCALARTSSCAN)
+
+#define TSVECTOR 8 // packets per vector
+
+static inline __m256i TsHeaders(const uchar *Data)
+{
+  const __m256i Offsets = _mm256_setr_epi32(0, TS_SIZE, 2 * TS_SIZE, 3 * TS_SIZE, 4 * TS_SIZE, 5 * TS_SIZE, 6 * TS_SIZE, 7 * TS_SIZE);
+  return _mm256_i32gather_epi32((const int *)Data, Offsets, 1);
+}
+
+static inline __m256i HeaderPids(__m256i Headers)
+{
+  // ((b1 & 0x1F) << 8) | b2, with b1 and b2 at bits 8..15 and 16..23:
+  return _mm256_or_si256(_mm256_and_si256(Headers, _mm256_set1_epi32(PID_MASK_HI << 8)), _mm256_and_si256(_mm256_srli_epi32(Headers, 16), _mm256_set1_epi32(0xFF)));
+}
+
+static inline int Matches(__m256i a, __m256i b)
+{
+  return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)));
+}
+
+#define SYNCBYTES _mm256_set1_epi32(TS_SYNC_BYTE)
+#define LOWBYTE   _mm256_set1_epi32(0xFF)
+#define SPLAT     _mm256_set1_epi32
+#define AND       _mm256_and_si256
+
+#define SCVECTOR 32 // bytes per vector
+
+static inline uint32_t StartCodeMask(const uchar *Data)
+{
+  __m256i b0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)Data), _mm256_setzero_si256());
+  __m256i b1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Data + 1)), _mm256_setzero_si256());
+  __m256i b2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Data + 2)), _mm256_set1_epi8(1));
+  return _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(b0, b1), b2));
+}
+
+#elif defined(__SSE2__) && !defined(SCALARTSSCAN)
+
+#define TSVECTOR 4 // packets per vector
+
+static inline __m128i TsHeaders(const uchar *Data)
+{
+  return _mm_setr_epi32(TsHeader(Data), TsHeader(Data + TS_SIZE), TsHeader(Data + 2 * TS_SIZE), TsHeader(Data + 3 * TS_SIZE));
+}
+
+static inline __m128i HeaderPids(__m128i Headers)
+{
+  return _mm_or_si128(_mm_and_si128(Headers, _mm_set1_epi32(PID_MASK_HI << 8)), _mm_and_si128(_mm_srli_epi32(Headers, 16), _mm_set1_epi32(0xFF)));
+}
+
+static inline int Matches(__m128i a, __m128i b)
+{
+  return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+}
+
+#define SYNCBYTES _mm_set1_epi32(TS_SYNC_BYTE)
+#define LOWBYTE   _mm_set1_epi32(0xFF)
+#define SPLAT     _mm_set1_epi32
+#define AND       _mm_and_si128
+
+#define SCVECTOR 16 // bytes per vector
+
+static inline uint32_t StartCodeMask(const uchar *Data)
+{
+  __m128i b0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)Data), _mm_setzero_si128());
+  __m128i b1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data + 1)), _mm_setzero_si128());
+  __m128i b2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Data + 2)), _mm_set1_epi8(1));
+  return _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(b0, b1), b2));
+}
+
+#endif
+
+#define ALLMATCH ((1 << TSVECTOR) - 1)
+
+int TsSynced(const uchar *Data, int Count)
+{
+  Count -= Count % TS_SIZE;
+  int n = 0;
+#ifdef TSVECTOR
+  for ( ; n + TSVECTOR * TS_SIZE <= Count; n += TSVECTOR * TS_SIZE) {
+      int m = Matches(AND(TsHeaders(Data + n), LOWBYTE), SYNCBYTES);
+      if (m != ALLMATCH)
+         return n + __builtin_ctz(~m) * TS_SIZE;
+      }
+#endif
+  while (n < Count && Data[n] == TS_SYNC_BYTE)
+        n += TS_SIZE;
+  return n;
+}
+
+int TsPidRun(const uchar *Data, int Count)
+{
+  Count -= Count % TS_SIZE;
+  int Pid = TsPid(Data);
+  int n = TS_SIZE;
+#ifdef TSVECTOR
+  for ( ; n + TSVECTOR * TS_SIZE <= Count; n += TSVECTOR * TS_SIZE) {
+      int m = Matches(HeaderPids(TsHeaders(Data + n)), SPLAT(Pid));
+      if (m != ALLMATCH)
+         return n + __builtin_ctz(~m) * TS_SIZE;
+      }
+#endif
+  while (n < Count && TsPid(Data + n) == Pid)
+        n += TS_SIZE;
+  return n;
+}
+
+// Start codes are searched for in all positions of a vector at once: bit k
+// of StartCodeMask() is set if there is a start code at offset k. Since the
+// last two bytes of a start code are looked at through loads that are one and
+// two bytes further on, the vector loop stops SCVECTOR + 2 bytes before the
+// end of the data.
+
+static inline bool IsStartCode(const uchar *Data)
+{
+  return Data[0] == 0 && Data[1] == 0 && Data[2] == 1;
+}
+
+int FindStartCode(const uchar *Data, int Count)
+{
+  int n = 0;
+#ifdef SCVECTOR
+  for ( ; n + SCVECTOR + 2 <= Count; n += SCVECTOR) {
+      uint32_t m = StartCodeMask(Data + n);
+      if (m)
+         return n + __builtin_ctz(m);
+      }
+#endif
+  for ( ; n + 2 < Count; n++) {
+      if (Data[n + 2] > 1)
+         n += 2; // none of the next three positions can start a start code
+      else if (IsStartCode(Data + n))
+         return n;
+      }
+  return -1;
+}
+
+int FindStartCodes(const uchar *Data, int Count, int *Offsets, int Max)
+{
+  int Found = 0;
+  int n = 0;
+  if (Max <= 0)
+     return 0;
+#ifdef SCVECTOR
+  for ( ; n + SCVECTOR + 2 <= Count; n += SCVECTOR) {
+      uint32_t m = StartCodeMask(Data + n);
+      while (m) {
+            Offsets[Found++] = n + __builtin_ctz(m);
+            if (Found == Max)
+               return Found;
+            m &= m - 1;
+            }
+      }
+#endif
+  for ( ; n + 2 < Count; n++) {
+      if (Data[n + 2] > 1)
+         n += 2;
+      else if (IsStartCode(Data + n)) {
+         Offsets[Found++] = n;
+         if (Found == Max)
+            break;
+         }
+      }
+  return Found;
+}
@@ -0,0 +1,48 @@
+/*
+ * tsscan.h: Fast scanning of blocks of TS packets and PES data
+ *
+ * See the main source file 'vdr.c' for copyright information and
+ * how to reach the author.
+ *
+ * $Id$
+ */
+
+#ifndef __TSSCAN_H
+#define __TSSCAN_H
+
+#include "tools.h"
+
+#define TS_SIZE          188
+#define TS_SYNC_BYTE     0x47
+#define PID_MASK_HI      0x1F
+
+// These functions work on several packets at once. Depending on the
+// instruction set the compiler is told to use (-mavx2 or -msse2, which is
+// the default on x86_64), they use AVX2 or SSE2, otherwise they fall back
+// to plain C. Defining SCALARTSSCAN always uses the plain C versions.
+
+inline int TsPid(const uchar *Data)
+{
+  return ((Data[1] & PID_MASK_HI) << 8) | Data[2];
+}
+
+int TsSynced(const uchar *Data, int Count);
+   ///< Returns the number of bytes at the beginning of Data that form consecutive
+   ///< TS packets starting with TS_SYNC_BYTE. Count is the number of bytes
+   ///< available in Data. The result is always a multiple of TS_SIZE.
+int TsPidRun(const uchar *Data, int Count);
+   ///< Returns the number of bytes at the beginning of Data that form consecutive
+   ///< TS packets with the same PID as the first one. Count is the number of
+   ///< bytes available in Data and must be at least TS_SIZE. The result is
+   ///< always a multiple of TS_SIZE.
+
+int FindStartCode(const uchar *Data, int Count);
+   ///< Returns the offset of the first start code (00 00 01) that lies
+   ///< completely within the Count bytes of Data, or -1 if there is none.
+int FindStartCodes(const uchar *Data, int Count, int *Offsets, int Max);
+   ///< Stores the offsets of the start codes that lie completely within the
+   ///< Count bytes of Data in Offsets, in ascending order, and returns how many
+   ///< there are. Stops after Max start codes, so if the result is Max, the
+   ///< caller may continue searching behind the last one.
+
+#endif //__TSSCAN_H
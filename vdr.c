@@ -651,6 +651,8 @@ int main(int argc, char *argv[])
   cThemes::SetThemesDirectory(AddDirectory(ConfigDirectory, "themes"));
 
   Setup.Load(AddDirectory(ConfigDirectory, "setup.conf"));
+  cThread::SetThreadClass(tcUi);
+  cDirectWriter::SetEnabled(Setup.UseDirectIO);
   if (!(Sources.Load(AddDirectory(ConfigDirectory, "sources.conf"), true, true) &&
         Diseqcs.Load(AddDirectory(ConfigDirectory, "diseqc.conf"), true, Setup.DiSEqC) &&
         Channels.Load(AddDirectory(ConfigDirectory, ChannelsFileName ), false, true) &&
@@ -1579,7 +1581,7 @@ int main(int argc, char *argv[])
         if (!Menu) {
            if (!InhibitEpgScan)
               EITScanner.Process();
-           if (!cCutter::Active() && cCutter::Ended()) {
+           if (cCutter::Ended()) {
               if (cCutter::Error())
                  Skins.Message(mtError, tr("Editing process failed!"));
               else
@@ -1717,6 +1719,7 @@ Exit:
      }
   cDevice::Shutdown();
   PluginManager.Shutdown(true); 
+  cReadRequest::Shutdown();
   cSchedules::Cleanup(true);
   ReportEpgBugFixStats();
   if (WatchdogTimeout > 0)
@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include "recording.h"
+#include "thread.h"
 #include "tools.h"
 
 const char *VideoDirectory = VIDEODIR;
@@ -233,3 +234,50 @@ void RemoveEmptyVideoDirectories(void)
      } while (Dir.Next());
 }
 
+
+dev_t VideoFileDevice(const char *FileName)
+{
+  // The first file of a recording may be a symlink into another video directory:
+  struct stat st;
+  if (stat(AddDirectory(FileName, "001.vdr"), &st) == 0 || stat(FileName, &st) == 0)
+     return st.st_dev;
+  return 0;
+}
+
+#define MAXBUSYDISKS 16
+
+static cMutex BusyDisksMutex;
+static struct { dev_t device; int users; } BusyDisks[MAXBUSYDISKS];
+
+void SetVideoDiskBusy(dev_t Device, bool On)
+{
+  if (!Device)
+     return;
+  cMutexLock MutexLock(&BusyDisksMutex);
+  int Free = -1;
+  for (int i = 0; i < MAXBUSYDISKS; i++) {
+      if (BusyDisks[i].users && BusyDisks[i].device == Device) {
+         if (On)
+            BusyDisks[i].users++;
+         else
+            BusyDisks[i].users--;
+         return;
+         }
+      if (!BusyDisks[i].users && Free < 0)
+         Free = i;
+      }
+  if (On && Free >= 0) {
+     BusyDisks[Free].device = Device;
+     BusyDisks[Free].users = 1;
+     }
+}
+
+bool VideoDiskBusy(dev_t Device)
+{
+  cMutexLock MutexLock(&BusyDisksMutex);
+  for (int i = 0; i < MAXBUSYDISKS; i++) {
+      if (BusyDisks[i].users && BusyDisks[i].device == Device)
+         return true;
+      }
+  return false;
+}
@@ -11,6 +11,7 @@
 #define __VIDEODIR_H
 
 #include <stdlib.h>
+#include <sys/types.h>
 #include "tools.h"
 
 extern const char *VideoDirectory;
@@ -24,5 +25,13 @@ bool VideoFileSpaceAvailable(int SizeMB);
 int VideoDiskSpace(int *FreeMB = NULL, int *UsedMB = NULL); // returns the used disk space in percent
 cString PrefixVideoFileName(const char *FileName, char Prefix);
 void RemoveEmptyVideoDirectories(void);
+dev_t VideoFileDevice(const char *FileName);
+      // Returns the device the data of the recording with the given FileName is
+      // stored on, or 0 if this can't be determined.
+void SetVideoDiskBusy(dev_t Device, bool On);
+      // Tells background jobs (like the cutter) that a recording or replay is
+      // (On = true) or no longer is using the given Device.
+bool VideoDiskBusy(dev_t Device);
+      // Returns true if a recording or replay is using the given Device.
 
 #endif //__VIDEODIR_H